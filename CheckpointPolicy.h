@@ -0,0 +1,317 @@
+#ifndef CHECKPOINT_POLICY_H
+#define CHECKPOINT_POLICY_H
+
+#include <iostream>
+#include <string>
+
+#include <stdint.h> // uint32_t et al
+
+// Included at the end of "LowImpactProfiler.h", Checkpoint is complete here
+#include "LowImpactProfiler.h"
+
+using namespace std;
+
+//
+// Compile-time checkpoint policies
+//
+// BasicCheckpoint is the checkpoint fast path with its policies fixed at
+// compile time, inlined where it is called. The policies left to runtime
+// are read from the domain's settings, those fixed at compile time are not
+// branched on at all:
+//
+// ThreadingPolicy
+//   MultiThreadedPolicy   each thread has its slot, found with a thread-local load
+//   SingleThreadedPolicy  all the threads share slot 0, Config::numThreads 0
+// ClockPolicy
+//   RuntimeClockPolicy    Config::clockSource
+//   TscClockPolicy, TscpClockPolicy, MonotonicRawClockPolicy, RealtimeClockPolicy
+// LockingPolicy
+//   RuntimeLockingPolicy  Config::useLocking
+//   SequenceLockPolicy    the counters are published with the thread's sequence lock
+//   NoLockingPolicy       not published, for a dump() once the threads are done
+// FeaturePolicy
+//   RuntimeFeaturePolicy  setActive(), sampling, the segment stats, histograms,
+//                         perf counters, CPU time and attribution, transitions
+//                         and trace, as configured
+//   CountersOnlyPolicy    the iterations and times only
+// categoryMask
+//   checkpoint<category>() compiles to nothing if category is not in the mask
+//
+// Checkpoint::checkpoint() is RuntimeCheckpoint, the instantiation with all
+// the runtime policies. The others checkpoint in a domain created with their
+// createDomain(), whose Config is made to agree with the compile-time policies,
+// and that is dumped like any domain:
+//
+//   typedef BasicCheckpoint<MultiThreadedPolicy, TscClockPolicy,
+//                           NoLockingPolicy, CountersOnlyPolicy> FastCheckpoint;
+//   Checkpoint *domain(FastCheckpoint::createDomain("fast", config));
+//   FastCheckpoint::checkpoint(domain, 1);
+//
+
+struct MultiThreadedPolicy
+{
+  static const bool SHARED_SLOT = false;
+};
+
+struct SingleThreadedPolicy
+{
+  static const bool SHARED_SLOT = true;
+};
+
+struct RuntimeClockPolicy
+{
+  static const bool IS_FIXED = false;
+  static const Checkpoint::ClockSource CLOCK_SOURCE = Checkpoint::CLOCK_SOURCE_REALTIME_USEC;
+  static inline uint64_t getCycles(Checkpoint::ClockSource domainClockSource) {
+    return Checkpoint::readClock(domainClockSource);
+  }
+};
+
+template<Checkpoint::ClockSource clockSource>
+struct FixedClockPolicy
+{
+  static const bool IS_FIXED = true;
+  static const Checkpoint::ClockSource CLOCK_SOURCE = clockSource;
+  static inline uint64_t getCycles(Checkpoint::ClockSource) {
+    return Checkpoint::readClock(clockSource);
+  }
+};
+
+typedef FixedClockPolicy<Checkpoint::CLOCK_SOURCE_TSC>           TscClockPolicy;
+typedef FixedClockPolicy<Checkpoint::CLOCK_SOURCE_TSCP>          TscpClockPolicy;
+typedef FixedClockPolicy<Checkpoint::CLOCK_SOURCE_MONOTONIC_RAW> MonotonicRawClockPolicy;
+typedef FixedClockPolicy<Checkpoint::CLOCK_SOURCE_REALTIME_USEC> RealtimeClockPolicy;
+
+struct RuntimeLockingPolicy
+{
+  static const bool IS_FIXED = false;
+  static const bool USE_LOCKING = true;
+  static inline bool useLocking(bool domainUseLocking) { return domainUseLocking; }
+};
+
+struct SequenceLockPolicy
+{
+  static const bool IS_FIXED = true;
+  static const bool USE_LOCKING = true;
+  static inline bool useLocking(bool) { return true; }
+};
+
+struct NoLockingPolicy
+{
+  static const bool IS_FIXED = true;
+  static const bool USE_LOCKING = false;
+  static inline bool useLocking(bool) { return false; }
+};
+
+struct RuntimeFeaturePolicy
+{
+  static const bool USE_FEATURES = true;
+};
+
+struct CountersOnlyPolicy
+{
+  static const bool USE_FEATURES = false;
+};
+
+static const uint32_t ALL_CHECKPOINT_CATEGORIES = 0xffffffff;
+
+//
+// BasicCheckpoint
+//
+// See above. Only has static methods, the state is in the domain.
+//
+template<typename ThreadingPolicy,
+         typename ClockPolicy,
+         typename LockingPolicy,
+         typename FeaturePolicy,
+         uint32_t categoryMask>
+class BasicCheckpoint
+{
+public:
+  // Creates a domain with the settings of the compile-time policies, the
+  // others taken from config. Returns NULL if the domain can't be created,
+  // or if it can't use the clock source, for example a TSC that is not invariant.
+  static Checkpoint *createDomain(const string &name, const Checkpoint::Config &config);
+
+  static inline void checkpoint(Checkpoint *profiler, int checkpoint) {
+    if(FeaturePolicy::USE_FEATURES && __unlikely(!profiler->isActive_)) {
+      return;
+    }
+
+    Checkpoint::ThreadCheckpointInfo *threadCp(ThreadingPolicy::SHARED_SLOT ?
+                                               profiler->threadCpInfoTable_ :
+                                               profiler->getThreadCpInfo());
+
+    // A single compare, which also rejects negative ids
+    if(__unlikely((uint32_t) checkpoint >= threadCp->numCheckpoints_)) {
+      if(!profiler->growCheckpoints(threadCp, checkpoint)) {
+        return;
+      }
+    }
+
+    if(FeaturePolicy::USE_FEATURES && __unlikely(profiler->sampler_ != NULL)) {
+      profiler->sampledCheckpoint(threadCp, checkpoint);
+      return;
+    }
+
+    updateCheckpoint(profiler, threadCp, checkpoint);
+  }
+
+  // Compiles to nothing if category is not in categoryMask
+  template<uint32_t category>
+  static inline void checkpoint(Checkpoint *profiler, int checkpoint) {
+    if((category & categoryMask) != 0) {
+      BasicCheckpoint::checkpoint(profiler, checkpoint);
+    }
+  }
+
+private:
+  // Calibrates the overhead with this fast path
+  friend class Checkpoint;
+
+  BasicCheckpoint();
+
+  // The writer side of the thread's sequence lock, see Checkpoint::beginThreadUpdate()
+  static inline void beginThreadUpdate(Checkpoint *profiler, Checkpoint::ThreadCheckpointInfo *threadCp) {
+    if(__unlikely(LockingPolicy::useLocking(profiler->useLocking_))) {
+      __atomic_store_n(&threadCp->sequence_, threadCp->sequence_ + 1, __ATOMIC_RELAXED);
+      __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+  }
+  static inline void endThreadUpdate(Checkpoint *profiler, Checkpoint::ThreadCheckpointInfo *threadCp) {
+    if(__unlikely(LockingPolicy::useLocking(profiler->useLocking_))) {
+      __atomic_store_n(&threadCp->sequence_, threadCp->sequence_ + 1, __ATOMIC_RELEASE);
+    }
+  }
+
+  // The body of checkpoint(), once the thread's slot is known and holds checkpoint
+  static inline void updateCheckpoint(Checkpoint *profiler,
+                                      Checkpoint::ThreadCheckpointInfo *threadCp,
+                                      int checkpoint) {
+    uint32_t previousCheckpoint                (  threadCp->lastCheckpointHit_ );
+    Checkpoint::CheckpointInfo *currentCp      (  &(threadCp->checkpoints_[checkpoint]) );
+    Checkpoint::CheckpointInfo *previousCp     (  &(threadCp->checkpoints_[previousCheckpoint]) );
+
+    beginThreadUpdate(profiler, threadCp);
+
+    threadCp->lastCheckpointHit_  =  checkpoint;
+
+    // calculate and store deltas
+    ++(currentCp->iterations_);
+    currentCp->previousCycles_ = ClockPolicy::getCycles(profiler->clockSource_);
+    uint64_t elapsedCycles(profiler->subtractOverhead(currentCp->previousCycles_ - previousCp->previousCycles_));
+    currentCp->totalCycles_   += elapsedCycles;
+    if(FeaturePolicy::USE_FEATURES) {
+      if(threadCp->segmentStats_ != NULL) {
+        threadCp->segmentStats_[checkpoint].record(elapsedCycles);
+      }
+      if(threadCp->histograms_ != NULL) {
+        threadCp->histograms_[checkpoint].record(elapsedCycles);
+      }
+      if(threadCp->perfCounters_ != NULL) {
+        uint64_t deltas[PerfCounters::NUM_COUNTERS];
+        threadCp->perfCounters_->readDeltas(deltas);
+        Checkpoint::PerfCounterInfo &perfCounts(threadCp->perfCounts_[checkpoint]);
+        for(uint32_t counter = 0; counter < PerfCounters::NUM_COUNTERS; ++counter) {
+          perfCounts.counts_[counter] += deltas[counter];
+        }
+      }
+      if(threadCp->cpuClock_ != NULL) {
+        threadCp->cpuNanos_[checkpoint] += threadCp->cpuClock_->getDeltaNanos(profiler->cyclesToNanos(currentCp->previousCycles_));
+      }
+      if(threadCp->transitions_ != NULL) {
+        Checkpoint::TransitionInfo &transition((*threadCp->transitions_)[((uint64_t) previousCheckpoint << 32) | (uint32_t) checkpoint]);
+        ++(transition.iterations_);
+        transition.totalCycles_ += elapsedCycles;
+      }
+      if(threadCp->cpuSegments_ != NULL) {
+        profiler->recordCpuSegment(threadCp, checkpoint, elapsedCycles, 1);
+      }
+      if(threadCp->traceRing_ != NULL) {
+        threadCp->traceRing_->push(currentCp->previousCycles_, checkpoint);
+      }
+    }
+
+    endThreadUpdate(profiler, threadCp);
+  }
+};
+
+// The Checkpoint::checkpoint() fast path
+typedef BasicCheckpoint<MultiThreadedPolicy,
+                        RuntimeClockPolicy,
+                        RuntimeLockingPolicy,
+                        RuntimeFeaturePolicy,
+                        ALL_CHECKPOINT_CATEGORIES> RuntimeCheckpoint;
+
+// static
+// The features the fast path doesn't have are turned off, with a NOTICE
+template<typename ThreadingPolicy, typename ClockPolicy, typename LockingPolicy, typename FeaturePolicy, uint32_t categoryMask>
+Checkpoint *BasicCheckpoint<ThreadingPolicy, ClockPolicy, LockingPolicy, FeaturePolicy, categoryMask>::createDomain(
+    const string &name,
+    const Checkpoint::Config &config)
+{
+  Checkpoint::Config domainConfig(config);
+  if(ThreadingPolicy::SHARED_SLOT)
+  {
+    domainConfig.numThreads = 0;
+  }
+  if(ClockPolicy::IS_FIXED)
+  {
+    domainConfig.clockSource = ClockPolicy::CLOCK_SOURCE;
+  }
+  if(LockingPolicy::IS_FIXED)
+  {
+    domainConfig.useLocking = LockingPolicy::USE_LOCKING;
+  }
+  if(!FeaturePolicy::USE_FEATURES)
+  {
+    if(domainConfig.useHistograms || domainConfig.useSegmentStats || domainConfig.usePerfCounters ||
+       domainConfig.useCpuTime || domainConfig.useCpuAttribution ||
+       domainConfig.useTransitions || domainConfig.useScopeTree ||
+       !domainConfig.tracePath.empty() || domainConfig.sampleEvery > 1 ||
+       domainConfig.sampleMicros != 0 || domainConfig.sampleMaxOverheadPercent > 0.0)
+    {
+      cout << "NOTICE: domain [" << name << "] only counts the iterations and times, "
+           << "its histograms, segment stats, perf counters, CPU time and attribution, transitions, "
+           << "scope tree, trace and sampling are turned off"
+           << endl;
+    }
+    domainConfig.useHistograms = false;
+    domainConfig.useSegmentStats = false;
+    domainConfig.usePerfCounters = false;
+    domainConfig.useCpuTime = false;
+    domainConfig.useCpuAttribution = false;
+    domainConfig.useTransitions = false;
+    domainConfig.useScopeTree = false;
+    domainConfig.tracePath.clear();
+    domainConfig.sampleEvery = 1;
+    domainConfig.sampleMicros = 0;
+    domainConfig.sampleMaxOverheadPercent = 0.0;
+  }
+
+  Checkpoint *domain(Checkpoint::createDomain(name, domainConfig));
+  if(domain == NULL)
+  {
+    return NULL;
+  }
+
+  if(ClockPolicy::IS_FIXED && domain->clockSource_ != ClockPolicy::CLOCK_SOURCE)
+  {
+    cout << "NOTICE: domain [" << name << "] can't use the clock source ["
+         << Checkpoint::getClockSourceStr(ClockPolicy::CLOCK_SOURCE)
+         << "] it was compiled with, it is not created"
+         << endl;
+    delete domain;
+    return NULL;
+  }
+
+  // The shared slot is used without a thread-local lookup, so it is set up now
+  if(ThreadingPolicy::SHARED_SLOT)
+  {
+    domain->getThreadCpInfo();
+  }
+
+  return domain;
+}
+
+#endif // CHECKPOINT_POLICY_H
@@ -0,0 +1,191 @@
+
+#include <iostream>
+
+#include <errno.h>
+#include <stdlib.h> // posix_memalign(), free()
+#include <string.h> // strerror()
+#include <time.h>   // clock_gettime()
+
+#include "LowImpactProfiler.h"
+#include "CheckpointSampler.h"
+
+using namespace std;
+
+// How often the overhead is estimated when adapting the interval
+static const uint64_t ADAPT_PERIOD_NANOS = 100000000; // 100 milli-seconds
+
+// The interval is not scaled beyond this
+static const uint32_t MAX_SCALE = (1 << 20);
+
+CheckpointSampler::CheckpointSampler(Checkpoint *profiler,
+                                     uint32_t sampleEvery,
+                                     uint32_t sampleMicros,
+                                     double maxOverheadPercent,
+                                     double sampleCostNanos) :
+    profiler_(profiler),
+    epoch_(NULL),
+    sampleEvery_(sampleEvery > 0 ? sampleEvery : 1),
+    sampleEveryBase_(sampleEvery_),
+    sampleMicros_(sampleMicros),
+    scale_(1),
+    maxOverheadPercent_(maxOverheadPercent),
+    sampleCostNanos_(sampleCostNanos),
+    overheadPercent_(0.0),
+    previousNumSampled_(0),
+    isRunning_(false),
+    stopSampler_(false)
+{
+  void *epoch(NULL);
+  if(posix_memalign(&epoch, Checkpoint::CACHE_LINE_SIZE, Checkpoint::CACHE_LINE_SIZE) != 0)
+  {
+    throw bad_alloc();
+  }
+  epoch_ = (uint32_t*) epoch;
+  *epoch_ = 0;
+
+  pthread_mutex_init(&stopLock_, NULL);
+  pthread_condattr_t conditionAttr;
+  pthread_condattr_init(&conditionAttr);
+  pthread_condattr_setclock(&conditionAttr, CLOCK_MONOTONIC);
+  pthread_cond_init(&stopCondition_, &conditionAttr);
+  pthread_condattr_destroy(&conditionAttr);
+
+  // 1 in N sampling without adapting doesn't need the ticker
+  if(sampleMicros_ == 0 && maxOverheadPercent_ <= 0.0)
+  {
+    return;
+  }
+
+  int retval(pthread_create(&samplerThread_, NULL, samplerEntryPoint, this));
+  if(retval != 0)
+  {
+    cout << "NOTICE: could not create the sampler thread: " << strerror(retval)
+         << ", the sampling interval will not be adapted"
+         << (sampleMicros_ != 0 ? " and only the first segment of each thread will be sampled" : "")
+         << endl;
+    return;
+  }
+  isRunning_ = true;
+}
+
+CheckpointSampler::~CheckpointSampler()
+{
+  stop();
+  pthread_cond_destroy(&stopCondition_);
+  pthread_mutex_destroy(&stopLock_);
+  free(epoch_);
+}
+
+void CheckpointSampler::stop()
+{
+  if(!isRunning_)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&stopLock_);
+  stopSampler_ = true;
+  pthread_cond_signal(&stopCondition_);
+  pthread_mutex_unlock(&stopLock_);
+
+  pthread_join(samplerThread_, NULL);
+  isRunning_ = false;
+}
+
+// static private
+void *CheckpointSampler::samplerEntryPoint(void *sampler)
+{
+  ((CheckpointSampler*) sampler)->run();
+  return NULL;
+}
+
+// private
+// Ticks every sampleMicros * scale_ when time based, otherwise
+// every ADAPT_PERIOD_NANOS just to adapt the interval
+void CheckpointSampler::run()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t nowNanos((now.tv_sec * (uint64_t)1000000000) + now.tv_nsec);
+  uint64_t wakeUpNanos(nowNanos);
+  uint64_t adaptNanos(nowNanos);
+
+  pthread_mutex_lock(&stopLock_);
+  while(!stopSampler_)
+  {
+    wakeUpNanos += (sampleMicros_ != 0 ? (uint64_t) sampleMicros_ * 1000 * scale_ : ADAPT_PERIOD_NANOS);
+    struct timespec wakeUp;
+    wakeUp.tv_sec  = wakeUpNanos / 1000000000;
+    wakeUp.tv_nsec = wakeUpNanos % 1000000000;
+
+    int retval(0);
+    while(!stopSampler_ && retval != ETIMEDOUT)
+    {
+      retval = pthread_cond_timedwait(&stopCondition_, &stopLock_, &wakeUp);
+    }
+    if(stopSampler_)
+    {
+      break;
+    }
+
+    if(sampleMicros_ != 0)
+    {
+      __atomic_store_n(epoch_, *epoch_ + 1, __ATOMIC_RELAXED);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    nowNanos = (now.tv_sec * (uint64_t)1000000000) + now.tv_nsec;
+    if(maxOverheadPercent_ > 0.0 && nowNanos - adaptNanos >= ADAPT_PERIOD_NANOS)
+    {
+      adapt(nowNanos - adaptNanos);
+      adaptNanos = nowNanos;
+    }
+
+    // Don't try to catch up on missed ticks
+    if(wakeUpNanos < nowNanos)
+    {
+      wakeUpNanos = nowNanos;
+    }
+  }
+  pthread_mutex_unlock(&stopLock_);
+}
+
+// private
+// The overhead is the time spent sampling over the time the threads
+// that sampled were running. It is halved below a quarter of the maximum
+// so the interval doesn't oscillate around it.
+void CheckpointSampler::adapt(uint64_t elapsedNanos)
+{
+  // The slot lock keeps the exiting threads from moving their
+  // counts to the retired threads while summing them
+  pthread_mutex_lock(&profiler_->slotLock_);
+  uint32_t numThreadsUsed(profiler_->getNumThreadsUsed());
+  uint64_t numSampled(profiler_->retiredCpInfo_->numSampled_);
+  for(uint32_t slot = 0; slot < numThreadsUsed; ++slot)
+  {
+    numSampled += __atomic_load_n(&(profiler_->getThreadSlot(slot)->numSampled_), __ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&profiler_->slotLock_);
+
+  uint64_t intervalSampled(numSampled - previousNumSampled_);
+  previousNumSampled_ = numSampled;
+  overheadPercent_ = (100.0 * intervalSampled * sampleCostNanos_) /
+                     ((double) elapsedNanos * (numThreadsUsed > 0 ? numThreadsUsed : 1));
+
+  uint32_t scale(scale_);
+  if(overheadPercent_ > maxOverheadPercent_ && scale < MAX_SCALE)
+  {
+    scale *= 2;
+  }
+  else if(overheadPercent_ < maxOverheadPercent_ / 4 && scale > 1)
+  {
+    scale /= 2;
+  }
+
+  if(scale != scale_)
+  {
+    __atomic_store_n(&scale_, scale, __ATOMIC_RELAXED);
+    uint64_t sampleEvery((uint64_t) sampleEveryBase_ * scale);
+    __atomic_store_n(&sampleEvery_, (uint32_t) (sampleEvery < 0x7fffffff ? sampleEvery : 0x7fffffff), __ATOMIC_RELAXED);
+  }
+}
@@ -0,0 +1,106 @@
+#ifndef CHECKPOINT_SAMPLER_H
+#define CHECKPOINT_SAMPLER_H
+
+#include <pthread.h>
+#include <stdint.h> // uint32_t et al
+
+class Checkpoint;
+
+//
+// CheckpointSampler
+//
+// Decides which segments, from one checkpoint to the next on a thread,
+// are timed when sampling. Every checkpoint hit is still counted, but
+// the clock is only read at the start and end of the sampled segments.
+//
+// - 1 in N: each thread counts down a random gap with a mean of N segments,
+//   so loops whose length divides N don't always sample the same segment.
+// - Time based: a ticker thread increments a shared epoch every
+//   sampleMicros. When a thread sees a new epoch, it samples a segment at
+//   a random offset within the first half of the number of segments of the
+//   previous epoch, since the first segment after a tick is more likely to
+//   follow a long one, and the half leaves room for shorter epochs. So it
+//   only does a relaxed load of the epoch per checkpoint.
+// - Adaptive: the ticker thread estimates the profiler overhead from the
+//   number of sampled segments and the cost of sampling one, and doubles
+//   or halves the sampling interval to keep it below maxOverheadPercent.
+//
+class CheckpointSampler
+{
+public:
+  // The interval is 1 in sampleEvery segments, or 1 every sampleMicros if
+  // sampleMicros is not 0. maxOverheadPercent is 0 to not adapt the interval.
+  CheckpointSampler(Checkpoint *profiler,
+                    uint32_t sampleEvery,
+                    uint32_t sampleMicros,
+                    double maxOverheadPercent,
+                    double sampleCostNanos);
+  // Stops the ticker thread if stop() wasn't called
+  ~CheckpointSampler();
+
+  void stop();
+
+  inline bool isTimeBased() const { return sampleMicros_ != 0; }
+
+  // The epoch is on its own cache line, since the ticker writes it
+  inline uint32_t getEpoch() const { return __atomic_load_n(epoch_, __ATOMIC_RELAXED); }
+
+  // Current mean of the 1 in N gaps, raised by the adaptive interval
+  inline uint32_t getSampleEvery() const { return __atomic_load_n(&sampleEvery_, __ATOMIC_RELAXED); }
+
+  // Draws the next 1 in N gap, uniform in [1, 2*sampleEvery - 1]
+  static inline uint32_t getSampleGap(uint32_t &randomState, uint32_t sampleEvery)
+  {
+    return 1 + (getRandom(randomState) % (2 * sampleEvery - 1));
+  }
+
+  // Draws the offset of the sample in an epoch, uniform in [1, numSegments]
+  static inline uint32_t getSampleOffset(uint32_t &randomState, uint32_t numSegments)
+  {
+    return 1 + (getRandom(randomState) % (numSegments > 0 ? numSegments : 1));
+  }
+
+  // The factor the configured interval was multiplied by to bound the overhead
+  inline uint32_t getScale() const { return __atomic_load_n(&scale_, __ATOMIC_RELAXED); }
+  inline double getOverheadPercent() const { return overheadPercent_; }
+  inline double getSampleCostNanos() const { return sampleCostNanos_; }
+  inline uint32_t getSampleMicros() const { return sampleMicros_; }
+  inline double getMaxOverheadPercent() const { return maxOverheadPercent_; }
+
+private:
+  CheckpointSampler();
+  CheckpointSampler(const CheckpointSampler &);
+
+  // xorshift32, randomState must not be 0
+  static inline uint32_t getRandom(uint32_t &randomState)
+  {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+  }
+
+  static void *samplerEntryPoint(void *sampler);
+  void run();
+  // Adjusts scale_ from the segments sampled since the previous call
+  void adapt(uint64_t elapsedNanos);
+
+  Checkpoint *profiler_;
+  uint32_t *epoch_;
+  uint32_t sampleEvery_;
+  uint32_t sampleEveryBase_;
+  uint32_t sampleMicros_;
+  uint32_t scale_;
+  double maxOverheadPercent_;
+  double sampleCostNanos_;
+  double overheadPercent_;
+  uint64_t previousNumSampled_;
+
+  pthread_t samplerThread_;
+  pthread_mutex_t stopLock_;
+  pthread_cond_t stopCondition_;
+  bool isRunning_;
+  bool stopSampler_;
+};
+
+#endif // CHECKPOINT_SAMPLER_H
@@ -0,0 +1,272 @@
+
+#include <sstream>
+
+#include <errno.h>
+#include <fcntl.h>    // open()
+#include <stdio.h>    // rename()
+#include <string.h>   // memcmp, memcpy, strerror()
+#include <unistd.h>   // write(), close()
+#include <sys/mman.h> // mmap()
+#include <sys/stat.h> // fstat()
+
+#include "CheckpointSnapshot.h"
+
+using namespace std;
+
+CheckpointSnapshot::CheckpointSnapshot(const string &path) :
+    path_(path),
+    fd_(-1),
+    fileSize_(0),
+    file_(NULL),
+    header_(NULL)
+{
+  fd_ = open(path.c_str(), O_RDONLY);
+  if(fd_ < 0)
+  {
+    errorStr_ = string("could not open snapshot file: ") + strerror(errno);
+    return;
+  }
+
+  struct stat fileStat;
+  if(fstat(fd_, &fileStat) != 0 || fileStat.st_size < (off_t) sizeof(SnapshotFileHeader))
+  {
+    errorStr_ = "snapshot file is too short";
+    return;
+  }
+  fileSize_ = fileStat.st_size;
+
+  void *file(mmap(NULL, fileSize_, PROT_READ, MAP_PRIVATE, fd_, 0));
+  if(file == MAP_FAILED)
+  {
+    errorStr_ = string("could not map snapshot file: ") + strerror(errno);
+    return;
+  }
+  file_ = (const char*) file;
+
+  const SnapshotFileHeader *header((const SnapshotFileHeader*) file_);
+  if(memcmp(header->magic_, SNAPSHOT_FILE_MAGIC, sizeof(header->magic_)) != 0)
+  {
+    errorStr_ = "not a checkpoint snapshot file";
+    return;
+  }
+  if(header->version_ != SNAPSHOT_FILE_VERSION ||
+     header->headerSize_ != sizeof(SnapshotFileHeader) ||
+     header->checkpointSize_ != sizeof(SnapshotCheckpoint) ||
+     header->histogramSize_ != sizeof(LatencyHistogram) ||
+     header->numPerfCounters_ != PerfCounters::NUM_COUNTERS)
+  {
+    errorStr_ = "unsupported snapshot file version";
+    return;
+  }
+  if(header->fileSize_ != fileSize_ || header->namesOffset_ > fileSize_)
+  {
+    errorStr_ = "snapshot file is truncated";
+    return;
+  }
+
+  // The thread sections are indexed, checking each fits before the names
+  uint64_t offset(header->headerSize_);
+  for(uint32_t thread = 0; thread < header->numThreads_; ++thread)
+  {
+    if(offset + sizeof(SnapshotThread) > header->namesOffset_)
+    {
+      errorStr_ = "snapshot file is truncated";
+      return;
+    }
+    const SnapshotThread *threadSection((const SnapshotThread*) (file_ + offset));
+    offset += getThreadSectionSize(threadSection->flags_, threadSection->numCheckpoints_);
+    if(offset > header->namesOffset_)
+    {
+      errorStr_ = "snapshot file is truncated";
+      return;
+    }
+    threads_.push_back(threadSection);
+  }
+
+  header_ = header;
+  loadNames();
+}
+
+CheckpointSnapshot::~CheckpointSnapshot()
+{
+  if(file_ != NULL)
+  {
+    munmap((void*) file_, fileSize_);
+  }
+  if(fd_ >= 0)
+  {
+    close(fd_);
+  }
+}
+
+// static
+uint64_t CheckpointSnapshot::getThreadSectionSize(uint32_t flags, uint32_t numCheckpoints)
+{
+  uint64_t size(sizeof(SnapshotThread) + (uint64_t) numCheckpoints * sizeof(SnapshotCheckpoint));
+  if(flags & SNAPSHOT_HISTOGRAMS)
+  {
+    size += (uint64_t) numCheckpoints * sizeof(LatencyHistogram);
+  }
+  if(flags & SNAPSHOT_PERF_COUNTS)
+  {
+    size += (uint64_t) numCheckpoints * PerfCounters::NUM_COUNTERS * sizeof(uint64_t);
+  }
+  if(flags & SNAPSHOT_CPU_NANOS)
+  {
+    size += (uint64_t) numCheckpoints * sizeof(uint64_t);
+  }
+
+  return size;
+}
+
+const LatencyHistogram *CheckpointSnapshot::getHistograms(uint32_t index) const
+{
+  const SnapshotThread *thread(threads_[index]);
+  if((thread->flags_ & SNAPSHOT_HISTOGRAMS) == 0)
+  {
+    return NULL;
+  }
+
+  return (const LatencyHistogram*) (getCheckpoints(index) + thread->numCheckpoints_);
+}
+
+const uint64_t *CheckpointSnapshot::getPerfCounts(uint32_t index) const
+{
+  const SnapshotThread *thread(threads_[index]);
+  if((thread->flags_ & SNAPSHOT_PERF_COUNTS) == 0)
+  {
+    return NULL;
+  }
+
+  const char *section((const char*) (getCheckpoints(index) + thread->numCheckpoints_));
+  if(thread->flags_ & SNAPSHOT_HISTOGRAMS)
+  {
+    section += thread->numCheckpoints_ * sizeof(LatencyHistogram);
+  }
+
+  return (const uint64_t*) section;
+}
+
+const uint64_t *CheckpointSnapshot::getCpuNanos(uint32_t index) const
+{
+  const SnapshotThread *thread(threads_[index]);
+  if((thread->flags_ & SNAPSHOT_CPU_NANOS) == 0)
+  {
+    return NULL;
+  }
+
+  // The CPU times are the last array of the section
+  const char *sectionEnd((const char*) thread +
+                         getThreadSectionSize(thread->flags_, thread->numCheckpoints_));
+
+  return ((const uint64_t*) sectionEnd) - thread->numCheckpoints_;
+}
+
+string CheckpointSnapshot::getCheckpointLabel(uint32_t checkpoint) const
+{
+  if(checkpoint < names_.size() && !names_[checkpoint].empty())
+  {
+    return names_[checkpoint];
+  }
+
+  ostringstream label;
+  label << checkpoint;
+  return label.str();
+}
+
+// private
+// The lengths are read with memcpy, the names section is not aligned
+// A name is only kept for a checkpoint some thread section has room for
+void CheckpointSnapshot::loadNames()
+{
+  uint64_t offset(header_->namesOffset_);
+  uint32_t length(0);
+  if(offset == 0 || offset + sizeof(uint32_t) > fileSize_)
+  {
+    return;
+  }
+
+  uint32_t maxCheckpoints(0);
+  for(uint32_t thread = 0; thread < threads_.size(); ++thread)
+  {
+    if(threads_[thread]->numCheckpoints_ > maxCheckpoints)
+    {
+      maxCheckpoints = threads_[thread]->numCheckpoints_;
+    }
+  }
+
+  memcpy(&length, file_ + offset, sizeof(uint32_t));
+  offset += sizeof(uint32_t);
+  if(offset + length + sizeof(uint32_t) > fileSize_)
+  {
+    return;
+  }
+  domainName_.assign(file_ + offset, length);
+  offset += length;
+
+  uint32_t numNames(0);
+  memcpy(&numNames, file_ + offset, sizeof(uint32_t));
+  offset += sizeof(uint32_t);
+  for(uint32_t i = 0; i < numNames && offset + 2*sizeof(uint32_t) <= fileSize_; ++i)
+  {
+    uint32_t checkpoint(0);
+    memcpy(&checkpoint, file_ + offset, sizeof(uint32_t));
+    memcpy(&length, file_ + offset + sizeof(uint32_t), sizeof(uint32_t));
+    offset += 2*sizeof(uint32_t);
+    if(offset + length > fileSize_)
+    {
+      break;
+    }
+
+    if(checkpoint >= maxCheckpoints)
+    {
+      offset += length;
+      continue;
+    }
+    if(checkpoint >= names_.size())
+    {
+      names_.resize(checkpoint + 1);
+    }
+    names_[checkpoint].assign(file_ + offset, length);
+    offset += length;
+  }
+}
+
+// static
+bool CheckpointSnapshot::writeFile(const string &path, const vector<char> &buffer, string &errorStr)
+{
+  string tmpPath(path + ".tmp");
+  int fd(open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+  if(fd < 0)
+  {
+    errorStr = string("could not open snapshot file: ") + strerror(errno);
+    return false;
+  }
+
+  size_t written(0);
+  while(written < buffer.size())
+  {
+    ssize_t retval(write(fd, &(buffer[written]), buffer.size() - written));
+    if(retval < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+      errorStr = string("could not write snapshot file: ") + strerror(errno);
+      close(fd);
+      unlink(tmpPath.c_str());
+      return false;
+    }
+    written += retval;
+  }
+
+  if(close(fd) != 0 || rename(tmpPath.c_str(), path.c_str()) != 0)
+  {
+    errorStr = string("could not write snapshot file: ") + strerror(errno);
+    unlink(tmpPath.c_str());
+    return false;
+  }
+
+  return true;
+}
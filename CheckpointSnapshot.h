@@ -0,0 +1,155 @@
+#ifndef CHECKPOINT_SNAPSHOT_H
+#define CHECKPOINT_SNAPSHOT_H
+
+#include <string>
+#include <vector>
+
+#include <stdint.h> // uint32_t et al
+
+#include "LatencyHistogram.h"
+#include "PerfCounters.h"
+
+using namespace std;
+
+//
+// Checkpoint snapshot file format, version 1
+//
+// All fields are in host byte order, the sections are 8 byte aligned.
+//
+// SnapshotFileHeader, 88 bytes
+//
+// A thread section per thread with checkpoints hit, starting at headerSize:
+//   SnapshotThread
+//   SnapshotCheckpoint x numCheckpoints
+//   LatencyHistogram x numCheckpoints, histogramSize bytes each,
+//     if flags has SNAPSHOT_HISTOGRAMS
+//   uint64_t counts[numPerfCounters] x numCheckpoints, indexed by
+//     PerfCounters::Counter, if flags has SNAPSHOT_PERF_COUNTS
+//   uint64_t cpuNanos x numCheckpoints, if flags has SNAPSHOT_CPU_NANOS
+//
+// Names, at namesOffset
+//   uint32_t domainNameLength, char domainName[domainNameLength]
+//   uint32_t numNames
+//   numNames x { uint32_t checkpoint, uint32_t nameLength, char name[nameLength] }
+//
+
+typedef struct SnapshotFileHeader_s {
+  char     magic_[8];           // SNAPSHOT_FILE_MAGIC, not NULL terminated
+  uint32_t version_;            // SNAPSHOT_FILE_VERSION
+  uint32_t headerSize_;         // sizeof(SnapshotFileHeader)
+  uint32_t checkpointSize_;     // sizeof(SnapshotCheckpoint)
+  uint32_t histogramSize_;      // sizeof(LatencyHistogram)
+  uint32_t numPerfCounters_;    // PerfCounters::NUM_COUNTERS
+  uint32_t perfAvailableMask_;  // bit per PerfCounters::Counter opened by any thread
+  double   nanosPerCycle_;      // to convert the cycles to nano-seconds
+  uint32_t clockSource_;        // Checkpoint::ClockSource
+  uint32_t numThreads_;         // number of thread sections
+  uint64_t snapshotCycles_;     // when the snapshot was taken
+  uint64_t snapshotMicros_;     // CLOCK_REALTIME when the snapshot was taken
+  uint64_t pid_;
+  uint64_t namesOffset_;
+  uint64_t fileSize_;
+} SnapshotFileHeader;
+
+// SnapshotThread::flags_
+static const uint32_t SNAPSHOT_HISTOGRAMS  = 0x1;
+static const uint32_t SNAPSHOT_PERF_COUNTS = 0x2;
+static const uint32_t SNAPSHOT_CPU_NANOS   = 0x4;
+
+// The SnapshotThread::slot_ of the exited threads, merged as one
+static const uint32_t SNAPSHOT_RETIRED_SLOT = 0xffffffff;
+
+typedef struct SnapshotThread_s {
+  uint32_t slot_;               // thread slot, as numbered in Checkpoint::dump()
+  uint32_t flags_;
+  uint32_t numCheckpoints_;     // up to the highest checkpoint hit
+  uint32_t numThreads_;         // 1, or the number of exited threads for the retired slot
+  uint64_t threadId_;           // pthread_t, 0 for the retired slot
+  uint64_t creationCycles_;     // when the thread registered, or the slot was reset
+} SnapshotThread;
+
+// The counters of Checkpoint::CheckpointInfo, with the SegmentStats of the checkpoint
+typedef struct SnapshotCheckpoint_s {
+  uint64_t iterations_;
+  uint64_t totalCycles_;
+  uint64_t previousCycles_;     // when the checkpoint was last hit
+  uint64_t statsCount_;         // 0 unless Checkpoint::Config::useSegmentStats
+  uint64_t statsMin_;
+  uint64_t statsMax_;
+  double   statsMean_;
+  double   statsM2_;
+  uint32_t numThreads_;         // threads that hit the checkpoint
+  uint32_t padding_;
+} SnapshotCheckpoint;
+
+static const char SNAPSHOT_FILE_MAGIC[8] = {'L', 'I', 'P', 'S', 'N', 'A', 'P', 'S'};
+static const uint32_t SNAPSHOT_FILE_VERSION = 1;
+
+//
+// CheckpointSnapshot
+//
+// Reads a snapshot file written with Checkpoint::snapshot(). The file is
+// memory-mapped and validated, the thread sections are then accessed in
+// place. Also has the helpers used to write the file.
+//
+class CheckpointSnapshot
+{
+public:
+  CheckpointSnapshot(const string &path);
+  ~CheckpointSnapshot();
+
+  // false if the snapshot could not be opened or is not a valid snapshot
+  inline bool isOpen() const { return header_ != NULL; }
+  inline const string &getErrorStr() const { return errorStr_; }
+  inline const string &getPath() const { return path_; }
+
+  inline const SnapshotFileHeader &getHeader() const { return *header_; }
+  inline const string &getDomainName() const { return domainName_; }
+
+  inline uint32_t getNumThreads() const { return threads_.size(); }
+  inline const SnapshotThread &getThread(uint32_t index) const { return *threads_[index]; }
+  inline const SnapshotCheckpoint *getCheckpoints(uint32_t index) const {
+    return (const SnapshotCheckpoint*) (threads_[index] + 1);
+  }
+  // These return NULL if the thread has none
+  const LatencyHistogram *getHistograms(uint32_t index) const;
+  // numPerfCounters counts per checkpoint
+  const uint64_t *getPerfCounts(uint32_t index) const;
+  const uint64_t *getCpuNanos(uint32_t index) const;
+
+  // Returns the checkpoint name, or its number if its not named
+  string getCheckpointLabel(uint32_t checkpoint) const;
+
+  // Returns the size of a thread section
+  static uint64_t getThreadSectionSize(uint32_t flags, uint32_t numCheckpoints);
+
+  // Appends data to a snapshot being built in memory
+  static inline void append(vector<char> &buffer, const void *data, size_t length)
+  {
+    buffer.insert(buffer.end(), (const char*) data, (const char*) data + length);
+  }
+
+  // Writes the snapshot to path.tmp, and renames it to path, so a reader
+  // never sees a partial file. Returns false and sets errorStr on errors.
+  static bool writeFile(const string &path, const vector<char> &buffer, string &errorStr);
+
+private:
+  CheckpointSnapshot();
+  CheckpointSnapshot(const CheckpointSnapshot &);
+
+  // Reads the domain and checkpoint names
+  void loadNames();
+
+  string path_;
+  string errorStr_;
+  int fd_;
+  size_t fileSize_;
+  const char *file_;
+  const SnapshotFileHeader *header_;
+  vector<const SnapshotThread*> threads_;
+  string domainName_;
+  // checkpoint id => name, empty if not named
+  vector<string> names_;
+};
+
+#endif // CHECKPOINT_SNAPSHOT_H
@@ -0,0 +1,371 @@
+
+#include <iostream>
+
+#include <errno.h>
+#include <fcntl.h>    // open(), posix_fallocate()
+#include <string.h>   // memcpy, strerror()
+#include <unistd.h>   // ftruncate(), pwrite(), usleep()
+#include <sys/mman.h> // mmap()
+
+#include "CheckpointTrace.h"
+
+using namespace std;
+
+// The file is mapped in windows of this size, must be a multiple of the page size
+static const uint64_t TRACE_WINDOW_SIZE = 16 * 1024 * 1024;
+
+// Records drained from a ring at a time
+static const uint32_t TRACE_DRAIN_BATCH = 4096;
+
+//
+// TraceRing
+//
+
+TraceRing::TraceRing(uint32_t thread, uint32_t capacity) :
+    records_(NULL),
+    head_(0),
+    tailCache_(0),
+    overflows_(0),
+    capacity_(1),
+    mask_(0),
+    thread_(thread),
+    tail_(0)
+{
+  while(capacity_ < capacity)
+  {
+    capacity_ *= 2;
+  }
+  mask_ = capacity_ - 1;
+  records_ = new TraceRecord[capacity_];
+}
+
+TraceRing::~TraceRing()
+{
+  delete [] records_;
+}
+
+// Consumer side
+uint32_t TraceRing::pop(TraceRecord *records, uint32_t maxRecords)
+{
+  uint64_t head(__atomic_load_n(&head_, __ATOMIC_ACQUIRE));
+  uint64_t available(head - tail_);
+  uint32_t numRecords(available < maxRecords ? available : maxRecords);
+
+  for(uint32_t i = 0; i < numRecords; ++i)
+  {
+    records[i] = records_[(tail_ + i) & mask_];
+  }
+  __atomic_store_n(&tail_, tail_ + numRecords, __ATOMIC_RELEASE);
+
+  return numRecords;
+}
+
+//
+// CheckpointTrace
+//
+
+CheckpointTrace::CheckpointTrace(const string &path,
+                                 uint32_t numThreads,
+                                 uint32_t maxThreads,
+                                 uint32_t ringSize,
+                                 uint32_t drainMicros,
+                                 double nanosPerCycle,
+                                 uint32_t clockSource,
+                                 uint64_t startCycles) :
+    path_(path),
+    numRings_(0),
+    ringSize_(ringSize),
+    drainBuffer_(TRACE_DRAIN_BATCH),
+    drainMicros_(drainMicros),
+    fd_(-1),
+    window_(NULL),
+    windowOffset_(0),
+    fileOffset_(0),
+    numRecords_(0),
+    numUnwritten_(0),
+    drainerRunning_(false),
+    stopDrainer_(false)
+{
+  memset(&header_, 0, sizeof(header_));
+  memcpy(header_.magic_, TRACE_FILE_MAGIC, sizeof(header_.magic_));
+  header_.version_       = TRACE_FILE_VERSION;
+  header_.recordSize_    = sizeof(TraceRecord);
+  header_.nanosPerCycle_ = nanosPerCycle;
+  header_.clockSource_   = clockSource;
+  header_.numThreads_    = numThreads;
+  header_.startCycles_   = startCycles;
+
+  fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd_ < 0)
+  {
+    cout << "NOTICE: could not open trace file [" << path
+         << "]: " << strerror(errno) << ", tracing disabled"
+         << endl;
+    return;
+  }
+
+  if(!mapWindow(0))
+  {
+    ::close(fd_);
+    fd_ = -1;
+    return;
+  }
+  append(&header_, sizeof(header_));
+
+  rings_.resize(maxThreads > numThreads ? maxThreads : numThreads, NULL);
+  for(uint32_t thread = 0; thread < numThreads; ++thread)
+  {
+    rings_[thread] = new TraceRing(thread, ringSize);
+  }
+  numRings_ = numThreads;
+
+  int retval(pthread_create(&drainerThread_, NULL, drainerEntryPoint, this));
+  if(retval != 0)
+  {
+    cout << "NOTICE: could not create the trace drainer thread: " << strerror(retval)
+         << ", records will only be drained when the trace is closed"
+         << endl;
+  }
+  else
+  {
+    drainerRunning_ = true;
+  }
+}
+
+CheckpointTrace::~CheckpointTrace()
+{
+  if(isOpen())
+  {
+    close(vector<string>(), 0);
+  }
+
+  for(size_t i = 0; i < rings_.size(); ++i)
+  {
+    delete rings_[i];
+  }
+}
+
+// The ring is published before numRings_, see drainRings()
+TraceRing *CheckpointTrace::getRing(uint32_t thread)
+{
+  if(thread >= rings_.size())
+  {
+    return NULL;
+  }
+
+  if(rings_[thread] == NULL)
+  {
+    __atomic_store_n(&(rings_[thread]), new TraceRing(thread, ringSize_), __ATOMIC_RELEASE);
+    if(thread >= numRings_)
+    {
+      __atomic_store_n(&numRings_, thread + 1, __ATOMIC_RELEASE);
+    }
+  }
+
+  return rings_[thread];
+}
+
+uint64_t CheckpointTrace::getNumOverflows() const
+{
+  uint64_t numOverflows(0);
+  uint32_t numRings(__atomic_load_n(&numRings_, __ATOMIC_ACQUIRE));
+  for(uint32_t i = 0; i < numRings; ++i)
+  {
+    TraceRing *ring(__atomic_load_n(&(rings_[i]), __ATOMIC_ACQUIRE));
+    if(ring != NULL)
+    {
+      numOverflows += ring->getOverflows();
+    }
+  }
+
+  return numOverflows;
+}
+
+void CheckpointTrace::close(const vector<string> &names, int firstNamedCheckpoint)
+{
+  if(!isOpen())
+  {
+    return;
+  }
+
+  if(drainerRunning_)
+  {
+    __atomic_store_n(&stopDrainer_, true, __ATOMIC_RELEASE);
+    pthread_join(drainerThread_, NULL);
+    drainerRunning_ = false;
+  }
+
+  // Whatever the threads pushed after the drainer stopped
+  drainRings();
+
+  if(!names.empty())
+  {
+    header_.namesOffset_ = fileOffset_;
+    uint32_t numNames(names.size());
+    bool namesWritten(append(&numNames, sizeof(numNames)));
+    for(uint32_t i = 0; i < numNames && namesWritten; ++i)
+    {
+      uint32_t checkpoint(firstNamedCheckpoint + i);
+      uint32_t nameLength(names[i].size());
+      namesWritten = (append(&checkpoint, sizeof(checkpoint)) &&
+                      append(&nameLength, sizeof(nameLength)) &&
+                      append(names[i].data(), nameLength));
+    }
+    // A partial name table is cut off, the checkpoints are exported by number
+    if(!namesWritten)
+    {
+      fileOffset_ = header_.namesOffset_;
+      header_.namesOffset_ = 0;
+    }
+  }
+
+  if(numUnwritten_ > 0)
+  {
+    cout << "NOTICE: [" << numUnwritten_ << "] records could not be written to trace file ["
+         << path_ << "], the trace ends at the first of them"
+         << endl;
+  }
+
+  header_.numThreads_ = numRings_;
+  header_.numRecords_ = numRecords_;
+  header_.numOverflows_ = getNumOverflows();
+
+  if(window_ != NULL)
+  {
+    munmap(window_, TRACE_WINDOW_SIZE);
+    window_ = NULL;
+  }
+  // The windows reserved the blocks up to fileOffset_, the rest is cut off
+  int retval(posix_fallocate(fd_, 0, fileOffset_));
+  if(retval == 0 && ftruncate(fd_, fileOffset_) != 0)
+  {
+    retval = errno;
+  }
+  if(retval == 0 && pwrite(fd_, &header_, sizeof(header_), 0) != sizeof(header_))
+  {
+    retval = errno;
+  }
+  if(retval != 0)
+  {
+    cout << "NOTICE: could not complete trace file [" << path_
+         << "]: " << strerror(retval)
+         << endl;
+  }
+  ::close(fd_);
+  fd_ = -1;
+}
+
+// static private
+void *CheckpointTrace::drainerEntryPoint(void *trace)
+{
+  ((CheckpointTrace*) trace)->drain();
+  return NULL;
+}
+
+// private
+// The drainer thread only sleeps when the rings were empty
+void CheckpointTrace::drain()
+{
+  while(!__atomic_load_n(&stopDrainer_, __ATOMIC_ACQUIRE))
+  {
+    if(drainRings() == 0)
+    {
+      usleep(drainMicros_);
+    }
+  }
+}
+
+// private
+uint64_t CheckpointTrace::drainRings()
+{
+  uint64_t numDrained(0);
+  uint64_t numWritten(0);
+  uint32_t numRings(__atomic_load_n(&numRings_, __ATOMIC_ACQUIRE));
+  for(uint32_t thread = 0; thread < numRings; ++thread)
+  {
+    TraceRing *ring(__atomic_load_n(&(rings_[thread]), __ATOMIC_ACQUIRE));
+    if(ring == NULL)
+    {
+      continue;
+    }
+    uint32_t numRecords(ring->pop(&(drainBuffer_[0]), TRACE_DRAIN_BATCH));
+    if(numRecords > 0)
+    {
+      // Once the file can't grow the records are still drained, so the
+      // rings don't overflow, but only counted
+      if(append(&(drainBuffer_[0]), numRecords * sizeof(TraceRecord)))
+      {
+        numWritten += numRecords;
+      }
+      else
+      {
+        numUnwritten_ += numRecords;
+      }
+      numDrained += numRecords;
+    }
+  }
+
+  __atomic_store_n(&numRecords_, numRecords_ + numWritten, __ATOMIC_RELAXED);
+
+  return numDrained;
+}
+
+// private
+// Nothing is appended on failure, the file ends where it did
+bool CheckpointTrace::append(const void *data, size_t length)
+{
+  const uint64_t startOffset(fileOffset_);
+  const char *dataPtr((const char*) data);
+  while(length > 0)
+  {
+    if(window_ == NULL ||
+       (fileOffset_ >= windowOffset_ + TRACE_WINDOW_SIZE && !mapWindow(fileOffset_)))
+    {
+      fileOffset_ = startOffset;
+      return false;
+    }
+
+    size_t windowRemaining(windowOffset_ + TRACE_WINDOW_SIZE - fileOffset_);
+    size_t copyLength(length < windowRemaining ? length : windowRemaining);
+    memcpy(window_ + (fileOffset_ - windowOffset_), dataPtr, copyLength);
+    fileOffset_ += copyLength;
+    dataPtr += copyLength;
+    length -= copyLength;
+  }
+
+  return true;
+}
+
+// private
+bool CheckpointTrace::mapWindow(uint64_t fileOffset)
+{
+  if(window_ != NULL)
+  {
+    munmap(window_, TRACE_WINDOW_SIZE);
+    window_ = NULL;
+  }
+
+  // The blocks are reserved, not just the size set: a write to a hole of
+  // the mapping that the disk can't hold would raise SIGBUS
+  windowOffset_ = (fileOffset / TRACE_WINDOW_SIZE) * TRACE_WINDOW_SIZE;
+  int retval(posix_fallocate(fd_, windowOffset_, TRACE_WINDOW_SIZE));
+  if(retval != 0)
+  {
+    cout << "NOTICE: could not grow trace file [" << path_
+         << "]: " << strerror(retval) << ", tracing stopped"
+         << endl;
+    return false;
+  }
+
+  void *window(mmap(NULL, TRACE_WINDOW_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, windowOffset_));
+  if(window == MAP_FAILED)
+  {
+    cout << "NOTICE: could not map trace file [" << path_
+         << "]: " << strerror(errno) << ", tracing stopped"
+         << endl;
+    return false;
+  }
+  window_ = (char*) window;
+
+  return true;
+}
@@ -0,0 +1,190 @@
+#ifndef CHECKPOINT_TRACE_H
+#define CHECKPOINT_TRACE_H
+
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <stdint.h> // uint32_t et al
+
+using namespace std;
+
+//
+// Checkpoint trace file format, version 1
+//
+// All fields are in host byte order.
+//
+// TraceFileHeader, 64 bytes
+//   The numThreads, numRecords, numOverflows and namesOffset fields are
+//   only filled in when the trace is closed.
+//
+// TraceRecord x numRecords, 16 bytes each, starting at offset 64
+//   Records are in the order they were drained, which is in time order
+//   per thread, but the threads are interleaved in batches. A record of
+//   checkpoint TRACE_THREAD_START is written when a thread claims a slot,
+//   the records after it are of that thread, not of the one that exited.
+//
+// Checkpoint names, at namesOffset
+//   uint32_t numNames
+//   numNames x { uint32_t checkpoint, uint32_t nameLength, char name[nameLength] }
+//
+
+typedef struct TraceFileHeader_s {
+  char     magic_[8];       // TRACE_FILE_MAGIC, not NULL terminated
+  uint32_t version_;        // TRACE_FILE_VERSION
+  uint32_t recordSize_;     // sizeof(TraceRecord)
+  double   nanosPerCycle_;  // to convert TraceRecord::cycles_ to nano-seconds
+  uint32_t clockSource_;    // Checkpoint::ClockSource
+  uint32_t numThreads_;     // number of thread slots, up to the last one traced
+  uint64_t startCycles_;    // cycles when the trace was opened
+  uint64_t numRecords_;
+  uint64_t numOverflows_;   // records dropped because a ring was full
+  uint64_t namesOffset_;    // 0 if there are no names
+} TraceFileHeader;
+
+typedef struct TraceRecord_s {
+  uint64_t cycles_;
+  uint32_t checkpoint_;
+  uint32_t thread_;         // thread slot, as numbered in Checkpoint::dump()
+} TraceRecord;
+
+static const char TRACE_FILE_MAGIC[8] = {'L', 'I', 'P', 'T', 'R', 'A', 'C', 'E'};
+static const uint32_t TRACE_FILE_VERSION = 1;
+// Reserved checkpoint id, above Checkpoint::MAX_CHECKPOINT_ID
+static const uint32_t TRACE_THREAD_START = 0xffffffff;
+
+//
+// TraceRing
+//
+// Wait-free single producer, single consumer ring of TraceRecords.
+// The producer is the thread owning the ring, the consumer is the
+// CheckpointTrace drainer thread. When the ring is full the record
+// is dropped and counted, the producer never waits.
+//
+class TraceRing
+{
+public:
+  TraceRing(uint32_t thread, uint32_t capacity);
+  ~TraceRing();
+
+  // Producer side, called from Checkpoint::checkpoint()
+  inline void push(uint64_t cycles, uint32_t checkpoint)
+  {
+    if(__builtin_expect(head_ - tailCache_ >= capacity_, 0))
+    {
+      // Only re-read the consumer's index when the ring looks full,
+      // so the producer usually doesn't touch the consumer's cache line
+      tailCache_ = __atomic_load_n(&tail_, __ATOMIC_ACQUIRE);
+      if(head_ - tailCache_ >= capacity_)
+      {
+        __atomic_store_n(&overflows_, overflows_ + 1, __ATOMIC_RELAXED);
+        return;
+      }
+    }
+
+    TraceRecord *record(&(records_[head_ & mask_]));
+    record->cycles_ = cycles;
+    record->checkpoint_ = checkpoint;
+    record->thread_ = thread_;
+    __atomic_store_n(&head_, head_ + 1, __ATOMIC_RELEASE);
+  }
+
+  // Consumer side, copies up to maxRecords into records
+  // returns the number of records copied
+  uint32_t pop(TraceRecord *records, uint32_t maxRecords);
+
+  inline uint64_t getOverflows() const { return __atomic_load_n(&overflows_, __ATOMIC_RELAXED); }
+
+private:
+  TraceRing();
+  TraceRing(const TraceRing &);
+
+  // Producer cache line
+  TraceRecord *records_;
+  uint64_t head_;
+  uint64_t tailCache_;
+  uint64_t overflows_;
+  uint32_t capacity_;
+  uint32_t mask_;
+  uint32_t thread_;
+
+  // Consumer cache line
+  uint64_t tail_ __attribute__((aligned(64)));
+} __attribute__((aligned(64)));
+
+//
+// CheckpointTrace
+//
+// Owns a TraceRing per thread slot and a drainer thread that streams
+// the rings into a memory-mapped, append-only trace file. The rings of
+// the first numThreads slots are created with the trace, those of the
+// slots up to maxThreads when the slot is first used, see getRing().
+//
+class CheckpointTrace
+{
+public:
+  // ringSize is rounded up to a power of 2
+  CheckpointTrace(const string &path,
+                  uint32_t numThreads,
+                  uint32_t maxThreads,
+                  uint32_t ringSize,
+                  uint32_t drainMicros,
+                  double nanosPerCycle,
+                  uint32_t clockSource,
+                  uint64_t startCycles);
+  // Stops the drainer if close() wasn't called
+  ~CheckpointTrace();
+
+  // false if the trace file could not be created
+  inline bool isOpen() const { return fd_ >= 0; }
+
+  // Creates the ring of the slot if it has none yet, the callers must not
+  // race for the same slot. Returns NULL if thread is not below maxThreads.
+  TraceRing *getRing(uint32_t thread);
+
+  // Stops the drainer, drains what is left in the rings, appends the
+  // checkpoint names and completes the header. names are indexed by
+  // checkpoint - firstNamedCheckpoint.
+  void close(const vector<string> &names, int firstNamedCheckpoint);
+
+  inline const string &getPath() const { return path_; }
+  inline uint64_t getNumRecords() const { return __atomic_load_n(&numRecords_, __ATOMIC_RELAXED); }
+  uint64_t getNumOverflows() const;
+
+private:
+  CheckpointTrace();
+  CheckpointTrace(const CheckpointTrace &);
+
+  static void *drainerEntryPoint(void *trace);
+  void drain();
+  // returns the number of records drained, written or not
+  uint64_t drainRings();
+  // false if the file could not grow, then nothing was appended
+  bool append(const void *data, size_t length);
+  // maps the window holding fileOffset, growing the file if needed
+  bool mapWindow(uint64_t fileOffset);
+
+  string path_;
+  // Sized to maxThreads and never resized, the drainer reads the
+  // entries below numRings_, which are NULL until their slot is used
+  vector<TraceRing*> rings_;
+  uint32_t numRings_;
+  uint32_t ringSize_;
+  vector<TraceRecord> drainBuffer_;
+  uint32_t drainMicros_;
+  TraceFileHeader header_;
+
+  int fd_;
+  char *window_;
+  uint64_t windowOffset_;
+  uint64_t fileOffset_;
+  uint64_t numRecords_;
+  // Drained after the file could not grow, only read when closing
+  uint64_t numUnwritten_;
+
+  pthread_t drainerThread_;
+  bool drainerRunning_;
+  bool stopDrainer_;
+};
+
+#endif // CHECKPOINT_TRACE_H
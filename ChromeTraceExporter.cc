@@ -0,0 +1,301 @@
+
+#include <sstream>
+
+#include <errno.h>
+#include <fcntl.h>    // open()
+#include <string.h>   // memcmp, strerror()
+#include <unistd.h>   // write()
+#include <sys/mman.h> // mmap()
+#include <sys/stat.h> // fstat()
+
+#include "ChromeTraceExporter.h"
+
+using namespace std;
+
+ChromeTraceExporter::ChromeTraceExporter(const string &tracePath) :
+    fd_(-1),
+    fileSize_(0),
+    file_(NULL),
+    header_(NULL),
+    outBuffer_(NULL),
+    outUsed_(0),
+    outFd_(-1),
+    outError_(false),
+    numSlices_(0)
+{
+  fd_ = open(tracePath.c_str(), O_RDONLY);
+  if(fd_ < 0)
+  {
+    errorStr_ = string("could not open trace file: ") + strerror(errno);
+    return;
+  }
+
+  struct stat fileStat;
+  if(fstat(fd_, &fileStat) != 0 || fileStat.st_size < (off_t) sizeof(TraceFileHeader))
+  {
+    errorStr_ = "trace file is too short";
+    return;
+  }
+  fileSize_ = fileStat.st_size;
+
+  void *file(mmap(NULL, fileSize_, PROT_READ, MAP_SHARED, fd_, 0));
+  if(file == MAP_FAILED)
+  {
+    errorStr_ = string("could not map trace file: ") + strerror(errno);
+    return;
+  }
+  file_ = (const char*) file;
+  madvise(file, fileSize_, MADV_SEQUENTIAL);
+
+  const TraceFileHeader *header((const TraceFileHeader*) file_);
+  if(memcmp(header->magic_, TRACE_FILE_MAGIC, sizeof(header->magic_)) != 0)
+  {
+    errorStr_ = "not a checkpoint trace file";
+    return;
+  }
+  if(header->version_ != TRACE_FILE_VERSION || header->recordSize_ != sizeof(TraceRecord))
+  {
+    errorStr_ = "unsupported trace file version";
+    return;
+  }
+  if(sizeof(TraceFileHeader) + header->numRecords_ * sizeof(TraceRecord) > fileSize_)
+  {
+    errorStr_ = "trace file is truncated, or the trace was not closed";
+    return;
+  }
+
+  header_ = header;
+  loadLabels();
+}
+
+ChromeTraceExporter::~ChromeTraceExporter()
+{
+  if(file_ != NULL)
+  {
+    munmap((void*) file_, fileSize_);
+  }
+  if(fd_ >= 0)
+  {
+    close(fd_);
+  }
+  delete [] outBuffer_;
+}
+
+// private
+// The labels are JSON escaped once here, instead of for every slice
+void ChromeTraceExporter::loadLabels()
+{
+  uint64_t offset(header_->namesOffset_);
+  if(offset == 0 || offset + sizeof(uint32_t) > fileSize_)
+  {
+    return;
+  }
+
+  uint32_t numNames(*((const uint32_t*) (file_ + offset)));
+  offset += sizeof(uint32_t);
+  for(uint32_t i = 0; i < numNames && offset + 2*sizeof(uint32_t) <= fileSize_; ++i)
+  {
+    uint32_t checkpoint(*((const uint32_t*) (file_ + offset)));
+    uint32_t nameLength(*((const uint32_t*) (file_ + offset + sizeof(uint32_t))));
+    offset += 2*sizeof(uint32_t);
+    if(offset + nameLength > fileSize_)
+    {
+      break;
+    }
+
+    string label;
+    for(uint32_t c = 0; c < nameLength; ++c)
+    {
+      char ch(file_[offset + c]);
+      if(ch == '"' || ch == '\\')
+      {
+        label += '\\';
+      }
+      label += ((unsigned char) ch < 0x20 ? ' ' : ch);
+    }
+    offset += nameLength;
+
+    if(checkpoint >= labels_.size())
+    {
+      labels_.resize(checkpoint + 1);
+    }
+    labels_[checkpoint] = label;
+  }
+}
+
+// private
+const string &ChromeTraceExporter::getLabel(uint32_t checkpoint)
+{
+  if(checkpoint < labels_.size() && !labels_[checkpoint].empty())
+  {
+    return labels_[checkpoint];
+  }
+
+  ostringstream label;
+  label << checkpoint;
+  numberLabel_ = label.str();
+  return numberLabel_;
+}
+
+// private
+void ChromeTraceExporter::append(const char *str, size_t length)
+{
+  if(outUsed_ + length > OUTPUT_BUFFER_SIZE)
+  {
+    flush();
+  }
+  memcpy(outBuffer_ + outUsed_, str, length);
+  outUsed_ += length;
+}
+
+// private
+void ChromeTraceExporter::appendUint(uint64_t value)
+{
+  char digits[24];
+  int pos(sizeof(digits));
+  do
+  {
+    digits[--pos] = '0' + (value % 10);
+    value /= 10;
+  } while(value != 0);
+
+  append(digits + pos, sizeof(digits) - pos);
+}
+
+// private
+void ChromeTraceExporter::appendMicros(uint64_t nanos)
+{
+  appendUint(nanos / 1000);
+  char decimals[4] = {'.',
+                      (char) ('0' + (nanos / 100) % 10),
+                      (char) ('0' + (nanos / 10) % 10),
+                      (char) ('0' + nanos % 10)};
+  append(decimals, sizeof(decimals));
+}
+
+// private
+bool ChromeTraceExporter::flush()
+{
+  size_t written(0);
+  while(written < outUsed_ && !outError_)
+  {
+    ssize_t retval(write(outFd_, outBuffer_ + written, outUsed_ - written));
+    if(retval < 0)
+    {
+      if(errno == EINTR)
+      {
+        continue;
+      }
+      errorStr_ = string("could not write the JSON: ") + strerror(errno);
+      outError_ = true;
+    }
+    else
+    {
+      written += retval;
+    }
+  }
+  outUsed_ = 0;
+
+  return !outError_;
+}
+
+bool ChromeTraceExporter::exportTo(int fd)
+{
+  if(!isOpen())
+  {
+    return false;
+  }
+
+  if(outBuffer_ == NULL)
+  {
+    outBuffer_ = new char[OUTPUT_BUFFER_SIZE];
+  }
+  outFd_ = fd;
+  outUsed_ = 0;
+  outError_ = false;
+  numSlices_ = 0;
+
+  // The last record seen on each thread, the start of the next slice,
+  // and the track of the thread that has the slot
+  vector<const TraceRecord*> lastRecords(header_->numThreads_, (const TraceRecord*) NULL);
+  vector<uint32_t> tracks(header_->numThreads_, 0);
+  vector<uint32_t> numTracks(header_->numThreads_, 0);
+  uint32_t nextTrack(0);
+  const double nanosPerCycle(header_->nanosPerCycle_);
+  const uint64_t startCycles(header_->startCycles_);
+  bool firstEvent(true);
+
+  const char EVENTS_START[] = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+  append(EVENTS_START, sizeof(EVENTS_START) - 1);
+
+  const TraceRecord *record((const TraceRecord*) (file_ + sizeof(TraceFileHeader)));
+  const TraceRecord *lastRecord(record + header_->numRecords_);
+  for(; record < lastRecord && !outError_; ++record)
+  {
+    if(record->thread_ >= lastRecords.size())
+    {
+      lastRecords.resize(record->thread_ + 1, (const TraceRecord*) NULL);
+      tracks.resize(record->thread_ + 1, 0);
+      numTracks.resize(record->thread_ + 1, 0);
+    }
+
+    // A new thread has the slot, its first record starts a new track
+    if(record->checkpoint_ == TRACE_THREAD_START)
+    {
+      lastRecords[record->thread_] = NULL;
+      continue;
+    }
+
+    const TraceRecord *previous(lastRecords[record->thread_]);
+    lastRecords[record->thread_] = record;
+
+    if(previous == NULL)
+    {
+      // First record of this thread, name the track. The later threads
+      // of a slot are named "Thread <slot> #<n>".
+      tracks[record->thread_] = nextTrack++;
+      ++numTracks[record->thread_];
+      const char THREAD_NAME[] = "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":";
+      if(!firstEvent)
+      {
+        append(",\n", 2);
+      }
+      firstEvent = false;
+      append(THREAD_NAME, sizeof(THREAD_NAME) - 1);
+      appendUint(tracks[record->thread_]);
+      append(",\"args\":{\"name\":\"Thread ", 24);
+      appendUint(record->thread_);
+      if(numTracks[record->thread_] > 1)
+      {
+        append(" #", 2);
+        appendUint(numTracks[record->thread_]);
+      }
+      append("\"}}", 3);
+      continue;
+    }
+
+    uint64_t startNanos(previous->cycles_ > startCycles ?
+                        (uint64_t) ((previous->cycles_ - startCycles) * nanosPerCycle) : 0);
+    uint64_t durationNanos(record->cycles_ > previous->cycles_ ?
+                           (uint64_t) ((record->cycles_ - previous->cycles_) * nanosPerCycle) : 0);
+
+    const char SLICE[] = ",\n{\"ph\":\"X\",\"cat\":\"checkpoint\",\"pid\":1,\"tid\":";
+    append(SLICE, sizeof(SLICE) - 1);
+    appendUint(tracks[record->thread_]);
+    append(",\"ts\":", 6);
+    appendMicros(startNanos);
+    append(",\"dur\":", 7);
+    appendMicros(durationNanos);
+    append(",\"name\":\"", 9);
+    append(getLabel(previous->checkpoint_));
+    append(" -> ", 4);
+    append(getLabel(record->checkpoint_));
+    append("\"}", 2);
+    ++numSlices_;
+  }
+
+  const char EVENTS_END[] = "\n]}\n";
+  append(EVENTS_END, sizeof(EVENTS_END) - 1);
+
+  return flush();
+}
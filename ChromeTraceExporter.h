@@ -0,0 +1,81 @@
+#ifndef CHROME_TRACE_EXPORTER_H
+#define CHROME_TRACE_EXPORTER_H
+
+#include <string>
+#include <vector>
+
+#include <stdint.h> // uint32_t et al
+
+#include "CheckpointTrace.h"
+
+using namespace std;
+
+//
+// ChromeTraceExporter
+//
+// Converts a checkpoint trace file (see "CheckpointTrace.h") into the
+// trace-event JSON format loaded by chrome://tracing and Perfetto.
+//
+// Each thread becomes a track, and each pair of consecutive checkpoints
+// on a thread becomes a complete ("ph":"X") duration slice named
+// "from -> to", which also covers ScopedCheckpoint entry/exit pairs.
+// A thread slot reused by a new thread is a new track, the slices never
+// join the last checkpoint of a thread to the first of the next one.
+//
+// The trace file is memory-mapped and the JSON is formatted into a
+// fixed-size buffer that is written out when full, so traces of any
+// size are exported without holding the events in memory.
+//
+
+class ChromeTraceExporter
+{
+public:
+  ChromeTraceExporter(const string &tracePath);
+  ~ChromeTraceExporter();
+
+  // false if the trace could not be opened or is not a valid trace
+  inline bool isOpen() const { return header_ != NULL; }
+  inline const string &getErrorStr() const { return errorStr_; }
+
+  // Writes the JSON to the file descriptor, returns false on write errors
+  bool exportTo(int fd);
+
+  inline uint64_t getNumRecords() const { return (header_ == NULL ? 0 : header_->numRecords_); }
+  inline uint64_t getNumOverflows() const { return (header_ == NULL ? 0 : header_->numOverflows_); }
+  inline uint64_t getNumSlices() const { return numSlices_; }
+
+private:
+  ChromeTraceExporter();
+  ChromeTraceExporter(const ChromeTraceExporter &);
+
+  static const size_t OUTPUT_BUFFER_SIZE = 1024 * 1024;
+
+  // Reads the name table into labels_
+  void loadLabels();
+  const string &getLabel(uint32_t checkpoint);
+
+  void append(const char *str, size_t length);
+  inline void append(const string &str) { append(str.data(), str.size()); }
+  void appendUint(uint64_t value);
+  // chrome tracing timestamps are in micro-seconds, with nano-second decimals
+  void appendMicros(uint64_t nanos);
+  bool flush();
+
+  string errorStr_;
+  int fd_;
+  size_t fileSize_;
+  const char *file_;
+  const TraceFileHeader *header_;
+
+  // checkpoint id => JSON escaped label
+  vector<string> labels_;
+  string numberLabel_;
+
+  char *outBuffer_;
+  size_t outUsed_;
+  int outFd_;
+  bool outError_;
+  uint64_t numSlices_;
+};
+
+#endif // CHROME_TRACE_EXPORTER_H
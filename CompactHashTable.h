@@ -0,0 +1,164 @@
+#ifndef COMPACT_HASH_TABLE_H
+#define COMPACT_HASH_TABLE_H
+
+#include <vector>
+
+#include <stdint.h> // uint32_t et al
+
+using namespace std;
+
+//
+// CompactHashTable
+//
+// An open-addressing (linear probing) hash table of uint64_t keys to Values,
+// kept at most half full. It has a single writer, the thread owning it,
+// and readers on other threads may copy it with copyEntries() while it
+// is being written, with the owner's sequence lock to retry inconsistent
+// copies. So the entries arrays replaced when growing are only freed when
+// the table is destroyed, and the new array is published before the new
+// capacity.
+//
+// Value must be copyable with memcpy, and is value-initialized on insertion.
+// The key EMPTY_KEY can not be used.
+//
+
+template<typename Value>
+class CompactHashTable
+{
+public:
+  static const uint64_t EMPTY_KEY = ~((uint64_t) 0);
+
+  typedef struct Entry_s {
+    uint64_t key_;
+    Value value_;
+  } Entry;
+
+  // initialCapacity is rounded up to a power of 2
+  CompactHashTable(uint32_t initialCapacity = 64) :
+      entries_(NULL),
+      capacity_(1),
+      size_(0)
+  {
+    while(capacity_ < initialCapacity)
+    {
+      capacity_ *= 2;
+    }
+    entries_ = allocateEntries(capacity_);
+  }
+
+  ~CompactHashTable()
+  {
+    delete [] entries_;
+    for(size_t i = 0; i < retiredEntries_.size(); ++i)
+    {
+      delete [] retiredEntries_[i];
+    }
+  }
+
+  // Returns the value of the key, inserting it if its not in the table
+  inline Value &operator[](uint64_t key)
+  {
+    uint32_t mask(capacity_ - 1);
+    for(uint32_t index = hash(key) & mask; ; index = (index + 1) & mask)
+    {
+      Entry *entry(&(entries_[index]));
+      if(__builtin_expect(entry->key_ == key, 1))
+      {
+        return entry->value_;
+      }
+      if(entry->key_ == EMPTY_KEY)
+      {
+        if(__builtin_expect(2 * (size_ + 1) > capacity_, 0))
+        {
+          grow();
+          return (*this)[key];
+        }
+        entry->value_ = Value();
+        __atomic_store_n(&entry->key_, key, __ATOMIC_RELEASE);
+        ++size_;
+        return entry->value_;
+      }
+    }
+  }
+
+  // Removes all of the keys, the capacity is kept
+  void clear()
+  {
+    for(uint32_t index = 0; index < capacity_; ++index)
+    {
+      entries_[index].key_ = EMPTY_KEY;
+    }
+    size_ = 0;
+  }
+
+  inline uint32_t getSize() const { return size_; }
+
+  // To sort copied entries by key
+  static bool isKeyLess(const Entry &lhs, const Entry &rhs) { return lhs.key_ < rhs.key_; }
+
+  // Appends the entries in use to entries, in no particular order.
+  // May be called from any thread, see the class comment.
+  void copyEntries(vector<Entry> &entries) const
+  {
+    uint32_t capacity(__atomic_load_n(&capacity_, __ATOMIC_ACQUIRE));
+    const Entry *tableEntries(__atomic_load_n(&entries_, __ATOMIC_ACQUIRE));
+    for(uint32_t index = 0; index < capacity; ++index)
+    {
+      if(__atomic_load_n(&(tableEntries[index].key_), __ATOMIC_ACQUIRE) != EMPTY_KEY)
+      {
+        entries.push_back(tableEntries[index]);
+      }
+    }
+  }
+
+private:
+  CompactHashTable(const CompactHashTable &);
+  CompactHashTable &operator=(const CompactHashTable &);
+
+  // Fibonacci hashing, the high bits are the best mixed
+  static inline uint32_t hash(uint64_t key)
+  {
+    return (uint32_t) ((key * 0x9E3779B97F4A7C15ULL) >> 32);
+  }
+
+  static Entry *allocateEntries(uint32_t capacity)
+  {
+    Entry *entries(new Entry[capacity]);
+    for(uint32_t index = 0; index < capacity; ++index)
+    {
+      entries[index].key_ = EMPTY_KEY;
+    }
+    return entries;
+  }
+
+  void grow()
+  {
+    uint32_t capacity(capacity_ * 2);
+    uint32_t mask(capacity - 1);
+    Entry *entries(allocateEntries(capacity));
+    for(uint32_t oldIndex = 0; oldIndex < capacity_; ++oldIndex)
+    {
+      if(entries_[oldIndex].key_ == EMPTY_KEY)
+      {
+        continue;
+      }
+      uint32_t index(hash(entries_[oldIndex].key_) & mask);
+      while(entries[index].key_ != EMPTY_KEY)
+      {
+        index = (index + 1) & mask;
+      }
+      entries[index] = entries_[oldIndex];
+    }
+
+    retiredEntries_.push_back(entries_);
+    __atomic_store_n(&entries_, entries, __ATOMIC_RELEASE);
+    __atomic_store_n(&capacity_, capacity, __ATOMIC_RELEASE);
+  }
+
+  Entry *entries_;
+  uint32_t capacity_;
+  uint32_t size_;
+  vector<Entry*> retiredEntries_;
+};
+
+#endif // COMPACT_HASH_TABLE_H
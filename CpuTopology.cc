@@ -0,0 +1,126 @@
+
+#include <fstream>
+#include <sstream>
+
+#include <dirent.h> // opendir()
+#include <stdlib.h> // strtoul()
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>  // __get_cpuid()
+#endif
+
+#include "CpuTopology.h"
+
+using namespace std;
+
+static const char *NODE_DIR = "/sys/devices/system/node";
+
+CpuTopology::CpuTopology() :
+    useRdtscp_(false),
+    numNodes_(1)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int eax, ebx, ecx, edx;
+  if(__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) && (edx & (1 << 27)) != 0)
+  {
+    // TSC_AUX is only set up by Linux, check it on this CPU
+    unsigned int aux;
+    __rdtscp(&aux);
+    int cpu(sched_getcpu());
+    useRdtscp_ = (cpu >= 0 && (uint32_t) cpu == (aux & 0xfff));
+  }
+#endif
+
+  readNodes();
+}
+
+// static
+bool CpuTopology::parseCpuList(const string &cpuList, vector<uint32_t> &cpus)
+{
+  cpus.clear();
+
+  istringstream ranges(cpuList);
+  string range;
+  while(getline(ranges, range, ','))
+  {
+    if(range.empty() || range == "\n")
+    {
+      continue;
+    }
+
+    char *end(NULL);
+    unsigned long first(strtoul(range.c_str(), &end, 10));
+    unsigned long last(first);
+    if(end == range.c_str())
+    {
+      return false;
+    }
+    if(*end == '-')
+    {
+      const char *lastStr(end + 1);
+      last = strtoul(lastStr, &end, 10);
+      if(end == lastStr || last < first)
+      {
+        return false;
+      }
+    }
+    if(*end != '\0' && *end != '\n')
+    {
+      return false;
+    }
+
+    for(unsigned long cpu = first; cpu <= last; ++cpu)
+    {
+      cpus.push_back(cpu);
+    }
+  }
+
+  return true;
+}
+
+// private
+void CpuTopology::readNodes()
+{
+  DIR *nodeDir(opendir(NODE_DIR));
+  if(nodeDir == NULL)
+  {
+    return;
+  }
+
+  uint32_t maxNode(0);
+  struct dirent *entry;
+  while((entry = readdir(nodeDir)) != NULL)
+  {
+    string name(entry->d_name);
+    if(name.compare(0, 4, "node") != 0 || name.size() == 4 ||
+       name.find_first_not_of("0123456789", 4) != string::npos)
+    {
+      continue;
+    }
+    uint32_t node(strtoul(name.c_str() + 4, NULL, 10));
+
+    ifstream cpuListFile((string(NODE_DIR) + "/" + name + "/cpulist").c_str());
+    string cpuList;
+    vector<uint32_t> cpus;
+    if(!getline(cpuListFile, cpuList) || !parseCpuList(cpuList, cpus))
+    {
+      continue;
+    }
+
+    for(size_t i = 0; i < cpus.size(); ++i)
+    {
+      if(cpus[i] >= cpuNodes_.size())
+      {
+        cpuNodes_.resize(cpus[i] + 1, 0);
+      }
+      cpuNodes_[cpus[i]] = node;
+    }
+    if(node > maxNode)
+    {
+      maxNode = node;
+    }
+  }
+  closedir(nodeDir);
+
+  numNodes_ = maxNode + 1;
+}
@@ -0,0 +1,74 @@
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <string>
+#include <vector>
+
+#include <sched.h>  // sched_getcpu()
+#include <stdint.h> // uint32_t et al
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // __rdtscp()
+#endif
+
+using namespace std;
+
+//
+// CpuTopology
+//
+// The CPU the calling thread runs on, and the NUMA node of each CPU.
+//
+// On x86 the kernel sets the TSC_AUX register of each CPU to its number,
+// in the low 12 bits, and its node above them, so rdtscp returns the CPU
+// without a system call. It is only used if the CPU has rdtscp and the
+// register agrees with sched_getcpu(), which is used otherwise: a vDSO
+// call, or a read of the rseq area with a recent glibc.
+//
+// The nodes are read from sysfs, /sys/devices/system/node/node<N>/cpulist.
+// Without it, every CPU is on node 0.
+//
+class CpuTopology
+{
+public:
+  CpuTopology();
+
+  inline uint32_t getCurrentCpu() const
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    if(useRdtscp_)
+    {
+      unsigned int aux;
+      __rdtscp(&aux);
+      return aux & 0xfff;
+    }
+#endif
+    int cpu(sched_getcpu());
+    return (cpu >= 0 ? cpu : 0);
+  }
+
+  inline uint32_t getNode(uint32_t cpu) const
+  {
+    return (cpu < cpuNodes_.size() ? cpuNodes_[cpu] : 0);
+  }
+
+  inline uint32_t getNumNodes() const { return numNodes_; }
+
+  // "rdtscp" or "sched_getcpu"
+  inline const char *getCpuSourceStr() const { return (useRdtscp_ ? "rdtscp" : "sched_getcpu"); }
+
+  // Parses a sysfs CPU list, like "0-3,8,10-11", into cpus.
+  // Returns false if it is malformed.
+  static bool parseCpuList(const string &cpuList, vector<uint32_t> &cpus);
+
+private:
+  CpuTopology(const CpuTopology &);
+
+  void readNodes();
+
+  bool useRdtscp_;
+  // Indexed by CPU
+  vector<uint32_t> cpuNodes_;
+  uint32_t numNodes_;
+};
+
+#endif // CPU_TOPOLOGY_H
@@ -0,0 +1,258 @@
+
+#include <iostream>
+
+#include <errno.h>
+#include <string.h> // strerror()
+#include <time.h>   // clock_gettime()
+
+#include "LowImpactProfiler.h"
+#include "IntervalReporter.h"
+
+using namespace std;
+
+// Checkpoint names are quoted if they hold CSV separators or quotes
+static string getCsvLabel(const string &label)
+{
+  if(label.find_first_of(",\"\n") == string::npos)
+  {
+    return label;
+  }
+
+  string quoted("\"");
+  for(size_t i = 0; i < label.size(); ++i)
+  {
+    quoted += label[i];
+    if(label[i] == '"')
+    {
+      quoted += '"';
+    }
+  }
+  quoted += '"';
+
+  return quoted;
+}
+
+IntervalReporter::IntervalReporter(Checkpoint *profiler, const string &path, uint32_t intervalMillis) :
+    profiler_(profiler),
+    path_(path),
+    intervalMillis_(intervalMillis > 0 ? intervalMillis : 1),
+    startCycles_(profiler_->getCycles()),
+    previousCycles_(startCycles_),
+    numIntervals_(0),
+    isRunning_(false),
+    stopReporter_(false)
+{
+  pthread_mutex_init(&stopLock_, NULL);
+  pthread_condattr_t conditionAttr;
+  pthread_condattr_init(&conditionAttr);
+  pthread_condattr_setclock(&conditionAttr, CLOCK_MONOTONIC);
+  pthread_cond_init(&stopCondition_, &conditionAttr);
+  pthread_condattr_destroy(&conditionAttr);
+
+  out_.open(path.c_str(), ios::out | ios::trunc);
+  if(!out_.is_open())
+  {
+    cout << "NOTICE: could not open interval report file [" << path
+         << "], interval reporting disabled"
+         << endl;
+    return;
+  }
+  out_ << "endNanos,thread,checkpoint,iterations,nanos,itersPerSec\n";
+
+  int retval(pthread_create(&reporterThread_, NULL, reporterEntryPoint, this));
+  if(retval != 0)
+  {
+    cout << "NOTICE: could not create the interval reporter thread: " << strerror(retval)
+         << ", interval reporting disabled"
+         << endl;
+    out_.close();
+    return;
+  }
+  isRunning_ = true;
+}
+
+IntervalReporter::~IntervalReporter()
+{
+  stop();
+  pthread_cond_destroy(&stopCondition_);
+  pthread_mutex_destroy(&stopLock_);
+}
+
+void IntervalReporter::stop()
+{
+  if(!isRunning_)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&stopLock_);
+  stopReporter_ = true;
+  pthread_cond_signal(&stopCondition_);
+  pthread_mutex_unlock(&stopLock_);
+
+  pthread_join(reporterThread_, NULL);
+  isRunning_ = false;
+  out_.close();
+}
+
+// static private
+void *IntervalReporter::reporterEntryPoint(void *reporter)
+{
+  ((IntervalReporter*) reporter)->run();
+  return NULL;
+}
+
+// private
+// The wake-up times are advanced from the previous one, so the
+// intervals don't drift by the time it takes to report
+void IntervalReporter::run()
+{
+  struct timespec wakeUp;
+  clock_gettime(CLOCK_MONOTONIC, &wakeUp);
+
+  pthread_mutex_lock(&stopLock_);
+  while(!stopReporter_)
+  {
+    wakeUp.tv_sec  += intervalMillis_ / 1000;
+    wakeUp.tv_nsec += (intervalMillis_ % 1000) * 1000000;
+    if(wakeUp.tv_nsec >= 1000000000)
+    {
+      wakeUp.tv_nsec -= 1000000000;
+      ++wakeUp.tv_sec;
+    }
+
+    int retval(0);
+    while(!stopReporter_ && retval != ETIMEDOUT)
+    {
+      retval = pthread_cond_timedwait(&stopCondition_, &stopLock_, &wakeUp);
+    }
+
+    // The last interval is reported when stopping too
+    pthread_mutex_unlock(&stopLock_);
+    report();
+    pthread_mutex_lock(&stopLock_);
+  }
+  pthread_mutex_unlock(&stopLock_);
+}
+
+// private
+void IntervalReporter::report()
+{
+  uint64_t nowCycles(profiler_->getCycles());
+  uint64_t endNanos(profiler_->cyclesToNanos(nowCycles - startCycles_));
+  uint64_t elapsedNanos(profiler_->cyclesToNanos(nowCycles - previousCycles_));
+  double elapsedSeconds(elapsedNanos > 0 ? elapsedNanos / 1000000000.0 : 1.0);
+  previousCycles_ = nowCycles;
+
+  // The counters are copied while the threads can't register or retire,
+  // and written once they can, so a slow file never holds them up. The
+  // retired threads are at index 0, then the slots, as in previousIterations_.
+  vector<vector<uint64_t> > iterations;
+  vector<vector<uint64_t> > totalCycles;
+  vector<uint64_t> creationCycles;
+  Checkpoint::ThreadCheckpointInfo snapshot;
+  vector<Checkpoint::CheckpointInfo> checkpoints;
+
+  pthread_mutex_lock(&profiler_->slotLock_);
+
+  uint32_t numThreadsUsed(profiler_->getNumThreadsUsed());
+  iterations.resize(numThreadsUsed + 1);
+  totalCycles.resize(numThreadsUsed + 1);
+  creationCycles.resize(numThreadsUsed + 1, 0);
+  for(uint32_t index = 0; index <= numThreadsUsed; ++index)
+  {
+    uint32_t slot(index == 0 ? Checkpoint::RETIRED_SLOT : index - 1);
+    profiler_->getThreadCpInfoSnapshot(slot, snapshot, checkpoints);
+    iterations[index].resize(snapshot.numCheckpoints_);
+    totalCycles[index].resize(snapshot.numCheckpoints_);
+    for(uint32_t chkPoint = 0; chkPoint < snapshot.numCheckpoints_; ++chkPoint)
+    {
+      iterations[index][chkPoint] = checkpoints[chkPoint].iterations_;
+      totalCycles[index][chkPoint] = checkpoints[chkPoint].totalCycles_;
+    }
+    creationCycles[index] = snapshot.creationCycles_;
+  }
+
+  pthread_mutex_unlock(&profiler_->slotLock_);
+
+  vector<string> names(Checkpoint::getCheckpointNames());
+  if(numThreadsUsed + 1 > previousIterations_.size())
+  {
+    previousIterations_.resize(numThreadsUsed + 1);
+    previousTotalCycles_.resize(numThreadsUsed + 1);
+    previousCreationCycles_.resize(numThreadsUsed + 1, 0);
+  }
+
+  // The retired threads last, once the threads that exited are known
+  for(uint32_t thread = 0; thread < numThreadsUsed; ++thread)
+  {
+    reportThread(thread, thread + 1, iterations[thread + 1], totalCycles[thread + 1],
+                 creationCycles[thread + 1], endNanos, elapsedSeconds, names);
+  }
+  reportThread(Checkpoint::RETIRED_SLOT, 0, iterations[0], totalCycles[0], 0, endNanos, elapsedSeconds, names);
+
+  out_.flush();
+  __atomic_store_n(&numIntervals_, numIntervals_ + 1, __ATOMIC_RELAXED);
+}
+
+// private
+// The counters of a thread that exits move to the retired threads. So when
+// a slot has a new creationCycles_, what was reported for it is subtracted
+// from the retired threads' deltas, and the slot is reported from 0.
+void IntervalReporter::reportThread(uint32_t slot,
+                                    uint32_t previousIndex,
+                                    const vector<uint64_t> &iterations,
+                                    const vector<uint64_t> &totalCycles,
+                                    uint64_t creationCycles,
+                                    uint64_t endNanos,
+                                    double elapsedSeconds,
+                                    const vector<string> &names)
+{
+  vector<uint64_t> &previousIterations(previousIterations_[previousIndex]);
+  vector<uint64_t> &previousTotalCycles(previousTotalCycles_[previousIndex]);
+  if(slot != Checkpoint::RETIRED_SLOT && creationCycles != previousCreationCycles_[previousIndex])
+  {
+    previousCreationCycles_[previousIndex] = creationCycles;
+    vector<uint64_t> &retiredIterations(previousIterations_[0]);
+    vector<uint64_t> &retiredTotalCycles(previousTotalCycles_[0]);
+    if(previousIterations.size() > retiredIterations.size())
+    {
+      retiredIterations.resize(previousIterations.size(), 0);
+      retiredTotalCycles.resize(previousIterations.size(), 0);
+    }
+    for(uint32_t chkPoint = 0; chkPoint < previousIterations.size(); ++chkPoint)
+    {
+      retiredIterations[chkPoint] += previousIterations[chkPoint];
+      retiredTotalCycles[chkPoint] += previousTotalCycles[chkPoint];
+    }
+    previousIterations.assign(previousIterations.size(), 0);
+    previousTotalCycles.assign(previousTotalCycles.size(), 0);
+  }
+
+  if(iterations.size() > previousIterations.size())
+  {
+    previousIterations.resize(iterations.size(), 0);
+    previousTotalCycles.resize(iterations.size(), 0);
+  }
+
+  string thread(Checkpoint::getThreadLabel(slot));
+  for(uint32_t chkPoint = 0; chkPoint < iterations.size(); ++chkPoint)
+  {
+    uint64_t intervalIterations(iterations[chkPoint] - previousIterations[chkPoint]);
+    uint64_t cycles(totalCycles[chkPoint] - previousTotalCycles[chkPoint]);
+    if(intervalIterations == 0)
+    {
+      continue;
+    }
+    previousIterations[chkPoint] = iterations[chkPoint];
+    previousTotalCycles[chkPoint] = totalCycles[chkPoint];
+
+    out_ << endNanos
+         << ',' << thread
+         << ',' << getCsvLabel(Checkpoint::getCheckpointLabel(chkPoint, names))
+         << ',' << intervalIterations
+         << ',' << profiler_->cyclesToNanos(cycles)
+         << ',' << (uint64_t) (intervalIterations / elapsedSeconds)
+         << '\n';
+  }
+}
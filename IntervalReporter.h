@@ -0,0 +1,86 @@
+#ifndef INTERVAL_REPORTER_H
+#define INTERVAL_REPORTER_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include <pthread.h>
+#include <stdint.h> // uint32_t et al
+
+using namespace std;
+
+class Checkpoint;
+
+//
+// IntervalReporter
+//
+// A thread that wakes up every intervalMillis and appends the per-thread,
+// per-checkpoint deltas since the previous interval to a CSV file:
+//
+//   endNanos,thread,checkpoint,iterations,nanos,itersPerSec
+//
+// endNanos is the end of the interval in nano-seconds since the reporter
+// was started, nanos is the checkpoint time accumulated in the interval.
+// Only the checkpoints hit in the interval are written. The counters are
+// read with the per-thread sequence locks, the checkpointing threads never
+// wait on the reporter. The threads that exited are reported as the
+// thread "retired".
+//
+class IntervalReporter
+{
+public:
+  IntervalReporter(Checkpoint *profiler, const string &path, uint32_t intervalMillis);
+  // Stops the reporter if stop() wasn't called
+  ~IntervalReporter();
+
+  // false if the file could not be opened or the thread could not be started
+  inline bool isOpen() const { return isRunning_; }
+
+  // Wakes the thread to report the last, partial interval and waits for it to exit
+  void stop();
+
+  inline const string &getPath() const { return path_; }
+  inline uint64_t getNumIntervals() const { return __atomic_load_n(&numIntervals_, __ATOMIC_RELAXED); }
+
+private:
+  IntervalReporter();
+  IntervalReporter(const IntervalReporter &);
+
+  static void *reporterEntryPoint(void *reporter);
+  void run();
+  void report();
+  // Writes the deltas of the slot's checkpoints, from the counters copied
+  // with its creationCycles_, previousIndex is its index in the previous
+  // counters below
+  void reportThread(uint32_t slot,
+                    uint32_t previousIndex,
+                    const vector<uint64_t> &iterations,
+                    const vector<uint64_t> &totalCycles,
+                    uint64_t creationCycles,
+                    uint64_t endNanos,
+                    double elapsedSeconds,
+                    const vector<string> &names);
+
+  Checkpoint *profiler_;
+  string path_;
+  ofstream out_;
+  uint32_t intervalMillis_;
+  uint64_t startCycles_;
+  uint64_t previousCycles_;
+  uint64_t numIntervals_;
+
+  // The counters at the end of the previous interval, the retired threads'
+  // at index 0 and then per thread slot, with the creationCycles_ of the slots
+  vector<vector<uint64_t> > previousIterations_;
+  vector<vector<uint64_t> > previousTotalCycles_;
+  vector<uint64_t> previousCreationCycles_;
+
+  pthread_t reporterThread_;
+  pthread_mutex_t stopLock_;
+  pthread_cond_t stopCondition_;
+  bool isRunning_;
+  bool stopReporter_;
+};
+
+#endif // INTERVAL_REPORTER_H
@@ -0,0 +1,179 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <math.h>   // sqrt()
+#include <string.h> // memset
+#include <stdint.h> // uint32_t et al
+
+//
+// LatencyHistogram
+//
+// A fixed-size, log-linear histogram in the style of HdrHistogram.
+// Values below SUB_BUCKET_COUNT each get their own bucket, above that every
+// power of 2 is split into SUB_BUCKET_COUNT linear buckets, so the relative
+// error of a recorded value is at most 1/SUB_BUCKET_COUNT (6.25%).
+// Values of 2^MAX_VALUE_BITS and above are recorded in the last bucket.
+//
+// record() is just a count-leading-zeros, a shift and a few increments.
+// The min and max are exact, the percentiles and standard deviation are
+// calculated from the bucket mid-points.
+//
+
+class LatencyHistogram
+{
+public:
+  static const int SUB_BUCKET_BITS  = 4;
+  static const int SUB_BUCKET_COUNT = (1 << SUB_BUCKET_BITS);
+  static const int MAX_VALUE_BITS   = 48;
+  static const int NUM_BUCKETS      = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+  LatencyHistogram() { reset(); }
+
+  inline void reset()
+  {
+    count_ = 0;
+    min_ = UINT64_MAX;
+    max_ = 0;
+    memset(counts_, 0, sizeof(counts_));
+  }
+
+  inline void record(uint64_t value)
+  {
+    ++counts_[getBucketIndex(value)];
+    ++count_;
+    if(value < min_) { min_ = value; }
+    if(value > max_) { max_ = value; }
+  }
+
+  static inline int getBucketIndex(uint64_t value)
+  {
+    if(value < (uint64_t) SUB_BUCKET_COUNT)
+    {
+      return (int) value;
+    }
+    if(value >> MAX_VALUE_BITS)
+    {
+      return NUM_BUCKETS - 1;
+    }
+    int shift((63 - __builtin_clzll(value)) - SUB_BUCKET_BITS);
+    return ((shift + 1) << SUB_BUCKET_BITS) + (int) ((value >> shift) - SUB_BUCKET_COUNT);
+  }
+
+  // Lowest value that will be recorded in the bucket
+  static inline uint64_t getBucketLowValue(int index)
+  {
+    if(index < SUB_BUCKET_COUNT)
+    {
+      return index;
+    }
+    int shift((index >> SUB_BUCKET_BITS) - 1);
+    return ((uint64_t) ((index & (SUB_BUCKET_COUNT - 1)) + SUB_BUCKET_COUNT)) << shift;
+  }
+
+  // Highest value that will be recorded in the bucket
+  static inline uint64_t getBucketHighValue(int index)
+  {
+    if(index < SUB_BUCKET_COUNT)
+    {
+      return index;
+    }
+    int shift((index >> SUB_BUCKET_BITS) - 1);
+    return getBucketLowValue(index) + (((uint64_t) 1) << shift) - 1;
+  }
+
+  // Add the counts of another histogram, used to merge the per-thread histograms
+  void merge(const LatencyHistogram &rhs)
+  {
+    if(this == &rhs || rhs.count_ == 0) { return; }
+    for(int i = 0; i < NUM_BUCKETS; ++i)
+    {
+      counts_[i] += rhs.counts_[i];
+    }
+    count_ += rhs.count_;
+    if(rhs.min_ < min_) { min_ = rhs.min_; }
+    if(rhs.max_ > max_) { max_ = rhs.max_; }
+  }
+
+  inline uint64_t getCount() const { return count_; }
+  inline uint64_t getMin()   const { return (count_ == 0 ? 0 : min_); }
+  inline uint64_t getMax()   const { return max_; }
+  inline uint64_t getBucketCount(int index) const { return counts_[index]; }
+
+  // percentile is in the range [0, 100], the result is the mid-point of the
+  // bucket holding the percentile, clamped to the exact min and max
+  uint64_t getValueAtPercentile(double percentile) const
+  {
+    if(count_ == 0) { return 0; }
+
+    uint64_t target((uint64_t) ceil((percentile / 100.0) * count_));
+    if(target < 1)      { target = 1; }
+    if(target > count_) { target = count_; }
+
+    uint64_t runningCount(0);
+    for(int i = 0; i < NUM_BUCKETS; ++i)
+    {
+      runningCount += counts_[i];
+      if(runningCount >= target)
+      {
+        return clamp(getBucketMidValue(i));
+      }
+    }
+
+    return max_;
+  }
+
+  double getMean() const
+  {
+    if(count_ == 0) { return 0.0; }
+
+    double sum(0.0);
+    for(int i = 0; i < NUM_BUCKETS; ++i)
+    {
+      if(counts_[i] != 0)
+      {
+        sum += ((double) counts_[i]) * clamp(getBucketMidValue(i));
+      }
+    }
+
+    return sum / count_;
+  }
+
+  double getStdDev() const
+  {
+    if(count_ < 2) { return 0.0; }
+
+    double mean(getMean());
+    double sumSquares(0.0);
+    for(int i = 0; i < NUM_BUCKETS; ++i)
+    {
+      if(counts_[i] != 0)
+      {
+        double delta(clamp(getBucketMidValue(i)) - mean);
+        sumSquares += ((double) counts_[i]) * delta * delta;
+      }
+    }
+
+    return sqrt(sumSquares / count_);
+  }
+
+private:
+  static inline uint64_t getBucketMidValue(int index)
+  {
+    return getBucketLowValue(index) + (getBucketHighValue(index) - getBucketLowValue(index))/2;
+  }
+
+  inline uint64_t clamp(uint64_t value) const
+  {
+    if(value < min_) { return min_; }
+    if(value > max_) { return max_; }
+    return value;
+  }
+
+  uint64_t count_;
+  uint64_t min_;
+  uint64_t max_;
+  // 64 bits, a hot bucket would wrap after 2^32 hits, minutes at full speed
+  uint64_t counts_[NUM_BUCKETS];
+};
+
+#endif // LATENCY_HISTOGRAM_H
@@ -1,16 +1,37 @@
 
 #include <iostream>
+#include <sstream>
+#include <algorithm> // sort()
 
+#include <new>      // placement new
+#include <errno.h>
+#include <fcntl.h>  // open()
+#include <sched.h>  // sched_yield()
+#include <signal.h> // sigaction()
+#include <stddef.h> // offsetof
 #include <pthread.h>
+#include <stdlib.h> // posix_memalign(), free()
 #include <string.h> // memset
 #include <stdint.h> // uint32_t et al
 #include <time.h>   // clock_gettime() et al
+#include <unistd.h> // getpid()
 
 #include "LowImpactProfiler.h"
+#include "CheckpointSnapshot.h"
+
+#ifdef LIP_HAVE_TSC
+#include <cpuid.h>  // __get_cpuid()
+#endif
 
 // Initialize static class variables
+const uint32_t Checkpoint::RETIRED_SLOT;
 Checkpoint *Checkpoint::instance_ = 0;
-bool Checkpoint::useLocking_ = true;
+uint64_t Checkpoint::instanceIdCounter_ = 0;
+__thread Checkpoint::ThreadLocalSlot Checkpoint::tlsSlot_ = {0, NULL, 0};
+__thread Checkpoint::ThreadLocalSlot Checkpoint::tlsDomainSlots_[Checkpoint::MAX_DOMAINS];
+Checkpoint *Checkpoint::signalDomains_[Checkpoint::MAX_DOMAINS];
+bool Checkpoint::signalDumpBusy_ = false;
+char Checkpoint::signalDumpBuffer_[Checkpoint::SIGNAL_DUMP_BUFFER_SIZE];
 const string Checkpoint::SECOND_STR    = "Seconds";
 const string Checkpoint::MICRO_SEC_STR = "MicroSec";
 const string Checkpoint::MILLI_SEC_STR = "MilliSec";
@@ -23,11 +44,137 @@ using namespace std;
 // This method is not thread-safe, so it must be called before the threads are started
 void Checkpoint::initialize(uint32_t numThreads, bool useLocking) /* default values: DEFAULT_MAX_THREADS, true */
 {
-  Checkpoint::useLocking_ = useLocking;
+  Config config;
+  config.numThreads = numThreads;
+  config.useLocking = useLocking;
+  initialize(config);
+}
+
+// static
+// Same as above, with all of the settings in a Config
+void Checkpoint::initialize(const Config &config)
+{
   if(instance_ == 0)
   {
-    instance_ = new Checkpoint(numThreads);
+    instance_ = new Checkpoint(config, string(), 0);
+  }
+  else
+  {
+    cout << "NOTICE: the profiler is already initialized, the new settings are ignored."
+         << " Use Checkpoint::createDomain() for a profiler with its own settings"
+         << endl;
+  }
+}
+
+// static
+// Domains are thread-safe to create and delete, as long as no thread
+// checkpoints in a domain being deleted
+Checkpoint *Checkpoint::createDomain(const string &name, const Config &config)
+{
+  CheckpointRegistry &registry(getCheckpointRegistry());
+  uint32_t domainIndex(0);
+
+  // Index 0 is the global instance's
+  pthread_mutex_lock(&registry.lock_);
+  for(uint32_t index = 1; index < MAX_DOMAINS; ++index)
+  {
+    if((registry.domainsUsed_ & (1U << index)) == 0)
+    {
+      registry.domainsUsed_ |= (1U << index);
+      domainIndex = index;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&registry.lock_);
+
+  if(domainIndex == 0)
+  {
+    cout << "NOTICE: domain [" << name << "] not created, at most ["
+         << MAX_DOMAINS << "] domains can exist at once, including the global instance"
+         << endl;
+    return NULL;
+  }
+
+  return new Checkpoint(config, name, domainIndex);
+}
+
+// static
+const char *Checkpoint::getClockSourceStr(ClockSource clockSource)
+{
+  switch(clockSource)
+  {
+    case CLOCK_SOURCE_REALTIME_USEC: return "CLOCK_REALTIME";
+    case CLOCK_SOURCE_MONOTONIC_RAW: return "CLOCK_MONOTONIC_RAW";
+    case CLOCK_SOURCE_TSC:           return "TSC";
+    case CLOCK_SOURCE_TSCP:          return "TSCP";
+  }
+
+  return "Unknown";
+}
+
+// private
+// Sets the clock used by getCycles(). The TSC clock sources are calibrated
+// against CLOCK_MONOTONIC, by counting the cycles that elapse over a short
+// interval. The TSC is only used if the CPU reports it as invariant, meaning
+// it ticks at a constant rate regardless of frequency scaling and C-states.
+void Checkpoint::initializeClock(ClockSource clockSource)
+{
+  if(clockSource == CLOCK_SOURCE_TSC || clockSource == CLOCK_SOURCE_TSCP)
+  {
+    bool invariantTsc(false);
+#ifdef LIP_HAVE_TSC
+    unsigned int eax, ebx, ecx, edx;
+    if(__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+    {
+      invariantTsc = ((edx & (1 << 8)) != 0);
+    }
+#endif
+
+    if(!invariantTsc)
+    {
+      cout << "NOTICE: an invariant TSC is not available, using "
+           << getClockSourceStr(CLOCK_SOURCE_MONOTONIC_RAW) << " instead of "
+           << getClockSourceStr(clockSource)
+           << endl;
+      clockSource = CLOCK_SOURCE_MONOTONIC_RAW;
+    }
+  }
+
+  clockSource_ = clockSource;
+
+  if(clockSource == CLOCK_SOURCE_REALTIME_USEC)
+  {
+    nanosPerCycle_ = 1000.0;
+    return;
+  }
+  else if(clockSource == CLOCK_SOURCE_MONOTONIC_RAW)
+  {
+    nanosPerCycle_ = 1.0;
+    return;
   }
+
+  // Calibrate the TSC: the monotonic reads are bracketed by TSC reads
+  // so the mid-point can be used to reduce the error
+  const uint64_t CALIBRATION_NANOS(20000000); // 20 milli-seconds
+  struct timespec startTime, endTime;
+  uint64_t startCyclesBefore(getCycles());
+  clock_gettime(CLOCK_MONOTONIC, &startTime);
+  uint64_t startCyclesAfter(getCycles());
+
+  uint64_t elapsedNanos(0);
+  uint64_t endCyclesBefore(0), endCyclesAfter(0);
+  do
+  {
+    endCyclesBefore = getCycles();
+    clock_gettime(CLOCK_MONOTONIC, &endTime);
+    endCyclesAfter = getCycles();
+    elapsedNanos = ((endTime.tv_sec - startTime.tv_sec) * (uint64_t)1000000000) +
+                   endTime.tv_nsec - startTime.tv_nsec;
+  } while(elapsedNanos < CALIBRATION_NANOS);
+
+  uint64_t startCycles(startCyclesBefore + (startCyclesAfter - startCyclesBefore)/2);
+  uint64_t endCycles(endCyclesBefore + (endCyclesAfter - endCyclesBefore)/2);
+  nanosPerCycle_ = ((double) elapsedNanos) / (endCycles - startCycles);
 }
 
 // static
@@ -56,11 +203,57 @@ void Checkpoint::destroy()
 }
 
 // protected
-Checkpoint::Checkpoint(uint32_t numThreads) :
-    numThreads_(numThreads),
-    isActive_(true),
-    threadIdCounter_(0)
+Checkpoint::Checkpoint(const Config &config, const string &domainName, uint32_t domainIndex) :
+    useLocking_(config.useLocking),
+    clockSource_(CLOCK_SOURCE_REALTIME_USEC),
+    nanosPerCycle_(1000.0),
+    domainName_(domainName),
+    threadCpInfoTable_(NULL),
+    threadCpInfoChunks_(NULL),
+    maxThreadSlots_(config.maxThreadSlots),
+    numSlots_(0),
+    retiredCpInfo_(NULL),
+    numThreadsRetired_(0),
+    retiredPerfCounted_(false),
+    numThreadsShared_(0),
+    useThreadExitKey_(false),
+    useHistograms_(config.useHistograms),
+    useSegmentStats_(config.useSegmentStats),
+    usePerfCounters_(config.usePerfCounters),
+    perfNoticed_(false),
+    useCpuTime_(config.useCpuTime),
+    cpuClockNoticed_(false),
+    cpuTopology_(NULL),
+    perfAvailableMask_(0),
+    useTransitions_(config.useTransitions),
+    useScopeTree_(config.useScopeTree),
+    scopeTreeNodes_(config.scopeTreeNodes),
+    scopeTreeDepth_(config.scopeTreeDepth),
+    overheadNanos_(0.0),
+    overheadVariance_(0.0),
+    overheadCycles_(0),
+    subtractOverhead_(config.subtractOverhead),
+    percentiles_(config.percentiles),
+    trace_(NULL),
+    stats_(NULL),
+    shmFullNoticed_(false),
+    reporter_(NULL),
+    throughput_(NULL),
+    sampler_(NULL),
+    dumpSignal_(config.dumpSignal),
+    dumpSignalPath_(config.dumpSignalPath),
+    dumpSignalFd_(config.dumpSignalFd),
+    signalScratch_(NULL),
+    threadTableSize_(config.numThreads > 1 ? config.numThreads : 1),
+    instanceId_(__atomic_add_fetch(&instanceIdCounter_, 1, __ATOMIC_RELAXED)),
+    domainIndex_(domainIndex),
+    threadIdCounter_(0),
+    numThreads_(config.numThreads),
+    isActive_(true)
 {
+  // The clock must be set before any cycles are taken
+  initializeClock(config.clockSource);
+
   clockid_t clockId;
   int retval(clock_getcpuclockid(0, &clockId));
   if(retval != 0)
@@ -70,315 +263,2777 @@ Checkpoint::Checkpoint(uint32_t numThreads) :
          << endl;
   }
 
-  pthread_mutex_init(&checkpointLock_, NULL); // initialize it even if !useLocking_
-  pthread_rwlockattr_init(&rwlockAttr_);
-  // give priority to writers
-  pthread_rwlockattr_setkind_np(&rwlockAttr_, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
-  pthread_rwlock_init(&threadCpInfoMapRwLock_, &rwlockAttr_);
+  pthread_mutex_init(&growLock_, NULL);
+
+  pthread_mutexattr_t slotLockAttr;
+  pthread_mutexattr_init(&slotLockAttr);
+  pthread_mutexattr_settype(&slotLockAttr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&slotLock_, &slotLockAttr);
+  pthread_mutexattr_destroy(&slotLockAttr);
 
-  if(numThreads > 1)
+  if(usePerfCounters_ && numThreads_ == 0)
   {
-    threadIdVector_.reserve(numThreads);
+    cout << "NOTICE: perf counters are not used when all the threads share a slot"
+         << " (numThreads 0), since the counters are per thread"
+         << endl;
+    usePerfCounters_ = false;
   }
-  else
+  if(useCpuTime_ && numThreads_ == 0)
   {
-    threadIdVector_.reserve(1);
+    cout << "NOTICE: the CPU time is not used when all the threads share a slot"
+         << " (numThreads 0), since it is per thread"
+         << endl;
+    useCpuTime_ = false;
+  }
+  if(config.useCpuAttribution && numThreads_ == 0)
+  {
+    cout << "NOTICE: the CPU attribution is not used when all the threads share a slot"
+         << " (numThreads 0), since it is per thread"
+         << endl;
+  }
+  else if(config.useCpuAttribution)
+  {
+    cpuTopology_ = new CpuTopology();
   }
-}
-
-Checkpoint::~Checkpoint()
-{
-  pthread_rwlockattr_destroy(&rwlockAttr_);
-  pthread_rwlock_destroy(&threadCpInfoMapRwLock_);
-  pthread_mutex_destroy(&checkpointLock_);
-}
-
-// private
-Checkpoint::ThreadCheckpointInfo *Checkpoint::getThreadCpInfo()
-{
-  ThreadCheckpointInfo *threadCpInfo(NULL);
 
-  if(numThreads_ == 0)
+  if(!config.shmName.empty())
   {
-    if(__unlikely(threadCpInfoMap_.empty()))
+    // The segment only describes what a reader needs, the rest of
+    // the thread slots stays private to the profiler
+    uint32_t numCheckpoints(config.shmMaxCheckpoints);
+    if(numCheckpoints < (uint32_t) getNumRegisteredCheckpoints())
     {
-      threadCpInfoMap_[0] = ThreadCheckpointInfo();
-      threadIdVector_[threadIdCounter_++] = 0;
+      numCheckpoints = getNumRegisteredCheckpoints();
     }
-    threadCpInfo = &(threadCpInfoMap_[0]);
 
-    return threadCpInfo;
-  }
+    StatsSegmentHeader layout;
+    memset(&layout, 0, sizeof(layout));
+    layout.clockSource_          = clockSource_;
+    layout.nanosPerCycle_        = nanosPerCycle_;
+    layout.useLocking_           = useLocking_;
+    layout.numThreadSlots_       = threadTableSize_ + 1;
+    layout.threadStride_         = sizeof(ThreadCheckpointInfo);
+    layout.sequenceOffset_       = offsetof(ThreadCheckpointInfo, sequence_);
+    layout.lastCheckpointOffset_ = offsetof(ThreadCheckpointInfo, lastCheckpointHit_);
+    layout.checkpointSize_       = sizeof(CheckpointInfo);
+    layout.numCheckpoints_       = numCheckpoints;
+    layout.maxNames_             = (numCheckpoints > FIRST_NAMED_CHECKPOINT ? numCheckpoints - FIRST_NAMED_CHECKPOINT : 0);
 
-  pthread_t threadId(pthread_self());
-  pthread_rwlock_rdlock(&threadCpInfoMapRwLock_);
-  Checkpoint::ThreadCpInfoMapType::iterator iter(threadCpInfoMap_.find(threadId));
+    stats_ = new StatsSegment(config.shmName, layout);
+    if(!stats_->isOpen())
+    {
+      delete stats_;
+      stats_ = NULL;
+    }
+    else
+    {
+      // Under the registry lock, so the names registered meanwhile are not missed
+      CheckpointRegistry &registry(getCheckpointRegistry());
+      pthread_mutex_lock(&registry.lock_);
+      for(size_t i = 0; i < registry.names_.size(); ++i)
+      {
+        stats_->addName(FIRST_NAMED_CHECKPOINT + i, registry.names_[i]);
+      }
+      registry.statsDomains_[domainIndex_] = this;
+      pthread_mutex_unlock(&registry.lock_);
+    }
+  }
 
-  if(__likely(iter != threadCpInfoMap_.end()))
+  // The table can't grow in the shared-memory segment, nor when
+  // all the threads share slot 0
+  if(stats_ != NULL || numThreads_ == 0 || maxThreadSlots_ < threadTableSize_)
   {
-    threadCpInfo = &(iter->second);
-    pthread_rwlock_unlock(&threadCpInfoMapRwLock_);
+    maxThreadSlots_ = threadTableSize_;
   }
-  else
-  {
-    // release the read lock
-    pthread_rwlock_unlock(&threadCpInfoMapRwLock_);
 
-    // get a write lock, since we'll have to modify the map
-    pthread_rwlock_wrlock(&threadCpInfoMapRwLock_);
-      threadIdVector_[threadIdCounter_++] = threadId;
-      threadCpInfoMap_[threadId] = ThreadCheckpointInfo();
-      threadCpInfo = &(threadCpInfoMap_[threadId]);
-    pthread_rwlock_unlock(&threadCpInfoMapRwLock_);
+  if(!config.tracePath.empty())
+  {
+    // The overflow slot is not traced, since its ring would have several
+    // producers. The grown slots, numbered on from it up to maxThreadSlots_,
+    // get their rings when they are first claimed.
+    trace_ = new CheckpointTrace(config.tracePath,
+                                 threadTableSize_,
+                                 maxThreadSlots_ + 1,
+                                 config.traceRingSize,
+                                 config.traceDrainMicros,
+                                 nanosPerCycle_,
+                                 clockSource_,
+                                 getCycles());
+    if(!trace_->isOpen())
+    {
+      delete trace_;
+      trace_ = NULL;
+    }
   }
 
-  return threadCpInfo;
-}
-
-
-// Method to calculate current checkpoint information
-void Checkpoint::checkpoint(int checkpoint)
-{
-  if(__unlikely(!isActive_)) {
-    return;
+  // Measured without the trace, whose ring push is then not counted, and
+  // before any sampling, so every calibration checkpoint reads the clock
+  calibrateOverhead();
+  if(subtractOverhead_)
+  {
+    overheadCycles_ = (uint64_t) (overheadNanos_ / nanosPerCycle_ + 0.5);
   }
 
-  // Not checking threadNum nor checkpoint for performance reasons
-
-  ThreadCheckpointInfo *threadCp (  getThreadCpInfo() );
-  CheckpointInfo *currentCp      (  &(threadCp->checkpoints_[checkpoint]) );
-  CheckpointInfo *previousCp     (  &(threadCp->checkpoints_[threadCp->lastCheckpointHit_]) );
-  threadCp->lastCheckpointHit_  =  checkpoint;
-
-  if(__unlikely(useLocking_)) {
-    pthread_mutex_lock(&checkpointLock_);
+  // Created before the thread slots, which draw their first sampling gap from it
+  if(config.sampleEvery > 1 || config.sampleMicros != 0 || config.sampleMaxOverheadPercent > 0.0)
+  {
+    if(trace_ != NULL || useScopeTree_)
+    {
+      cout << "NOTICE: sampling is not used with the trace or the scope tree, "
+           << "which need every checkpoint timestamp"
+           << endl;
+    }
+    else
+    {
+      sampler_ = new CheckpointSampler(this,
+                                       config.sampleEvery,
+                                       config.sampleMicros,
+                                       config.sampleMaxOverheadPercent,
+                                       overheadNanos_);
+    }
   }
 
-  // calculate and store deltas
-  ++(currentCp->iterations_);
-  currentCp->previousCycles_ = getCycles();
-  currentCp->totalCycles_   += (currentCp->previousCycles_ - previousCp->previousCycles_);
-
-  if(__unlikely(useLocking_)) {
-    pthread_mutex_unlock(&checkpointLock_);
+  uint32_t numChunks((maxThreadSlots_ - threadTableSize_ + THREAD_CHUNK_SIZE - 1) / THREAD_CHUNK_SIZE);
+  if(numChunks > 0)
+  {
+    threadCpInfoChunks_ = new ThreadCheckpointInfo*[numChunks];
+    memset(threadCpInfoChunks_, 0, sizeof(ThreadCheckpointInfo*) * numChunks);
   }
-}
 
-const char *Checkpoint::getTimeResolutionStr(uint64_t &avgCycles, uint64_t &totalCycles)
-{
-  const char *unitPtr(Checkpoint::MICRO_SEC_STR.c_str());
+  if(numThreads_ != 0)
+  {
+    useThreadExitKey_ = (pthread_key_create(&threadExitKey_, threadExitHook) == 0);
+    if(!useThreadExitKey_)
+    {
+      cout << "NOTICE: pthread_key_create() failed, the slots of the threads that exit will not be reused"
+           << endl;
+    }
+  }
 
-  if(avgCycles > 99999LU && totalCycles > 999999LU)
+  // One extra slot for threads registered beyond maxThreadSlots_
+  if(stats_ != NULL)
   {
-    totalCycles /= 1000000LU;
-    avgCycles   /= 1000000LU;
-    unitPtr = Checkpoint::SECOND_STR.c_str();
+    threadCpInfoTable_ = (ThreadCheckpointInfo*) stats_->getThreadTable();
   }
-  else if(avgCycles > 9999 && totalCycles > 99999)
+  else
   {
-    totalCycles /= 1000;
-    avgCycles   /= 1000;
-    unitPtr = Checkpoint::MILLI_SEC_STR.c_str();
+    threadCpInfoTable_ = (ThreadCheckpointInfo*) allocateAligned(sizeof(ThreadCheckpointInfo) * (threadTableSize_ + 1));
+  }
+  for(uint32_t slot = 0; slot <= threadTableSize_; ++slot)
+  {
+    new (&(threadCpInfoTable_[slot])) ThreadCheckpointInfo();
+    initThreadCpInfo(slot);
   }
 
-  return unitPtr;
-}
+  // Private even with a shared-memory segment, whose readers see
+  // the slots reset as their threads exit
+  retiredCpInfo_ = (ThreadCheckpointInfo*) allocateAligned(sizeof(ThreadCheckpointInfo));
+  new (retiredCpInfo_) ThreadCheckpointInfo();
+  initThreadCpInfo(RETIRED_SLOT);
+  retiredCpHits_.resize(retiredCpInfo_->numCheckpoints_, 0);
 
-// Dump all the checkpoint information
-void Checkpoint::dump(ostream &out, bool verbose, bool dumpAverages, bool dumpTput, bool dumpThreadIds)
-{
-  if(verbose)
+  // Started last, since it reads the thread table
+  if(!config.intervalPath.empty())
   {
-    out << "Number of Threads [configured, used] = [" << numThreads_
-        << ", " << threadIdCounter_
-        << "]"
-        << endl;
+    reporter_ = new IntervalReporter(this, config.intervalPath, config.intervalMillis);
+    if(!reporter_->isOpen())
+    {
+      delete reporter_;
+      reporter_ = NULL;
+    }
   }
-
-  if(verbose)
+  if(config.throughputBucketMillis != 0)
   {
-    struct timespec resolution;
-    //clock_getres(CLOCK_THREAD_CPUTIME_ID, &resolution);
-    clock_getres(CLOCK_REALTIME, &resolution);
-    out << "Timer resolution in nanoseconds [" << resolution.tv_nsec << "]" << endl;
+    throughput_ = new ThroughputMonitor(this, config.throughputBucketMillis, config.throughputBuckets);
+    if(!throughput_->isRunning())
+    {
+      delete throughput_;
+      throughput_ = NULL;
+    }
   }
 
-  if(useLocking_)
+  if(dumpSignal_ != 0)
   {
-    pthread_mutex_lock(&checkpointLock_);
+    installSignalDump();
   }
+}
 
-  CheckpointInfo totalCpAvg[MAX_CHECKPOINT];
-  uint32_t numCpHits[MAX_CHECKPOINT];
-  memset(numCpHits, 0, sizeof(uint32_t)*MAX_CHECKPOINT);
-
-  // Print a summary of the Checkpoints for each Thread
-  //
-  // Iterate over the vector and index the map, because if we iterate the map
-  // the key is the threadId and the threads will be ordered by the threadId
-  for(int thread = 0; thread < threadIdCounter_; ++thread)
+Checkpoint::~Checkpoint()
+{
+  // Frees the domain index, the threads' cached slots for it are
+  // invalidated by the next domain's instanceId_
+  CheckpointRegistry &registry(getCheckpointRegistry());
+  pthread_mutex_lock(&registry.lock_);
+  registry.statsDomains_[domainIndex_] = NULL;
+  __atomic_store_n(&(signalDomains_[domainIndex_]), (Checkpoint*) NULL, __ATOMIC_SEQ_CST);
+  if(domainIndex_ != 0)
   {
-    ThreadCheckpointInfo *threadCp = &(threadCpInfoMap_[threadIdVector_[thread]]);
-
-    // Filter out unused threads
-    bool threadUsed(false);
-    CheckpointInfo *currentCp(threadCp->checkpoints_);
-    for(int chkPoint=0; chkPoint < MAX_CHECKPOINT; currentCp = &(threadCp->checkpoints_[++chkPoint]))
-    {
-      if(currentCp->iterations_ != 0)
-      {
-        threadUsed = true;
-      }
-    }
+    registry.domainsUsed_ &= ~(1U << domainIndex_);
+  }
+  pthread_mutex_unlock(&registry.lock_);
 
-    if(!threadUsed)
+  // A signal dump on another thread may still be reading this domain
+  if(dumpSignal_ != 0)
+  {
+    while(__atomic_load_n(&signalDumpBusy_, __ATOMIC_SEQ_CST))
     {
-      //out << "Thread [" << thread << "] No checkpoints hit on this thread, skipping\n" << endl;
-      continue;
+      sched_yield();
     }
+  }
 
-    // Filter out unused checkpoints
-    int maxCpIndex(MAX_CHECKPOINT);
-    currentCp = &(threadCp->checkpoints_[MAX_CHECKPOINT-1]);
-    for(int chkPoint=MAX_CHECKPOINT; chkPoint > 0; currentCp = &(threadCp->checkpoints_[--chkPoint]))
-    {
-      if(currentCp->iterations_ == 0)
-      {
-        maxCpIndex = chkPoint;
-      }
-      else
-      {
-        break;
-      }
-    }
+  // The threads still running will not retire their slots
+  if(useThreadExitKey_)
+  {
+    pthread_key_delete(threadExitKey_);
+  }
 
-    currentCp = threadCp->checkpoints_;
-    for(int checkPoint=0; checkPoint < maxCpIndex; currentCp = &(threadCp->checkpoints_[++checkPoint]))
-    {
-      uint64_t avgCycles(0);
+  if(sampler_ != NULL)
+  {
+    sampler_->stop();
+  }
 
-      if(currentCp->iterations_ != 0)
-      {
-        // Avoiding possible divide by zero
-        avgCycles = currentCp->totalCycles_/currentCp->iterations_;
-        totalCpAvg[checkPoint] += currentCp;
-        numCpHits[checkPoint]++;
-      }
+  if(reporter_ != NULL)
+  {
+    // Reports the last interval
+    reporter_->stop();
+    delete reporter_;
+  }
 
-      uint64_t totalCycles(currentCp->totalCycles_);
-      const char *unitPtr(getTimeResolutionStr(avgCycles, totalCycles));
+  if(throughput_ != NULL)
+  {
+    delete throughput_;
+  }
 
-      if(verbose)
-      {
-        out << "Thread [" << thread
-            << "] Checkpoint [" << checkPoint
-            << "] Iterations [" << currentCp->iterations_
-            << "] Time [Unit,Avg,Total] = [" << unitPtr
-            << ", " << avgCycles
-            << ", " << totalCycles << "]\n";
-      }
-      else
-      {
-        // minimalCheckpoint format:
-        // Iters0=20, MicroSec0=300, Iters1=10, MilliSec1=400, Iters2=10, MilliSec2=800
-        if(checkPoint != 0)
-        {
-          out << ", ";
-        }
-        out << "Iters" << checkPoint << "=" << currentCp->iterations_
-            << ", " << unitPtr << checkPoint << "=" << totalCycles;
-      }
-    }
-    out << endl;
+  if(trace_ != NULL)
+  {
+    trace_->close(getCheckpointNames(), FIRST_NAMED_CHECKPOINT);
+    delete trace_;
   }
 
-  // Now print the averages
-  if(dumpAverages)
+  // CheckpointInfo, ThreadCheckpointInfo and LatencyHistogram have trivial destructors
+  for(uint32_t slot = 0; slot <= threadTableSize_; ++slot)
+  {
+    freeThreadCpInfo(&(threadCpInfoTable_[slot]), stats_ == NULL);
+  }
+  uint32_t numChunks((maxThreadSlots_ - threadTableSize_ + THREAD_CHUNK_SIZE - 1) / THREAD_CHUNK_SIZE);
+  for(uint32_t chunk = 0; chunk < numChunks; ++chunk)
   {
-    for(int i = 0; i < MAX_CHECKPOINT; ++i)
+    if(threadCpInfoChunks_[chunk] != NULL)
     {
-      CheckpointInfo *avgCp = &(totalCpAvg[i]);
-      if(numCpHits[i] > 1)
+      for(uint32_t slot = 0; slot < THREAD_CHUNK_SIZE; ++slot)
       {
-        avgCp->totalCycles_ = avgCp->totalCycles_/numCpHits[i];
-        avgCp->iterations_ = avgCp->iterations_/numCpHits[i];
-
-        uint64_t totalCycles(avgCp->totalCycles_);
-        uint64_t avgCycles((uint64_t) (avgCp->totalCycles_/avgCp->iterations_));
-        const char *unitPtr(getTimeResolutionStr(avgCycles, totalCycles));
-
-        out << "Weighted Average: Checkpoint [" << i
-             << "] Iterations [" << avgCp->iterations_
-             << "] Time [Unit,Avg,Total] = [" << unitPtr
-             << ", " << avgCycles
-             << ", " << totalCycles << "]\n";
+        freeThreadCpInfo(&(threadCpInfoChunks_[chunk][slot]), true);
       }
+      free(threadCpInfoChunks_[chunk]);
     }
   }
-
-  // Now print the approximated Throughput
-  if(dumpTput)
+  delete [] threadCpInfoChunks_;
+  freeThreadCpInfo(retiredCpInfo_, true);
+  free(retiredCpInfo_);
+  for(size_t i = 0; i < retiredArrays_.size(); ++i)
   {
-    dumpThroughput(out);
+    free(retiredArrays_[i]);
+  }
+  if(stats_ != NULL)
+  {
+    // Unmaps the table and the checkpoint arrays, and removes the segment
+    delete stats_;
+  }
+  else
+  {
+    free(threadCpInfoTable_);
   }
+  delete sampler_;
+  delete cpuTopology_;
+  free(signalScratch_);
+  pthread_mutex_destroy(&growLock_);
+  pthread_mutex_destroy(&slotLock_);
+}
 
-  // Now print the threadId map
-  if(dumpThreadIds)
+// private
+void Checkpoint::freeThreadCpInfo(ThreadCheckpointInfo *threadCp, bool freeCheckpoints)
+{
+  if(freeCheckpoints)
   {
-    out << "\nTreadIds [" << threadIdCounter_ << "]" << endl;
-    for(int i = 0; i < threadIdCounter_; ++i)
-    {
-      out << "\t thread [" << i << "] => threadId [" << threadIdVector_[i] << "]\n";
-    }
-    out << endl;
+    free(threadCp->checkpoints_);
   }
+  free(threadCp->histograms_);
+  free(threadCp->segmentStats_);
+  free(threadCp->perfCounts_);
+  delete threadCp->perfCounters_;
+  free(threadCp->cpuNanos_);
+  delete threadCp->cpuClock_;
+  delete threadCp->transitions_;
+  delete threadCp->scopeTree_;
+  delete threadCp->cpuSegments_;
+}
+
+// static private
+void *Checkpoint::allocateAligned(size_t size)
+{
+  size = ((size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE) * CACHE_LINE_SIZE;
 
-  if(useLocking_)
+  void *ptr(NULL);
+  if(posix_memalign(&ptr, CACHE_LINE_SIZE, size) != 0)
   {
-    pthread_mutex_unlock(&checkpointLock_);
+    throw bad_alloc();
   }
+
+  return ptr;
 }
 
-void Checkpoint::dumpThroughput(ostream &out)
+// private
+// The slot keeps its arrays when re-initialized, they are just reset
+void Checkpoint::initThreadCpInfo(uint32_t slot)
 {
-  // Thread 0 is the first thread created, so its creation time
-  // will be the start time for the throughput calculation
-  ThreadCheckpointInfo *threadZeroCps(&(threadCpInfoMap_[threadIdVector_[0]]));
+  ThreadCheckpointInfo *threadCpInfo(getThreadSlot(slot));
+  CheckpointInfo *checkpoints(threadCpInfo->checkpoints_);
+  LatencyHistogram *histograms(threadCpInfo->histograms_);
+  SegmentStats *segmentStats(threadCpInfo->segmentStats_);
+  PerfCounterInfo *perfCounts(threadCpInfo->perfCounts_);
+  uint64_t *cpuNanos(threadCpInfo->cpuNanos_);
+  TransitionTable *transitions(threadCpInfo->transitions_);
+  ScopeTree *scopeTree(threadCpInfo->scopeTree_);
+  CpuSegmentTable *cpuSegments(threadCpInfo->cpuSegments_);
+  uint32_t numCheckpoints(threadCpInfo->numCheckpoints_);
 
-  // Assuming all threads have hit the same checkpoints,
-  // so lets get the last checkpoint hit from thread 0
-  int maxCpIndex(MAX_CHECKPOINT);
-  CheckpointInfo *currentCp = &(threadZeroCps->checkpoints_[MAX_CHECKPOINT-1]);
-  for(int checkPoint = MAX_CHECKPOINT; checkPoint > 0; currentCp = &(threadZeroCps->checkpoints_[--checkPoint]))
+  if(checkpoints == NULL)
   {
-    if(currentCp->iterations_ != 0)
+    if(stats_ != NULL && slot != RETIRED_SLOT)
     {
-      maxCpIndex = checkPoint;
-      break;
+      numCheckpoints = stats_->getNumCheckpoints();
+      checkpoints = (CheckpointInfo*) stats_->getCheckpoints(slot);
+    }
+    else if(stats_ != NULL)
+    {
+      // Sized like the slots, which can't grow
+      numCheckpoints = stats_->getNumCheckpoints();
+      checkpoints = (CheckpointInfo*) allocateAligned(sizeof(CheckpointInfo) * numCheckpoints);
+    }
+    else
+    {
+      numCheckpoints = getNumRegisteredCheckpoints();
+      checkpoints = (CheckpointInfo*) allocateAligned(sizeof(CheckpointInfo) * numCheckpoints);
+    }
+    if(useHistograms_)
+    {
+      histograms = (LatencyHistogram*) allocateAligned(sizeof(LatencyHistogram) * numCheckpoints);
+    }
+    if(useSegmentStats_)
+    {
+      segmentStats = (SegmentStats*) allocateAligned(sizeof(SegmentStats) * numCheckpoints);
+    }
+    if(usePerfCounters_ && slot != threadTableSize_)
+    {
+      perfCounts = (PerfCounterInfo*) allocateAligned(sizeof(PerfCounterInfo) * numCheckpoints);
+    }
+    if(useCpuTime_ && slot != threadTableSize_)
+    {
+      cpuNanos = (uint64_t*) allocateAligned(sizeof(uint64_t) * numCheckpoints);
+    }
+    if(dumpSignal_ != 0)
+    {
+      pthread_mutex_lock(&growLock_);
+      reserveSignalScratch(numCheckpoints);
+      pthread_mutex_unlock(&growLock_);
     }
   }
 
-  out << "\nThroughput for each thread cp[" << maxCpIndex << "]:\n";
+  // The readers that don't take slotLock_, lip-top and the signal dump,
+  // retry their copy while the slot is being reset
+  beginThreadUpdate(threadCpInfo);
 
-  // Now get the greatest previousCycles from the last checkpoint hit to get the endTime
-  // Iterate over the vector and index the map
-  float totalThroughput(0);
-  for(int thread = 0; thread < threadIdCounter_; ++thread)
+  for(uint32_t chkPoint = 0; chkPoint < numCheckpoints; ++chkPoint)
   {
-    ThreadCheckpointInfo *threadCp = &(threadCpInfoMap_[threadIdVector_[thread]]);
-    uint64_t startTime(threadCp->creationCycles_);
-    uint64_t endTime(threadCp->checkpoints_[maxCpIndex].previousCycles_);
-    uint64_t iterations(threadCp->checkpoints_[maxCpIndex].iterations_);
-    float throughput = (iterations/((float) (endTime - startTime)/1000000.0));
-    totalThroughput += throughput;
-
-    out << "Thread[" << thread << "] Time usec [start, end, diff] = [" << startTime
-        << ", " << endTime
-        << ", " << (endTime - startTime)
-        << "], iterations = " << iterations
-        << ", throughput (iters/sec) = " << throughput
-        << endl;
+    new (&(checkpoints[chkPoint])) CheckpointInfo();
+    if(histograms != NULL)
+    {
+      new (&(histograms[chkPoint])) LatencyHistogram();
+    }
+    if(segmentStats != NULL)
+    {
+      new (&(segmentStats[chkPoint])) SegmentStats();
+    }
+    if(perfCounts != NULL)
+    {
+      new (&(perfCounts[chkPoint])) PerfCounterInfo();
+    }
+    if(cpuNanos != NULL)
+    {
+      cpuNanos[chkPoint] = 0;
+    }
   }
 
-  out << "\nTotal Throughput (iters/sec) = " << totalThroughput << endl;
+  // The counters and clocks belong to the thread that had the slot,
+  // the registering thread opens its own
+  delete threadCpInfo->perfCounters_;
+  delete threadCpInfo->cpuClock_;
+
+  // Like the trace rings, the overflow slot has no transitions, scope
+  // tree or CPU attribution, since they can only have one writer
+  if(transitions != NULL)
+  {
+    transitions->clear();
+  }
+  else if(useTransitions_ && slot != threadTableSize_)
+  {
+    transitions = new TransitionTable();
+  }
+  if(scopeTree != NULL)
+  {
+    scopeTree->reset();
+  }
+  else if(useScopeTree_ && slot != threadTableSize_)
+  {
+    scopeTree = new ScopeTree(scopeTreeNodes_, scopeTreeDepth_);
+  }
+  if(cpuSegments != NULL)
+  {
+    cpuSegments->clear();
+  }
+  else if(cpuTopology_ != NULL && slot != threadTableSize_)
+  {
+    cpuSegments = new CpuSegmentTable();
+  }
+
+  // The first segment of the thread starts now. The sequence keeps
+  // counting, so a copy made across the reset is never taken as consistent.
+  ThreadCheckpointInfo resetCpInfo;
+  resetCpInfo.sequence_ = threadCpInfo->sequence_;
+  *threadCpInfo = resetCpInfo;
+  threadCpInfo->creationCycles_ = getCycles();
+  checkpoints[0].previousCycles_ = threadCpInfo->creationCycles_;
+  threadCpInfo->checkpoints_ = checkpoints;
+  threadCpInfo->histograms_ = histograms;
+  threadCpInfo->segmentStats_ = segmentStats;
+  threadCpInfo->perfCounts_ = perfCounts;
+  threadCpInfo->cpuNanos_ = cpuNanos;
+  threadCpInfo->transitions_ = transitions;
+  threadCpInfo->scopeTree_ = scopeTree;
+  threadCpInfo->cpuSegments_ = cpuSegments;
+  threadCpInfo->numCheckpoints_ = numCheckpoints;
+  // The trace file has a ring per slot, but the overflow slot
+  if(trace_ != NULL && slot != threadTableSize_ && slot != RETIRED_SLOT)
+  {
+    threadCpInfo->traceRing_ = trace_->getRing(slot);
+  }
+  if(sampler_ != NULL)
+  {
+    // The threads draw different gaps, and in time based mode the
+    // first segment is sampled, as the epoch is seen as new
+    threadCpInfo->randomState_ = (slot + 1) * 2654435761U;
+    threadCpInfo->sampleEpoch_ = sampler_->getEpoch() - 1;
+    if(!sampler_->isTimeBased())
+    {
+      threadCpInfo->sampleWeight_ = sampler_->getSampleEvery();
+      threadCpInfo->sampleCountdown_ = CheckpointSampler::getSampleGap(threadCpInfo->randomState_,
+                                                                       threadCpInfo->sampleWeight_);
+    }
+  }
+
+  endThreadUpdate(threadCpInfo);
+}
+
+// private
+// The new arrays are published before the new size, so a reader that loads
+// numCheckpoints_ before the arrays never indexes past the end of them.
+bool Checkpoint::growCheckpoints(ThreadCheckpointInfo *threadCp, int checkpoint)
+{
+  if(checkpoint < 0 || checkpoint >= MAX_CHECKPOINT_ID)
+  {
+    return false;
+  }
+
+  // Only the overflow slot can have several threads growing it
+  pthread_mutex_lock(&growLock_);
+
+  // The arrays in the shared-memory segment have a fixed size
+  if(stats_ != NULL)
+  {
+    if(!shmFullNoticed_)
+    {
+      cout << "NOTICE: checkpoint [" << checkpoint << "] is beyond the ["
+           << stats_->getNumCheckpoints() << "] checkpoints of the shared-memory segment"
+           << ", increase Checkpoint::Config::shmMaxCheckpoints. Ignoring it."
+           << endl;
+      shmFullNoticed_ = true;
+    }
+    pthread_mutex_unlock(&growLock_);
+    return false;
+  }
+
+  uint32_t oldNumCheckpoints(threadCp->numCheckpoints_);
+  if((uint32_t) checkpoint < oldNumCheckpoints)
+  {
+    pthread_mutex_unlock(&growLock_);
+    return true;
+  }
+
+  // Grow to a power of 2, and at least to the number of registered
+  // checkpoints, so growing is rare
+  uint32_t numCheckpoints(oldNumCheckpoints > 0 ? oldNumCheckpoints : 1);
+  while(numCheckpoints <= (uint32_t) checkpoint)
+  {
+    numCheckpoints *= 2;
+  }
+  if(numCheckpoints < (uint32_t) getNumRegisteredCheckpoints())
+  {
+    numCheckpoints = getNumRegisteredCheckpoints();
+  }
+
+  growArray(threadCp->checkpoints_, oldNumCheckpoints, numCheckpoints);
+  if(threadCp->histograms_ != NULL)
+  {
+    growArray(threadCp->histograms_, oldNumCheckpoints, numCheckpoints);
+  }
+  if(threadCp->segmentStats_ != NULL)
+  {
+    growArray(threadCp->segmentStats_, oldNumCheckpoints, numCheckpoints);
+  }
+  if(threadCp->perfCounts_ != NULL)
+  {
+    growArray(threadCp->perfCounts_, oldNumCheckpoints, numCheckpoints);
+  }
+  if(threadCp->cpuNanos_ != NULL)
+  {
+    growArray(threadCp->cpuNanos_, oldNumCheckpoints, numCheckpoints);
+  }
+  if(dumpSignal_ != 0)
+  {
+    reserveSignalScratch(numCheckpoints);
+  }
+
+  __atomic_store_n(&threadCp->numCheckpoints_, numCheckpoints, __ATOMIC_RELEASE);
+
+  pthread_mutex_unlock(&growLock_);
+
+  return true;
+}
+
+// private
+template<typename T>
+void Checkpoint::growArray(T *&array, uint32_t oldNumCheckpoints, uint32_t numCheckpoints)
+{
+  T *newArray((T*) allocateAligned(sizeof(T) * numCheckpoints));
+  memcpy(newArray, array, sizeof(T) * oldNumCheckpoints);
+  for(uint32_t chkPoint = oldNumCheckpoints; chkPoint < numCheckpoints; ++chkPoint)
+  {
+    new (&(newArray[chkPoint])) T();
+  }
+  retiredArrays_.push_back(array);
+  __atomic_store_n(&array, newArray, __ATOMIC_RELEASE);
+}
+
+// static private
+Checkpoint::CheckpointRegistry &Checkpoint::getCheckpointRegistry()
+{
+  static CheckpointRegistry registry;
+  return registry;
+}
+
+// static
+int Checkpoint::registerCheckpoint(const string &name)
+{
+  CheckpointRegistry &registry(getCheckpointRegistry());
+  int checkpoint;
+
+  pthread_mutex_lock(&registry.lock_);
+  map<string, int>::iterator iter(registry.ids_.find(name));
+  if(iter != registry.ids_.end())
+  {
+    checkpoint = iter->second;
+  }
+  else
+  {
+    checkpoint = FIRST_NAMED_CHECKPOINT + registry.names_.size();
+    registry.names_.push_back(name);
+    registry.ids_[name] = checkpoint;
+    // The registry lock also serializes the segments' name tables
+    for(uint32_t index = 0; index < MAX_DOMAINS; ++index)
+    {
+      if(registry.statsDomains_[index] != NULL)
+      {
+        registry.statsDomains_[index]->stats_->addName(checkpoint, name);
+      }
+    }
+  }
+  pthread_mutex_unlock(&registry.lock_);
+
+  return checkpoint;
+}
+
+// static
+string Checkpoint::getCheckpointName(int checkpoint)
+{
+  CheckpointRegistry &registry(getCheckpointRegistry());
+  string name;
+
+  pthread_mutex_lock(&registry.lock_);
+  int index(checkpoint - FIRST_NAMED_CHECKPOINT);
+  if(index >= 0 && index < (int) registry.names_.size())
+  {
+    name = registry.names_[index];
+  }
+  pthread_mutex_unlock(&registry.lock_);
+
+  return name;
+}
+
+// static
+int Checkpoint::getNumRegisteredCheckpoints()
+{
+  CheckpointRegistry &registry(getCheckpointRegistry());
+
+  pthread_mutex_lock(&registry.lock_);
+  int numCheckpoints(FIRST_NAMED_CHECKPOINT + registry.names_.size());
+  pthread_mutex_unlock(&registry.lock_);
+
+  return numCheckpoints;
+}
+
+// static private
+vector<string> Checkpoint::getCheckpointNames()
+{
+  CheckpointRegistry &registry(getCheckpointRegistry());
+
+  pthread_mutex_lock(&registry.lock_);
+  vector<string> names(registry.names_);
+  pthread_mutex_unlock(&registry.lock_);
+
+  return names;
+}
+
+// static private
+string Checkpoint::getCheckpointLabel(int checkpoint, const vector<string> &names)
+{
+  int index(checkpoint - FIRST_NAMED_CHECKPOINT);
+  if(index >= 0 && index < (int) names.size())
+  {
+    return names[index];
+  }
+
+  ostringstream label;
+  label << checkpoint;
+  return label.str();
+}
+
+// private
+// Only called the first time a thread checkpoints, after that the
+// thread-local slot is used. The slot is claimed under slotLock_, which
+// is only taken by registering and exiting threads, and by the dumps.
+Checkpoint::ThreadCheckpointInfo *Checkpoint::registerThread()
+{
+  ThreadCheckpointInfo *threadCpInfo(NULL);
+  uint32_t slot(0);
+
+  if(numThreads_ == 0)
+  {
+    // Not multi-threaded, every caller uses slot 0. It was initialized
+    // with the table, and the callers that lose the race may already be
+    // checkpointing into it, so it is only published.
+    uint32_t expected(0);
+    if(__atomic_compare_exchange_n(&threadIdCounter_, &expected, 1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+    {
+      __atomic_store_n(&numSlots_, 1, __ATOMIC_RELEASE);
+    }
+    threadCpInfo = &(threadCpInfoTable_[0]);
+  }
+  else
+  {
+    pthread_mutex_lock(&slotLock_);
+    ++threadIdCounter_;
+    slot = claimSlot();
+    threadCpInfo = getThreadSlot(slot);
+    if(__likely(slot != threadTableSize_))
+    {
+      initThreadCpInfo(slot);
+      threadCpInfo->threadId_ = pthread_self();
+      // The slot's ring may hold the records of a thread that exited,
+      // the exporter starts a new track at the marker
+      if(threadCpInfo->traceRing_ != NULL)
+      {
+        threadCpInfo->traceRing_->push(threadCpInfo->creationCycles_, TRACE_THREAD_START);
+      }
+      if(usePerfCounters_)
+      {
+        openPerfCounters(threadCpInfo);
+      }
+      if(useCpuTime_)
+      {
+        openCpuClock(threadCpInfo);
+      }
+      if(threadCpInfo->cpuSegments_ != NULL)
+      {
+        threadCpInfo->lastCpu_ = cpuTopology_->getCurrentCpu();
+      }
+      // So the slot is retired and reused when the thread exits
+      if(useThreadExitKey_)
+      {
+        pthread_setspecific(threadExitKey_, this);
+      }
+    }
+    else
+    {
+      // More threads than slots, they all share the overflow slot
+      // and its counters will not be accurate. The slot was created with
+      // the table, so its creationCycles_ is the table creation time.
+      if(numThreadsShared_++ == 0)
+      {
+        cout << "NOTICE: more than [" << maxThreadSlots_
+             << "] threads are checkpointing at once, the extra threads will share one slot"
+             << endl;
+      }
+    }
+    pthread_mutex_unlock(&slotLock_);
+  }
+
+  ThreadLocalSlot &tlsSlot(domainIndex_ == 0 ? tlsSlot_ : tlsDomainSlots_[domainIndex_]);
+  tlsSlot.threadCpInfo_ = threadCpInfo;
+  tlsSlot.slot_ = slot;
+  tlsSlot.instanceId_ = instanceId_;
+
+  return threadCpInfo;
+}
+
+// private
+// The slots above the overflow slot are numbered on from it, so the
+// table slots keep their numbers, which the trace and lip-top use
+uint32_t Checkpoint::claimSlot()
+{
+  if(!freeSlots_.empty())
+  {
+    uint32_t slot(freeSlots_.back());
+    freeSlots_.pop_back();
+    return slot;
+  }
+
+  uint32_t slot(numSlots_);
+  if(slot < threadTableSize_)
+  {
+    __atomic_store_n(&numSlots_, slot + 1, __ATOMIC_RELEASE);
+    return slot;
+  }
+
+  // Skips the overflow slot, the slots claimed are then slot - 1
+  // plus the one being claimed
+  if(slot == threadTableSize_)
+  {
+    slot = threadTableSize_ + 1;
+  }
+  if(slot > maxThreadSlots_)
+  {
+    __atomic_store_n(&numSlots_, threadTableSize_ + 1 > numSlots_ ? threadTableSize_ + 1 : numSlots_, __ATOMIC_RELEASE);
+    return threadTableSize_;
+  }
+
+  // The chunk is published before numSlots_, see getThreadSlot()
+  uint32_t chunk((slot - threadTableSize_ - 1) / THREAD_CHUNK_SIZE);
+  if(threadCpInfoChunks_[chunk] == NULL)
+  {
+    ThreadCheckpointInfo *newChunk((ThreadCheckpointInfo*) allocateAligned(sizeof(ThreadCheckpointInfo) * THREAD_CHUNK_SIZE));
+    for(uint32_t chunkSlot = 0; chunkSlot < THREAD_CHUNK_SIZE; ++chunkSlot)
+    {
+      new (&(newChunk[chunkSlot])) ThreadCheckpointInfo();
+    }
+    __atomic_store_n(&(threadCpInfoChunks_[chunk]), newChunk, __ATOMIC_RELEASE);
+  }
+  __atomic_store_n(&numSlots_, slot + 1, __ATOMIC_RELEASE);
+
+  return slot;
+}
+
+// static private
+void Checkpoint::threadExitHook(void *profiler)
+{
+  ((Checkpoint*) profiler)->retireThread();
+}
+
+// private
+// Called on the exiting thread, whose thread-local slot is still valid
+void Checkpoint::retireThread()
+{
+  ThreadLocalSlot &tlsSlot(domainIndex_ == 0 ? tlsSlot_ : tlsDomainSlots_[domainIndex_]);
+  if(tlsSlot.instanceId_ != instanceId_ || tlsSlot.slot_ == threadTableSize_)
+  {
+    return;
+  }
+
+  // A checkpoint in a later thread exit hook registers the thread again
+  tlsSlot.instanceId_ = 0;
+
+  pthread_mutex_lock(&slotLock_);
+  addToRetired(tlsSlot.threadCpInfo_);
+  initThreadCpInfo(tlsSlot.slot_);
+  freeSlots_.push_back(tlsSlot.slot_);
+  ++numThreadsRetired_;
+  pthread_mutex_unlock(&slotLock_);
+}
+
+// private
+void Checkpoint::addToRetired(ThreadCheckpointInfo *threadCp)
+{
+  ThreadCheckpointInfo *retiredCp(retiredCpInfo_);
+  uint32_t numCheckpoints(threadCp->numCheckpoints_);
+  if(numCheckpoints > retiredCp->numCheckpoints_)
+  {
+    growCheckpoints(retiredCp, numCheckpoints - 1);
+    retiredCpHits_.resize(retiredCp->numCheckpoints_, 0);
+  }
+
+  for(uint32_t chkPoint = 0; chkPoint < numCheckpoints; ++chkPoint)
+  {
+    const CheckpointInfo &threadCpInfo(threadCp->checkpoints_[chkPoint]);
+    if(threadCpInfo.iterations_ == 0)
+    {
+      continue;
+    }
+
+    retiredCp->checkpoints_[chkPoint] += &threadCpInfo;
+    ++retiredCpHits_[chkPoint];
+
+    if(threadCp->histograms_ != NULL)
+    {
+      retiredCp->histograms_[chkPoint].merge(threadCp->histograms_[chkPoint]);
+    }
+    if(threadCp->segmentStats_ != NULL)
+    {
+      retiredCp->segmentStats_[chkPoint].merge(threadCp->segmentStats_[chkPoint]);
+    }
+    if(threadCp->perfCounters_ != NULL)
+    {
+      for(uint32_t counter = 0; counter < PerfCounters::NUM_COUNTERS; ++counter)
+      {
+        retiredCp->perfCounts_[chkPoint].counts_[counter] += threadCp->perfCounts_[chkPoint].counts_[counter];
+      }
+      retiredPerfCounted_ = true;
+    }
+    if(threadCp->cpuClock_ != NULL)
+    {
+      retiredCp->cpuNanos_[chkPoint] += threadCp->cpuNanos_[chkPoint];
+    }
+  }
+
+  if(threadCp->transitions_ != NULL)
+  {
+    vector<TransitionTable::Entry> transitions;
+    threadCp->transitions_->copyEntries(transitions);
+    for(size_t i = 0; i < transitions.size(); ++i)
+    {
+      TransitionInfo &transition((*retiredCp->transitions_)[transitions[i].key_]);
+      transition.iterations_  += transitions[i].value_.iterations_;
+      transition.totalCycles_ += transitions[i].value_.totalCycles_;
+    }
+  }
+  if(threadCp->scopeTree_ != NULL)
+  {
+    vector<ScopeTree::ScopeNode> scopeNodes;
+    threadCp->scopeTree_->copyNodes(scopeNodes);
+    retiredCp->scopeTree_->merge(scopeNodes, threadCp->scopeTree_->getNumDropped());
+  }
+  if(threadCp->cpuSegments_ != NULL)
+  {
+    vector<CpuSegmentTable::Entry> cpuSegments;
+    threadCp->cpuSegments_->copyEntries(cpuSegments);
+    for(size_t i = 0; i < cpuSegments.size(); ++i)
+    {
+      addCpuSegment((*retiredCp->cpuSegments_)[cpuSegments[i].key_], cpuSegments[i].value_);
+    }
+  }
+  retiredCp->numSampled_ += threadCp->numSampled_;
+
+  // For the signal dump, which can't read retiredCpHits_
+  if(dumpSignal_ != 0)
+  {
+    pthread_mutex_lock(&growLock_);
+    uint32_t numScratchCheckpoints(signalScratch_->numCheckpoints_ < numCheckpoints ?
+                                   signalScratch_->numCheckpoints_ : numCheckpoints);
+    for(uint32_t chkPoint = 0; chkPoint < numScratchCheckpoints; ++chkPoint)
+    {
+      __atomic_store_n(&(signalScratch_->retiredHits_[chkPoint]), retiredCpHits_[chkPoint], __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&growLock_);
+  }
+}
+
+// static private
+string Checkpoint::getThreadLabel(uint32_t slot)
+{
+  if(slot == RETIRED_SLOT)
+  {
+    return "retired";
+  }
+
+  ostringstream label;
+  label << slot;
+  return label.str();
+}
+
+// private
+void Checkpoint::openPerfCounters(ThreadCheckpointInfo *threadCp)
+{
+  PerfCounters *perfCounters(new PerfCounters());
+  if(!perfCounters->isOpen())
+  {
+    if(!__atomic_exchange_n(&perfNoticed_, true, __ATOMIC_RELAXED))
+    {
+      cout << "NOTICE: perf counters are not available, " << perfCounters->getErrorStr()
+           << ". The checkpoints will only be timed."
+           << endl;
+    }
+    delete perfCounters;
+    return;
+  }
+
+  for(uint32_t counter = 0; counter < PerfCounters::NUM_COUNTERS; ++counter)
+  {
+    if(perfCounters->isAvailable(counter))
+    {
+      __atomic_fetch_or(&perfAvailableMask_, 1 << counter, __ATOMIC_RELAXED);
+    }
+  }
+  threadCp->perfCounters_ = perfCounters;
+}
+
+// private
+void Checkpoint::openCpuClock(ThreadCheckpointInfo *threadCp)
+{
+  ThreadCpuClock *cpuClock(new ThreadCpuClock());
+  if(!cpuClock->usesSwitchDetection() && !__atomic_exchange_n(&cpuClockNoticed_, true, __ATOMIC_RELAXED))
+  {
+    cout << "NOTICE: the thread switches can't be detected, " << cpuClock->getErrorStr()
+         << ". The CPU time will be read with a system call per checkpoint."
+         << endl;
+  }
+  threadCp->cpuClock_ = cpuClock;
+}
+
+// Method to calculate current checkpoint information
+// The fast path with the runtime policies, see "CheckpointPolicy.h"
+void Checkpoint::checkpoint(int checkpoint)
+{
+  RuntimeCheckpoint::checkpoint(this, checkpoint);
+}
+
+// private
+// Every hit is counted, a sampled segment is timed from the previous hit
+// to this one, and its time and transition are weighted by the number of
+// segments it stands for: the mean gap in 1 in N mode, or the number of
+// segments since the previous sample in time based mode. The histograms keep the
+// unweighted sampled times, their distribution being the same, as do the
+// segment stats, whose count is then the number of segments sampled.
+void Checkpoint::sampledCheckpoint(ThreadCheckpointInfo *threadCp, int checkpoint)
+{
+  uint32_t previousCheckpoint    (  threadCp->lastCheckpointHit_ );
+  CheckpointInfo *currentCp      (  &(threadCp->checkpoints_[checkpoint]) );
+
+  bool closeSegment(threadCp->segmentSampled_);
+  if(sampler_->isTimeBased()) {
+    ++(threadCp->epochSegments_);
+    ++(threadCp->segmentsSinceSample_);
+    uint32_t epoch(sampler_->getEpoch());
+    if(__unlikely(epoch != threadCp->sampleEpoch_)) {
+      // A sample still pending from the previous epoch is dropped,
+      // its segments are then counted by the next sample
+      threadCp->sampleEpoch_ = epoch;
+      threadCp->sampleCountdown_ = CheckpointSampler::getSampleOffset(threadCp->randomState_,
+                                                                      (threadCp->epochSegments_ + 1) / 2);
+      threadCp->epochSegments_ = 0;
+    }
+  }
+  bool openSegment(threadCp->sampleCountdown_ != 0 && --(threadCp->sampleCountdown_) == 0);
+
+  beginThreadUpdate(threadCp);
+
+  threadCp->lastCheckpointHit_  =  checkpoint;
+  ++(currentCp->iterations_);
+
+  if(closeSegment || openSegment) {
+    uint64_t nowCycles(getCycles());
+    uint64_t deltas[PerfCounters::NUM_COUNTERS];
+    if(threadCp->perfCounters_ != NULL) {
+      threadCp->perfCounters_->readDeltas(deltas);
+    }
+    uint64_t cpuDeltaNanos(0);
+    if(threadCp->cpuClock_ != NULL) {
+      cpuDeltaNanos = threadCp->cpuClock_->getDeltaNanos(cyclesToNanos(nowCycles));
+    }
+    if(closeSegment) {
+      uint64_t elapsedCycles(subtractOverhead(nowCycles - threadCp->checkpoints_[previousCheckpoint].previousCycles_));
+      currentCp->totalCycles_ += elapsedCycles * threadCp->sampleWeight_;
+      if(threadCp->segmentStats_ != NULL) {
+        threadCp->segmentStats_[checkpoint].record(elapsedCycles);
+      }
+      if(threadCp->histograms_ != NULL) {
+        threadCp->histograms_[checkpoint].record(elapsedCycles);
+      }
+      if(threadCp->perfCounters_ != NULL) {
+        PerfCounterInfo &perfCounts(threadCp->perfCounts_[checkpoint]);
+        for(uint32_t counter = 0; counter < PerfCounters::NUM_COUNTERS; ++counter) {
+          perfCounts.counts_[counter] += deltas[counter] * threadCp->sampleWeight_;
+        }
+      }
+      if(threadCp->cpuClock_ != NULL) {
+        threadCp->cpuNanos_[checkpoint] += cpuDeltaNanos * threadCp->sampleWeight_;
+      }
+      if(threadCp->transitions_ != NULL) {
+        TransitionInfo &transition((*threadCp->transitions_)[((uint64_t) previousCheckpoint << 32) | (uint32_t) checkpoint]);
+        transition.iterations_  += threadCp->sampleWeight_;
+        transition.totalCycles_ += elapsedCycles * threadCp->sampleWeight_;
+      }
+      if(threadCp->cpuSegments_ != NULL) {
+        recordCpuSegment(threadCp, checkpoint, elapsedCycles, threadCp->sampleWeight_);
+      }
+      __atomic_store_n(&(threadCp->numSampled_), threadCp->numSampled_ + 1, __ATOMIC_RELAXED);
+    }
+    currentCp->previousCycles_ = nowCycles;
+
+    if(openSegment) {
+      // The CPU is only read for the sampled segments
+      if(threadCp->cpuSegments_ != NULL && !closeSegment) {
+        threadCp->lastCpu_ = cpuTopology_->getCurrentCpu();
+      }
+      if(sampler_->isTimeBased()) {
+        threadCp->sampleWeight_ = threadCp->segmentsSinceSample_;
+        threadCp->segmentsSinceSample_ = 0;
+      }
+      else {
+        threadCp->sampleWeight_ = sampler_->getSampleEvery();
+        threadCp->sampleCountdown_ = CheckpointSampler::getSampleGap(threadCp->randomState_,
+                                                                     threadCp->sampleWeight_);
+      }
+    }
+    threadCp->segmentSampled_ = openSegment;
+  }
+
+  endThreadUpdate(threadCp);
+}
+
+// private
+// Not inlined, so the calibration pays for a call like checkpoint() does
+__attribute__((noinline))
+void Checkpoint::calibrationCheckpoint(ThreadCheckpointInfo *threadCp, int checkpoint)
+{
+  if(__unlikely(!isActive_)) {
+    return;
+  }
+  if(__unlikely((uint32_t) checkpoint >= threadCp->numCheckpoints_)) {
+    return;
+  }
+  RuntimeCheckpoint::updateCheckpoint(this, threadCp, checkpoint);
+}
+
+// private
+// The overhead is the segment between 2 back to back checkpoints: the end of
+// the first one after its clock read, and the start of the second one up to
+// its clock read. The slowest 1% of the samples are left out, since they
+// are mostly interrupts and preemptions.
+void Checkpoint::calibrateOverhead()
+{
+  const uint32_t WARMUP_SAMPLES(1000);
+  const uint32_t NUM_SAMPLES(20000);
+
+  CheckpointInfo checkpoints[2];
+  ThreadCheckpointInfo threadCp;
+  threadCp.checkpoints_ = checkpoints;
+  threadCp.numCheckpoints_ = 2;
+  if(useHistograms_)
+  {
+    threadCp.histograms_ = (LatencyHistogram*) allocateAligned(sizeof(LatencyHistogram) * 2);
+    new (&(threadCp.histograms_[0])) LatencyHistogram();
+    new (&(threadCp.histograms_[1])) LatencyHistogram();
+  }
+  if(useSegmentStats_)
+  {
+    threadCp.segmentStats_ = (SegmentStats*) allocateAligned(sizeof(SegmentStats) * 2);
+    new (&(threadCp.segmentStats_[0])) SegmentStats();
+    new (&(threadCp.segmentStats_[1])) SegmentStats();
+  }
+  if(useTransitions_)
+  {
+    threadCp.transitions_ = new TransitionTable();
+  }
+  if(cpuTopology_ != NULL)
+  {
+    threadCp.cpuSegments_ = new CpuSegmentTable();
+    threadCp.lastCpu_ = cpuTopology_->getCurrentCpu();
+  }
+  if(usePerfCounters_)
+  {
+    threadCp.perfCounts_ = (PerfCounterInfo*) allocateAligned(sizeof(PerfCounterInfo) * 2);
+    threadCp.perfCounters_ = new PerfCounters();
+    if(!threadCp.perfCounters_->isOpen())
+    {
+      delete threadCp.perfCounters_;
+      threadCp.perfCounters_ = NULL;
+    }
+  }
+  if(useCpuTime_)
+  {
+    threadCp.cpuNanos_ = (uint64_t*) allocateAligned(sizeof(uint64_t) * 2);
+    threadCp.cpuNanos_[0] = threadCp.cpuNanos_[1] = 0;
+    threadCp.cpuClock_ = new ThreadCpuClock();
+  }
+
+  vector<uint64_t> samples;
+  samples.reserve(NUM_SAMPLES);
+  for(uint32_t i = 0; i < WARMUP_SAMPLES + NUM_SAMPLES; ++i)
+  {
+    calibrationCheckpoint(&threadCp, 0);
+    calibrationCheckpoint(&threadCp, 1);
+    if(i >= WARMUP_SAMPLES)
+    {
+      samples.push_back(checkpoints[1].previousCycles_ - checkpoints[0].previousCycles_);
+    }
+  }
+
+  free(threadCp.histograms_);
+  free(threadCp.segmentStats_);
+  delete threadCp.transitions_;
+  delete threadCp.cpuSegments_;
+  free(threadCp.perfCounts_);
+  delete threadCp.perfCounters_;
+  free(threadCp.cpuNanos_);
+  delete threadCp.cpuClock_;
+
+  sort(samples.begin(), samples.end());
+  samples.resize(samples.size() - samples.size() / 100);
+
+  double mean(0.0);
+  for(size_t i = 0; i < samples.size(); ++i)
+  {
+    mean += samples[i];
+  }
+  mean /= samples.size();
+
+  double variance(0.0);
+  for(size_t i = 0; i < samples.size(); ++i)
+  {
+    variance += (samples[i] - mean) * (samples[i] - mean);
+  }
+  variance /= samples.size();
+
+  overheadNanos_ = mean * nanosPerCycle_;
+  overheadVariance_ = variance * nanosPerCycle_ * nanosPerCycle_;
+}
+
+// The scope is timed with the cycles taken by checkpoint(),
+// the tree is only updated if the checkpoint was taken
+void Checkpoint::enterScope(int checkpoint)
+{
+  this->checkpoint(checkpoint);
+
+  ThreadCheckpointInfo *threadCp(getThreadCpInfo());
+  if(threadCp->scopeTree_ == NULL || !isActive_ || (uint32_t) checkpoint >= threadCp->numCheckpoints_) {
+    return;
+  }
+
+  beginThreadUpdate(threadCp);
+  threadCp->scopeTree_->push(checkpoint, threadCp->checkpoints_[checkpoint].previousCycles_);
+  endThreadUpdate(threadCp);
+}
+
+void Checkpoint::exitScope(int checkpoint)
+{
+  this->checkpoint(checkpoint);
+
+  ThreadCheckpointInfo *threadCp(getThreadCpInfo());
+  if(threadCp->scopeTree_ == NULL || !isActive_ || (uint32_t) checkpoint >= threadCp->numCheckpoints_) {
+    return;
+  }
+
+  beginThreadUpdate(threadCp);
+  threadCp->scopeTree_->pop(threadCp->checkpoints_[checkpoint].previousCycles_);
+  endThreadUpdate(threadCp);
+}
+
+// private
+void Checkpoint::getThreadCpInfoSnapshot(uint32_t slot,
+                                         ThreadCheckpointInfo &snapshot,
+                                         vector<CheckpointInfo> &checkpoints,
+                                         vector<TransitionTable::Entry> *transitions /* default NULL */,
+                                         vector<ScopeTree::ScopeNode> *scopeNodes /* default NULL */,
+                                         vector<CpuSegmentTable::Entry> *cpuSegments /* default NULL */)
+{
+  ThreadCheckpointInfo *threadCp(getThreadSlot(slot));
+
+  // The retries are bounded, since the overflow slot has several writers
+  // whose sequence updates may race, leaving the sequence odd
+  const int MAX_RETRIES(10000);
+  uint32_t sequenceBefore, sequenceAfter;
+  int retries(0);
+  do
+  {
+    sequenceBefore = __atomic_load_n(&threadCp->sequence_, __ATOMIC_ACQUIRE);
+    memcpy(&snapshot, threadCp, sizeof(ThreadCheckpointInfo));
+
+    // See growCheckpoints() for the order of these
+    snapshot.numCheckpoints_ = __atomic_load_n(&threadCp->numCheckpoints_, __ATOMIC_ACQUIRE);
+    snapshot.checkpoints_ = __atomic_load_n(&threadCp->checkpoints_, __ATOMIC_ACQUIRE);
+    snapshot.histograms_ = __atomic_load_n(&threadCp->histograms_, __ATOMIC_ACQUIRE);
+    snapshot.segmentStats_ = __atomic_load_n(&threadCp->segmentStats_, __ATOMIC_ACQUIRE);
+    snapshot.perfCounts_ = __atomic_load_n(&threadCp->perfCounts_, __ATOMIC_ACQUIRE);
+    snapshot.cpuNanos_ = __atomic_load_n(&threadCp->cpuNanos_, __ATOMIC_ACQUIRE);
+    checkpoints.resize(snapshot.numCheckpoints_);
+    memcpy(&(checkpoints[0]), snapshot.checkpoints_, sizeof(CheckpointInfo) * snapshot.numCheckpoints_);
+    if(transitions != NULL)
+    {
+      transitions->clear();
+      if(snapshot.transitions_ != NULL)
+      {
+        snapshot.transitions_->copyEntries(*transitions);
+      }
+    }
+    if(scopeNodes != NULL)
+    {
+      scopeNodes->clear();
+      if(snapshot.scopeTree_ != NULL)
+      {
+        snapshot.scopeTree_->copyNodes(*scopeNodes);
+      }
+    }
+    if(cpuSegments != NULL)
+    {
+      cpuSegments->clear();
+      if(snapshot.cpuSegments_ != NULL)
+      {
+        snapshot.cpuSegments_->copyEntries(*cpuSegments);
+      }
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    sequenceAfter = __atomic_load_n(&threadCp->sequence_, __ATOMIC_RELAXED);
+  } while(useLocking_ &&
+          ((sequenceBefore & 1) || sequenceBefore != sequenceAfter) &&
+          ++retries < MAX_RETRIES);
+
+  snapshot.checkpoints_ = &(checkpoints[0]);
+}
+
+const char *Checkpoint::getTimeResolutionStr(uint64_t &avgCycles, uint64_t &totalCycles) const
+{
+  avgCycles   = cyclesToNanos(avgCycles);
+  totalCycles = cyclesToNanos(totalCycles);
+
+  return getTimeUnitStr(avgCycles, totalCycles);
+}
+
+// static
+const char *Checkpoint::getTimeUnitStr(uint64_t &avgNanos, uint64_t &totalNanos)
+{
+  const char *unitPtr(Checkpoint::NANO_SEC_STR.c_str());
+
+  if(avgNanos > 99999999LU && totalNanos > 999999999LU)
+  {
+    totalNanos /= 1000000000LU;
+    avgNanos   /= 1000000000LU;
+    unitPtr = Checkpoint::SECOND_STR.c_str();
+  }
+  else if(avgNanos > 9999999LU && totalNanos > 99999999LU)
+  {
+    totalNanos /= 1000000LU;
+    avgNanos   /= 1000000LU;
+    unitPtr = Checkpoint::MILLI_SEC_STR.c_str();
+  }
+  else if(avgNanos > 9999 && totalNanos > 99999)
+  {
+    totalNanos /= 1000;
+    avgNanos   /= 1000;
+    unitPtr = Checkpoint::MICRO_SEC_STR.c_str();
+  }
+
+  return unitPtr;
+}
+
+// static
+double Checkpoint::getTimeUnitDivisor(double nanos, const char *&unitPtr)
+{
+  if(nanos > 99999999.0)
+  {
+    unitPtr = Checkpoint::SECOND_STR.c_str();
+    return 1000000000.0;
+  }
+  if(nanos > 9999999.0)
+  {
+    unitPtr = Checkpoint::MILLI_SEC_STR.c_str();
+    return 1000000.0;
+  }
+  if(nanos > 9999.0)
+  {
+    unitPtr = Checkpoint::MICRO_SEC_STR.c_str();
+    return 1000.0;
+  }
+  unitPtr = Checkpoint::NANO_SEC_STR.c_str();
+  return 1.0;
+}
+
+// private
+// Appends the hardware counters of a checkpoint to the current dump line:
+// the IPC over all its iterations, and the misses per iteration of the
+// checkpoint. A counter no thread could open is shown as n/a
+void Checkpoint::dumpPerfCounters(ostream &out, const PerfCounterInfo &counts, uint64_t iterations)
+{
+  uint32_t mask(__atomic_load_n(&perfAvailableMask_, __ATOMIC_RELAXED));
+  const uint32_t IPC_MASK((1 << PerfCounters::INSTRUCTIONS) | (1 << PerfCounters::CYCLES));
+
+  out << " Counters [IPC,LLCMisses,BranchMisses] = [";
+  if((mask & IPC_MASK) == IPC_MASK && counts.counts_[PerfCounters::CYCLES] != 0)
+  {
+    out << ((double) counts.counts_[PerfCounters::INSTRUCTIONS] / counts.counts_[PerfCounters::CYCLES]);
+  }
+  else
+  {
+    out << "n/a";
+  }
+
+  const uint32_t MISSES[2] = {PerfCounters::LLC_MISSES, PerfCounters::BRANCH_MISSES};
+  for(int i = 0; i < 2; ++i)
+  {
+    out << ", ";
+    if((mask & (1 << MISSES[i])) != 0 && iterations != 0)
+    {
+      out << ((double) counts.counts_[MISSES[i]] / iterations);
+    }
+    else
+    {
+      out << "n/a";
+    }
+  }
+  out << "]";
+}
+
+// The on-CPU time is capped at the wall time, which may be lower when the
+// overhead is subtracted or the wall clock is in micro-seconds
+void Checkpoint::dumpCpuTime(ostream &out, uint64_t cpuNanos, uint64_t wallCycles, uint64_t iterations)
+{
+  uint64_t wallNanos(cyclesToNanos(wallCycles));
+  uint64_t onCpuNanos(cpuNanos < wallNanos ? cpuNanos : wallNanos);
+
+  uint64_t avgWallNanos(wallNanos / iterations);
+  const char *unitPtr;
+  double divisor(getTimeUnitDivisor(avgWallNanos, unitPtr));
+
+  double scale(1.0 / (divisor * iterations));
+  out << " CPU [Unit,AvgOnCpu,AvgOffCpu,Utilization] = [" << unitPtr
+      << ", " << (uint64_t) (onCpuNanos * scale)
+      << ", " << (uint64_t) ((wallNanos - onCpuNanos) * scale)
+      << ", " << (wallNanos > 0 ? (100.0 * onCpuNanos / wallNanos) : 100.0) << "%]";
+}
+
+// static private
+template<typename T>
+void Checkpoint::reduceCheckpoints(vector<vector<T> > &partials,
+                                   vector<uint32_t> &partialThreads,
+                                   const T *checkpoints,
+                                   uint32_t numCheckpoints)
+{
+  partials.push_back(vector<T>(checkpoints, checkpoints + numCheckpoints));
+  partialThreads.push_back(1);
+
+  while(partials.size() > 1 && partialThreads[partials.size() - 2] == partialThreads.back())
+  {
+    mergeCheckpoints(partials[partials.size() - 2], partials.back());
+    partialThreads[partials.size() - 2] *= 2;
+    partials.pop_back();
+    partialThreads.pop_back();
+  }
+}
+
+// static private
+// The remaining partials are merged smallest first
+template<typename T>
+vector<T> *Checkpoint::finishReduction(vector<vector<T> > &partials)
+{
+  if(partials.empty())
+  {
+    return NULL;
+  }
+
+  while(partials.size() > 1)
+  {
+    mergeCheckpoints(partials[partials.size() - 2], partials.back());
+    partials.pop_back();
+  }
+
+  return &(partials[0]);
+}
+
+// static private
+template<typename T>
+void Checkpoint::mergeCheckpoints(vector<T> &lhs, const vector<T> &rhs)
+{
+  if(rhs.size() > lhs.size())
+  {
+    lhs.resize(rhs.size());
+  }
+  for(size_t chkPoint = 0; chkPoint < rhs.size(); ++chkPoint)
+  {
+    mergeCounters(lhs[chkPoint], rhs[chkPoint]);
+  }
+}
+
+void Checkpoint::dumpSegmentStats(ostream &out, const SegmentStats &stats)
+{
+  double meanNanos(stats.getMean() * nanosPerCycle_);
+  const char *unitPtr;
+  double divisor(getTimeUnitDivisor(meanNanos, unitPtr));
+
+  double scale(nanosPerCycle_ / divisor);
+  out << " Stats [Unit,Min,Max,Mean,StdDev] = [" << unitPtr
+      << ", " << (uint64_t) (stats.getMin() * scale)
+      << ", " << (uint64_t) (stats.getMax() * scale)
+      << ", " << (stats.getMean() * scale)
+      << ", " << (stats.getStdDev() * scale) << "]";
+}
+
+// private
+// Appends the latency distribution of a checkpoint to the current dump line
+// The unit is chosen from the median, like getTimeResolutionStr() does with the average
+void Checkpoint::dumpLatency(ostream &out, const LatencyHistogram &histogram)
+{
+  uint64_t medianNanos(cyclesToNanos(histogram.getValueAtPercentile(50.0)));
+  const char *unitPtr;
+  double divisor(getTimeUnitDivisor(medianNanos, unitPtr));
+
+  double scale(nanosPerCycle_ / divisor);
+  out << " Latency [Unit,Min,Max,StdDev] = [" << unitPtr
+      << ", " << (uint64_t) (histogram.getMin() * scale)
+      << ", " << (uint64_t) (histogram.getMax() * scale)
+      << ", " << (uint64_t) (histogram.getStdDev() * scale) << "]";
+
+  if(percentiles_.empty())
+  {
+    return;
+  }
+
+  out << " Percentiles [";
+  for(size_t i = 0; i < percentiles_.size(); ++i)
+  {
+    out << (i == 0 ? "p" : ",p") << percentiles_[i];
+  }
+  out << "] = [";
+  for(size_t i = 0; i < percentiles_.size(); ++i)
+  {
+    out << (i == 0 ? "" : ", ")
+        << (uint64_t) (histogram.getValueAtPercentile(percentiles_[i]) * scale);
+  }
+  out << "]";
+}
+
+// private
+ScopeTree *Checkpoint::getMergedScopeTree()
+{
+  if(!useScopeTree_)
+  {
+    return NULL;
+  }
+
+  pthread_mutex_lock(&slotLock_);
+
+  // The retired threads are copied last, as one more thread
+  uint32_t numThreadsUsed(getNumThreadsUsed());
+  vector<vector<ScopeTree::ScopeNode> > scopeNodes(numThreadsUsed + 1);
+  vector<uint64_t> numDropped(numThreadsUsed + 1, 0);
+
+  ThreadCheckpointInfo snapshot;
+  vector<CheckpointInfo> snapshotCheckpoints;
+  for(uint32_t thread = 0; thread <= numThreadsUsed; ++thread)
+  {
+    getThreadCpInfoSnapshot((thread < numThreadsUsed ? thread : RETIRED_SLOT),
+                            snapshot, snapshotCheckpoints, NULL, &scopeNodes[thread]);
+    numDropped[thread] = (snapshot.scopeTree_ != NULL ? snapshot.scopeTree_->getNumDropped() : 0);
+  }
+
+  pthread_mutex_unlock(&slotLock_);
+
+  // The merged tree needs at most the nodes copied, without their roots.
+  // Past the largest tree a uint32_t can index, the scopes are dropped.
+  uint64_t numNodes(0);
+  for(uint32_t thread = 0; thread <= numThreadsUsed; ++thread)
+  {
+    numNodes += (scopeNodes[thread].empty() ? 0 : scopeNodes[thread].size() - 1);
+  }
+  if(numNodes >= ScopeTree::INVALID_NODE)
+  {
+    numNodes = ScopeTree::INVALID_NODE - 1;
+  }
+
+  ScopeTree *mergedTree(new ScopeTree(numNodes, scopeTreeDepth_));
+  for(uint32_t thread = 0; thread <= numThreadsUsed; ++thread)
+  {
+    mergedTree->merge(scopeNodes[thread], numDropped[thread]);
+  }
+
+  return mergedTree;
+}
+
+// private
+// Exclusive is the time not spent in child scopes
+void Checkpoint::dumpScopeTree(ostream &out,
+                               const vector<ScopeTree::ScopeNode> &nodes,
+                               uint32_t node,
+                               int depth,
+                               const vector<string> &names)
+{
+  if(node != ScopeTree::ROOT_NODE)
+  {
+    const ScopeTree::ScopeNode &scope(nodes[node]);
+    uint64_t inclusiveCycles(scope.inclusiveCycles_);
+    uint64_t exclusiveCycles(scope.inclusiveCycles_ > scope.childCycles_ ? scope.inclusiveCycles_ - scope.childCycles_ : 0);
+    uint64_t avgCycles(scope.calls_ != 0 ? inclusiveCycles/scope.calls_ : 0);
+    uint64_t totalCycles(inclusiveCycles);
+    // The unit is chosen from the inclusive time, exclusive is converted to the same unit
+    const char *unitPtr(getTimeResolutionStr(avgCycles, totalCycles));
+    uint64_t exclusiveTime(cyclesToNanos(exclusiveCycles));
+    if(unitPtr == SECOND_STR.c_str())         { exclusiveTime /= 1000000000LU; }
+    else if(unitPtr == MILLI_SEC_STR.c_str()) { exclusiveTime /= 1000000LU; }
+    else if(unitPtr == MICRO_SEC_STR.c_str()) { exclusiveTime /= 1000LU; }
+
+    out << string(2 * depth, ' ')
+        << "Scope [" << getCheckpointLabel(scope.checkpoint_, names)
+        << "] Calls [" << scope.calls_
+        << "] Time [Unit,Avg,Inclusive,Exclusive] = [" << unitPtr
+        << ", " << avgCycles
+        << ", " << totalCycles
+        << ", " << exclusiveTime << "]"
+        << "\n";
+  }
+
+  for(uint32_t child = nodes[node].firstChild_; child != ScopeTree::INVALID_NODE; child = nodes[child].nextSibling_)
+  {
+    dumpScopeTree(out, nodes, child, depth + 1, names);
+  }
+}
+
+// private
+void Checkpoint::dumpFoldedStacks(ostream &out,
+                                  const vector<ScopeTree::ScopeNode> &nodes,
+                                  uint32_t node,
+                                  const string &path,
+                                  const vector<string> &names)
+{
+  string nodePath(path);
+  if(node != ScopeTree::ROOT_NODE)
+  {
+    // ';' separates the frames and the count follows a space
+    string label(getCheckpointLabel(nodes[node].checkpoint_, names));
+    for(size_t i = 0; i < label.size(); ++i)
+    {
+      if(label[i] == ';' || label[i] == ' ' || label[i] == '\n')
+      {
+        label[i] = '_';
+      }
+    }
+    nodePath += (path.empty() ? "" : ";") + label;
+
+    const ScopeTree::ScopeNode &scope(nodes[node]);
+    uint64_t exclusiveCycles(scope.inclusiveCycles_ > scope.childCycles_ ? scope.inclusiveCycles_ - scope.childCycles_ : 0);
+    if(exclusiveCycles > 0)
+    {
+      out << nodePath << " " << cyclesToNanos(exclusiveCycles) << "\n";
+    }
+  }
+
+  for(uint32_t child = nodes[node].firstChild_; child != ScopeTree::INVALID_NODE; child = nodes[child].nextSibling_)
+  {
+    dumpFoldedStacks(out, nodes, child, nodePath, names);
+  }
+}
+
+void Checkpoint::dumpFoldedStacks(ostream &out)
+{
+  ScopeTree *mergedTree(getMergedScopeTree());
+  if(mergedTree == NULL)
+  {
+    return;
+  }
+
+  vector<ScopeTree::ScopeNode> nodes;
+  mergedTree->copyNodes(nodes);
+  dumpFoldedStacks(out, nodes, ScopeTree::ROOT_NODE, "", getCheckpointNames());
+  out.flush();
+
+  delete mergedTree;
+}
+
+// private
+// The share is of the time of all the edges dumped
+void Checkpoint::dumpTransitions(ostream &out,
+                                 const string &prefix,
+                                 vector<TransitionTable::Entry> &transitions,
+                                 const vector<string> &names)
+{
+  sort(transitions.begin(), transitions.end(), TransitionTable::isKeyLess);
+
+  uint64_t sumCycles(0);
+  for(size_t i = 0; i < transitions.size(); ++i)
+  {
+    sumCycles += transitions[i].value_.totalCycles_;
+  }
+
+  for(size_t i = 0; i < transitions.size(); ++i)
+  {
+    const TransitionInfo &transition(transitions[i].value_);
+    uint64_t totalCycles(transition.totalCycles_);
+    uint64_t avgCycles(transition.iterations_ != 0 ? totalCycles/transition.iterations_ : 0);
+    const char *unitPtr(getTimeResolutionStr(avgCycles, totalCycles));
+
+    out << prefix
+        << "Transition [" << getCheckpointLabel(transitions[i].key_ >> 32, names)
+        << " -> " << getCheckpointLabel(transitions[i].key_ & 0xffffffff, names)
+        << "] Iterations [" << transition.iterations_
+        << "] Time [Unit,Avg,Total] = [" << unitPtr
+        << ", " << avgCycles
+        << ", " << totalCycles
+        << "] Share [" << (sumCycles != 0 ? (100.0 * transition.totalCycles_) / sumCycles : 0.0) << "%]"
+        << "\n";
+  }
+}
+
+// static private
+void Checkpoint::addCpuSegment(CpuSegmentInfo &lhs, const CpuSegmentInfo &rhs)
+{
+  lhs.iterations_     += rhs.iterations_;
+  lhs.totalCycles_    += rhs.totalCycles_;
+  lhs.migrations_     += rhs.migrations_;
+  lhs.migratedCycles_ += rhs.migratedCycles_;
+  lhs.nodeMigrations_ += rhs.nodeMigrations_;
+}
+
+// private
+// Each checkpoint's CPUs are followed by its NUMA nodes, with the
+// average time of all the segments and of those that migrated
+void Checkpoint::dumpCpuSegments(ostream &out,
+                                 const string &prefix,
+                                 vector<CpuSegmentTable::Entry> &cpuSegments,
+                                 const vector<string> &names)
+{
+  sort(cpuSegments.begin(), cpuSegments.end(), CpuSegmentTable::isKeyLess);
+
+  for(size_t first = 0; first < cpuSegments.size(); )
+  {
+    uint32_t checkpoint(cpuSegments[first].key_ >> 32);
+    size_t last(first);
+    map<uint32_t, CpuSegmentInfo> nodeSegments;
+    for( ; last < cpuSegments.size() && (cpuSegments[last].key_ >> 32) == checkpoint; ++last)
+    {
+      uint32_t cpu(cpuSegments[last].key_ & 0xffffffff);
+      uint32_t node(cpuTopology_->getNode(cpu));
+      CpuSegmentInfo &nodeSegment(nodeSegments.insert(make_pair(node, CpuSegmentInfo())).first->second);
+      addCpuSegment(nodeSegment, cpuSegments[last].value_);
+
+      ostringstream label;
+      label << "CPU [" << cpu << "] Node [" << node << "]";
+      dumpCpuSegment(out, prefix, checkpoint, label.str(), cpuSegments[last].value_, names);
+    }
+
+    for(map<uint32_t, CpuSegmentInfo>::const_iterator iter = nodeSegments.begin();
+        iter != nodeSegments.end();
+        ++iter)
+    {
+      ostringstream label;
+      label << "Node [" << iter->first << "]";
+      dumpCpuSegment(out, prefix, checkpoint, label.str(), iter->second, names);
+    }
+
+    first = last;
+  }
+}
+
+// private
+void Checkpoint::dumpCpuSegment(ostream &out,
+                                const string &prefix,
+                                uint32_t checkpoint,
+                                const string &label,
+                                const CpuSegmentInfo &cpuSegment,
+                                const vector<string> &names)
+{
+  uint64_t totalCycles(cpuSegment.totalCycles_);
+  uint64_t avgCycles(cpuSegment.iterations_ != 0 ? totalCycles/cpuSegment.iterations_ : 0);
+  const char *unitPtr(getTimeResolutionStr(avgCycles, totalCycles));
+
+  out << prefix
+      << "Checkpoint [" << getCheckpointLabel(checkpoint, names)
+      << "] " << label
+      << " Iterations [" << cpuSegment.iterations_
+      << "] Time [Unit,Avg,Total] = [" << unitPtr
+      << ", " << avgCycles
+      << ", " << totalCycles
+      << "] Migrations [CPU,Node] = [" << cpuSegment.migrations_
+      << ", " << cpuSegment.nodeMigrations_
+      << "]";
+  if(cpuSegment.migrations_ != 0)
+  {
+    uint64_t migratedTotal(cpuSegment.migratedCycles_);
+    uint64_t migratedAvg(migratedTotal/cpuSegment.migrations_);
+    const char *migratedUnitPtr(getTimeResolutionStr(migratedAvg, migratedTotal));
+    out << " Migrated Time [Unit,Avg] = [" << migratedUnitPtr
+        << ", " << migratedAvg
+        << "]";
+  }
+  out << "\n";
+}
+
+// private
+bool Checkpoint::copyDumpedThread(uint32_t slot, DumpedThread &thread)
+{
+  ThreadCheckpointInfo snapshot;
+  getThreadCpInfoSnapshot(slot, snapshot, thread.checkpoints_,
+                          (useTransitions_ ? &thread.transitions_ : NULL),
+                          NULL,
+                          (cpuTopology_ != NULL ? &thread.cpuSegments_ : NULL));
+
+  // Unused checkpoints past the last one hit are not dumped
+  uint32_t maxCpIndex(0);
+  for(uint32_t chkPoint = 0; chkPoint < snapshot.numCheckpoints_; ++chkPoint)
+  {
+    if(thread.checkpoints_[chkPoint].iterations_ != 0)
+    {
+      maxCpIndex = chkPoint + 1;
+    }
+  }
+  if(maxCpIndex == 0)
+  {
+    return false;
+  }
+  thread.checkpoints_.resize(maxCpIndex);
+
+  // The retired threads have no counters or clock of their own
+  bool isRetired(slot == RETIRED_SLOT);
+  thread.slot_ = slot;
+  thread.hasPerfCounts_ = (isRetired ? retiredPerfCounted_ : snapshot.perfCounters_ != NULL);
+  thread.hasCpuTime_ = (isRetired ? snapshot.cpuNanos_ != NULL : snapshot.cpuClock_ != NULL);
+  thread.histograms_.clear();
+  thread.segmentStats_.clear();
+  thread.perfCounts_.clear();
+  thread.cpuNanos_.clear();
+  thread.numHits_.clear();
+  if(snapshot.histograms_ != NULL)
+  {
+    thread.histograms_.assign(snapshot.histograms_, snapshot.histograms_ + maxCpIndex);
+  }
+  if(snapshot.segmentStats_ != NULL)
+  {
+    thread.segmentStats_.assign(snapshot.segmentStats_, snapshot.segmentStats_ + maxCpIndex);
+  }
+  if(thread.hasPerfCounts_)
+  {
+    thread.perfCounts_.assign(snapshot.perfCounts_, snapshot.perfCounts_ + maxCpIndex);
+  }
+  if(thread.hasCpuTime_)
+  {
+    thread.cpuNanos_.assign(snapshot.cpuNanos_, snapshot.cpuNanos_ + maxCpIndex);
+  }
+  if(isRetired)
+  {
+    thread.numHits_.assign(retiredCpHits_.begin(), retiredCpHits_.end());
+    thread.numHits_.resize(maxCpIndex, 0);
+  }
+
+  return true;
+}
+
+// Dump all the checkpoint information
+//
+// The counters are copied under slotLock_, so the threads can't register or
+// retire meanwhile and each thread's counters are dumped once. They are
+// formatted once it is released, so a slow stream never holds up a thread's
+// first checkpoint or its exit.
+void Checkpoint::dump(ostream &out, bool verbose, bool dumpAverages, bool dumpTput, bool dumpThreadIds)
+{
+  // The slots are in thread registration order, until the slots of the
+  // exited threads are reused, then the retired threads as one
+  vector<DumpedThread> threads;
+  vector<pthread_t> threadIds;
+  uint32_t numThreadsCounted(0);
+  bool useRdpmc(false);
+
+  pthread_mutex_lock(&slotLock_);
+
+  uint32_t numThreadsUsed(getNumThreadsUsed());
+  uint32_t threadIdCounter(threadIdCounter_);
+  uint32_t numThreadsRetired(numThreadsRetired_);
+  uint32_t numThreadsShared(numThreadsShared_);
+  for(uint32_t slot = 0; slot <= numThreadsUsed; ++slot)
+  {
+    if(slot == numThreadsUsed && numThreadsRetired == 0)
+    {
+      break;
+    }
+    threads.resize(threads.size() + 1);
+    if(!copyDumpedThread((slot < numThreadsUsed ? slot : RETIRED_SLOT), threads.back()))
+    {
+      threads.pop_back();
+    }
+  }
+  if(usePerfCounters_)
+  {
+    for(uint32_t slot = 0; slot < numThreadsUsed; ++slot)
+    {
+      if(getThreadSlot(slot)->perfCounters_ != NULL)
+      {
+        ++numThreadsCounted;
+        useRdpmc = getThreadSlot(slot)->perfCounters_->usesRdpmc();
+      }
+    }
+  }
+  if(dumpThreadIds)
+  {
+    for(uint32_t slot = 0; slot < numThreadsUsed; ++slot)
+    {
+      threadIds.push_back(getThreadSlot(slot)->threadId_);
+    }
+  }
+  // The scope trees of all the threads
+  ScopeTree *mergedTree(getMergedScopeTree());
+
+  pthread_mutex_unlock(&slotLock_);
+
+  if(verbose)
+  {
+    if(!domainName_.empty())
+    {
+      out << "Domain [" << domainName_ << "]" << endl;
+    }
+    out << "Number of Threads [configured, used] = [" << numThreads_
+        << ", " << threadIdCounter
+        << "]"
+        << endl;
+    if(numThreadsRetired > 0)
+    {
+      out << "Threads exited [" << numThreadsRetired
+          << "] their counters are dumped as Thread [retired], thread slots ["
+          << (numThreadsUsed - (numThreadsUsed > threadTableSize_ ? 1 : 0))
+          << "]"
+          << endl;
+    }
+    if(numThreadsShared > 0)
+    {
+      out << "NOTICE: the last thread slot is shared by the ["
+          << numThreadsShared
+          << "] threads registered beyond the maximum number of thread slots ["
+          << maxThreadSlots_ << "]"
+          << endl;
+    }
+  }
+
+  if(verbose)
+  {
+    out << "Clock source [" << getClockSourceStr(clockSource_) << "]";
+    if(clockSource_ == CLOCK_SOURCE_TSC || clockSource_ == CLOCK_SOURCE_TSCP)
+    {
+      out << " calibrated at [" << (1.0 / nanosPerCycle_) << "] cycles per nanosecond" << endl;
+    }
+    else
+    {
+      struct timespec resolution;
+      //clock_getres(CLOCK_THREAD_CPUTIME_ID, &resolution);
+      clock_getres(clockSource_ == CLOCK_SOURCE_REALTIME_USEC ? CLOCK_REALTIME : CLOCK_MONOTONIC_RAW,
+                   &resolution);
+      out << " timer resolution in nanoseconds [" << resolution.tv_nsec
+          << "], nanoseconds per cycle [" << nanosPerCycle_ << "]" << endl;
+    }
+
+    out << "Checkpoint overhead [Mean,Variance] = [" << overheadNanos_
+        << " NanoSec, " << overheadVariance_ << " NanoSec^2] calibrated with locking ["
+        << (useLocking_ ? "on" : "off") << "], subtracted from each segment ["
+        << (subtractOverhead_ ? "yes" : "no") << "]"
+        << endl;
+
+    if(trace_ != NULL)
+    {
+      out << "Trace file [" << trace_->getPath()
+          << "] Records [written, dropped on ring overflow] = [" << trace_->getNumRecords()
+          << ", " << trace_->getNumOverflows() << "]"
+          << endl;
+    }
+
+    if(reporter_ != NULL)
+    {
+      out << "Interval report file [" << reporter_->getPath()
+          << "] intervals reported [" << reporter_->getNumIntervals() << "]"
+          << endl;
+    }
+
+    if(cpuTopology_ != NULL)
+    {
+      out << "CPU attribution read with [" << cpuTopology_->getCpuSourceStr()
+          << "] NUMA nodes [" << cpuTopology_->getNumNodes() << "]"
+          << endl;
+    }
+
+    if(throughput_ != NULL)
+    {
+      out << "Throughput monitored in buckets of [" << throughput_->getBucketMillis()
+          << "] ms, window [" << throughput_->getNumBuckets() << "] buckets"
+          << endl;
+    }
+
+    if(sampler_ != NULL)
+    {
+      out << "Sampling ";
+      if(sampler_->isTimeBased())
+      {
+        out << "[1 segment per thread every " << sampler_->getSampleMicros() << " usec]";
+      }
+      else
+      {
+        out << "[1 in " << sampler_->getSampleEvery() << " segments]";
+      }
+      if(sampler_->getMaxOverheadPercent() > 0.0)
+      {
+        out << " scaled by [" << sampler_->getScale()
+            << "] estimated overhead [" << sampler_->getOverheadPercent()
+            << "%] of max [" << sampler_->getMaxOverheadPercent() << "%]";
+      }
+      out << ", the times are estimated from the sampled segments" << endl;
+    }
+
+    if(usePerfCounters_)
+    {
+      out << "Perf counters opened by [" << numThreadsCounted << "] threads";
+      if(numThreadsCounted > 0)
+      {
+        out << ", read with [" << (useRdpmc ? "rdpmc" : "read()") << "]";
+        for(uint32_t counter = 0; counter < PerfCounters::NUM_COUNTERS; ++counter)
+        {
+          if((perfAvailableMask_ & (1 << counter)) == 0)
+          {
+            out << ", " << PerfCounters::getCounterName(counter) << " not available";
+          }
+        }
+      }
+      out << endl;
+    }
+
+    if(stats_ != NULL)
+    {
+      out << "Shared-memory stats segment [" << stats_->getName()
+          << "] checkpoints per thread [" << stats_->getNumCheckpoints() << "]"
+          << endl;
+    }
+  }
+
+  // The per-thread checkpoints and segment stats are merged pairwise into
+  // these for the averages, see reduceCheckpoints(). numCpHits is sized to
+  // the highest checkpoint hit on any thread as the threads are dumped.
+  vector<vector<CheckpointInfo> > partialCps;
+  vector<uint32_t> partialThreads;
+  vector<vector<SegmentStats> > partialStats;
+  vector<uint32_t> partialStatsThreads;
+  vector<uint32_t> numCpHits;
+
+  // The per-thread histograms are merged into these for the averages
+  vector<LatencyHistogram> totalHistograms;
+
+  // The per-thread perf counts and CPU times are summed into these for the averages
+  vector<PerfCounterInfo> totalPerfCounts;
+  vector<uint64_t> totalCpuNanos;
+  vector<uint64_t> totalCpuWallCycles;
+
+  // The per-thread transitions are merged into this
+  map<uint64_t, TransitionInfo> totalTransitions;
+  map<uint64_t, CpuSegmentInfo> totalCpuSegments;
+
+  vector<string> names(getCheckpointNames());
+
+  // Print a summary of the Checkpoints for each Thread
+  for(size_t threadIndex = 0; threadIndex < threads.size(); ++threadIndex)
+  {
+    DumpedThread &thread(threads[threadIndex]);
+    bool isRetired(thread.slot_ == RETIRED_SLOT);
+    int maxCpIndex(thread.checkpoints_.size());
+
+    if(dumpAverages)
+    {
+      reduceCheckpoints(partialCps, partialThreads, &(thread.checkpoints_[0]), maxCpIndex);
+      if(!thread.segmentStats_.empty())
+      {
+        reduceCheckpoints(partialStats, partialStatsThreads, &(thread.segmentStats_[0]), maxCpIndex);
+      }
+    }
+    if(maxCpIndex > numCpHits.size())
+    {
+      numCpHits.resize(maxCpIndex, 0);
+      if(!thread.histograms_.empty() && dumpAverages)
+      {
+        totalHistograms.resize(maxCpIndex);
+      }
+      if(usePerfCounters_ && dumpAverages)
+      {
+        totalPerfCounts.resize(maxCpIndex);
+      }
+      if(useCpuTime_ && dumpAverages)
+      {
+        totalCpuNanos.resize(maxCpIndex, 0);
+        totalCpuWallCycles.resize(maxCpIndex, 0);
+      }
+    }
+
+    for(int checkPoint=0; checkPoint < maxCpIndex; ++checkPoint)
+    {
+      const CheckpointInfo *currentCp(&(thread.checkpoints_[checkPoint]));
+      uint64_t avgCycles(0);
+      string cpLabel(getCheckpointLabel(checkPoint, names));
+
+      // The numbered checkpoints are all dumped as before, but there may
+      // be many named checkpoints, so only the ones hit are dumped
+      if(currentCp->iterations_ == 0 && checkPoint >= FIRST_NAMED_CHECKPOINT)
+      {
+        continue;
+      }
+
+      if(currentCp->iterations_ != 0)
+      {
+        // Avoiding possible divide by zero
+        avgCycles = currentCp->totalCycles_/currentCp->iterations_;
+        numCpHits[checkPoint] += (isRetired ? thread.numHits_[checkPoint] : 1);
+        if(!totalHistograms.empty() && !thread.histograms_.empty())
+        {
+          totalHistograms[checkPoint].merge(thread.histograms_[checkPoint]);
+        }
+        if(!totalPerfCounts.empty() && thread.hasPerfCounts_)
+        {
+          for(uint32_t counter = 0; counter < PerfCounters::NUM_COUNTERS; ++counter)
+          {
+            totalPerfCounts[checkPoint].counts_[counter] += thread.perfCounts_[checkPoint].counts_[counter];
+          }
+        }
+        if(!totalCpuNanos.empty() && thread.hasCpuTime_)
+        {
+          totalCpuNanos[checkPoint] += thread.cpuNanos_[checkPoint];
+          totalCpuWallCycles[checkPoint] += currentCp->totalCycles_;
+        }
+      }
+
+      uint64_t totalCycles(currentCp->totalCycles_);
+      const char *unitPtr(getTimeResolutionStr(avgCycles, totalCycles));
+
+      if(verbose)
+      {
+        out << "Thread [" << getThreadLabel(thread.slot_)
+            << "] Checkpoint [" << cpLabel
+            << "] Iterations [" << currentCp->iterations_
+            << "] Time [Unit,Avg,Total] = [" << unitPtr
+            << ", " << avgCycles
+            << ", " << totalCycles << "]";
+        if(!thread.segmentStats_.empty() && thread.segmentStats_[checkPoint].getCount() != 0)
+        {
+          dumpSegmentStats(out, thread.segmentStats_[checkPoint]);
+        }
+        if(!thread.histograms_.empty() && currentCp->iterations_ != 0)
+        {
+          dumpLatency(out, thread.histograms_[checkPoint]);
+        }
+        if(thread.hasPerfCounts_ && currentCp->iterations_ != 0)
+        {
+          dumpPerfCounters(out, thread.perfCounts_[checkPoint], currentCp->iterations_);
+        }
+        if(thread.hasCpuTime_ && currentCp->iterations_ != 0)
+        {
+          dumpCpuTime(out, thread.cpuNanos_[checkPoint], currentCp->totalCycles_, currentCp->iterations_);
+        }
+        out << "\n";
+      }
+      else
+      {
+        // minimalCheckpoint format:
+        // Iters0=20, MicroSec0=300, Iters1=10, MilliSec1=400, Iters2=10, MilliSec2=800
+        // named checkpoints are in brackets: Iters[parse.begin]=10, MicroSec[parse.begin]=50
+        if(checkPoint != 0)
+        {
+          out << ", ";
+        }
+        if(checkPoint >= FIRST_NAMED_CHECKPOINT)
+        {
+          cpLabel = "[" + cpLabel + "]";
+        }
+        out << "Iters" << cpLabel << "=" << currentCp->iterations_
+            << ", " << unitPtr << cpLabel << "=" << totalCycles;
+      }
+    }
+
+    if(useTransitions_)
+    {
+      for(size_t i = 0; i < thread.transitions_.size(); ++i)
+      {
+        TransitionInfo &total(totalTransitions[thread.transitions_[i].key_]);
+        total.iterations_  += thread.transitions_[i].value_.iterations_;
+        total.totalCycles_ += thread.transitions_[i].value_.totalCycles_;
+      }
+      if(verbose && !thread.transitions_.empty())
+      {
+        ostringstream prefix;
+        prefix << "Thread [" << getThreadLabel(thread.slot_) << "] ";
+        dumpTransitions(out, prefix.str(), thread.transitions_, names);
+      }
+    }
+    if(cpuTopology_ != NULL)
+    {
+      for(size_t i = 0; i < thread.cpuSegments_.size(); ++i)
+      {
+        CpuSegmentInfo &total(totalCpuSegments.insert(make_pair(thread.cpuSegments_[i].key_, CpuSegmentInfo())).first->second);
+        addCpuSegment(total, thread.cpuSegments_[i].value_);
+      }
+      if(verbose && !thread.cpuSegments_.empty())
+      {
+        ostringstream prefix;
+        prefix << "Thread [" << getThreadLabel(thread.slot_) << "] ";
+        dumpCpuSegments(out, prefix.str(), thread.cpuSegments_, names);
+      }
+    }
+    out << endl;
+  }
+
+  // The edges of all the threads, the overflow slot has no transitions
+  if(!totalTransitions.empty())
+  {
+    vector<TransitionTable::Entry> transitions;
+    for(map<uint64_t, TransitionInfo>::const_iterator iter = totalTransitions.begin();
+        iter != totalTransitions.end();
+        ++iter)
+    {
+      TransitionTable::Entry entry = {iter->first, iter->second};
+      transitions.push_back(entry);
+    }
+    dumpTransitions(out, "All Threads: ", transitions, names);
+    out << endl;
+  }
+
+  // The CPUs and nodes of all the threads, the overflow slot has none
+  if(!totalCpuSegments.empty())
+  {
+    vector<CpuSegmentTable::Entry> cpuSegments;
+    for(map<uint64_t, CpuSegmentInfo>::const_iterator iter = totalCpuSegments.begin();
+        iter != totalCpuSegments.end();
+        ++iter)
+    {
+      CpuSegmentTable::Entry entry = {iter->first, iter->second};
+      cpuSegments.push_back(entry);
+    }
+    dumpCpuSegments(out, "All Threads: ", cpuSegments, names);
+    out << endl;
+  }
+
+  if(mergedTree != NULL)
+  {
+    vector<ScopeTree::ScopeNode> nodes;
+    mergedTree->copyNodes(nodes);
+    if(nodes.size() > 1)
+    {
+      out << "Scope Tree, all threads:\n";
+      dumpScopeTree(out, nodes, ScopeTree::ROOT_NODE, 0, names);
+      if(mergedTree->getNumDropped() > 0)
+      {
+        out << "NOTICE: [" << mergedTree->getNumDropped()
+            << "] scope calls were not recorded, increase Checkpoint::Config::scopeTreeNodes or scopeTreeDepth"
+            << "\n";
+      }
+      out << endl;
+    }
+    delete mergedTree;
+  }
+
+  // Now print the averages
+  vector<CheckpointInfo> *totalCps(finishReduction(partialCps));
+  vector<SegmentStats> *totalStats(finishReduction(partialStats));
+  if(dumpAverages && totalCps != NULL)
+  {
+    for(int i = 0; i < numCpHits.size(); ++i)
+    {
+      if(numCpHits[i] > 1)
+      {
+        // The iterations and total are those of the average thread, the
+        // time per iteration and the misses per iteration are over the
+        // iterations of all the threads, rounded only once
+        const CheckpointInfo &totalCp((*totalCps)[i]);
+        uint64_t totalIterations(totalCp.iterations_);
+        double numThreads(numCpHits[i]);
+        uint64_t iterations((uint64_t) (totalIterations / numThreads + 0.5));
+        uint64_t totalCycles((uint64_t) (totalCp.totalCycles_ / numThreads + 0.5));
+        uint64_t avgCycles((uint64_t) ((double) totalCp.totalCycles_ / totalIterations + 0.5));
+        const char *unitPtr(getTimeResolutionStr(avgCycles, totalCycles));
+
+        out << "Weighted Average: Checkpoint [" << getCheckpointLabel(i, names)
+             << "] Iterations [" << iterations
+             << "] Time [Unit,Avg,Total] = [" << unitPtr
+             << ", " << avgCycles
+             << ", " << totalCycles << "]";
+        if(totalStats != NULL && i < totalStats->size() && (*totalStats)[i].getCount() != 0)
+        {
+          dumpSegmentStats(out, (*totalStats)[i]);
+        }
+        if(!totalHistograms.empty())
+        {
+          dumpLatency(out, totalHistograms[i]);
+        }
+        if(!totalPerfCounts.empty() && perfAvailableMask_ != 0)
+        {
+          dumpPerfCounters(out, totalPerfCounts[i], totalIterations);
+        }
+        if(!totalCpuNanos.empty() && totalCpuWallCycles[i] != 0)
+        {
+          dumpCpuTime(out, totalCpuNanos[i], totalCpuWallCycles[i], totalIterations);
+        }
+        out << "\n";
+      }
+    }
+  }
+
+  // Now print the approximated Throughput, copied apart from the counters
+  if(dumpTput)
+  {
+    dumpThroughput(out);
+  }
+
+  // Now print the threadId map
+  if(dumpThreadIds)
+  {
+    out << "\nTreadIds [" << threadIds.size() << "]" << endl;
+    for(size_t i = 0; i < threadIds.size(); ++i)
+    {
+      out << "\t thread [" << i << "] => threadId [" << threadIds[i] << "]\n";
+    }
+    out << endl;
+  }
+}
+
+// The thread sections are in the order of dump(), the header
+// is completed once they are copied
+bool Checkpoint::snapshot(const string &path)
+{
+  SnapshotFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic_, SNAPSHOT_FILE_MAGIC, sizeof(header.magic_));
+  header.version_         = SNAPSHOT_FILE_VERSION;
+  header.headerSize_      = sizeof(SnapshotFileHeader);
+  header.checkpointSize_  = sizeof(SnapshotCheckpoint);
+  header.histogramSize_   = sizeof(LatencyHistogram);
+  header.numPerfCounters_ = PerfCounters::NUM_COUNTERS;
+  header.nanosPerCycle_   = nanosPerCycle_;
+  header.clockSource_     = clockSource_;
+  header.pid_             = getpid();
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  header.snapshotMicros_ = (now.tv_sec * (uint64_t)1000000) + (now.tv_nsec / 1000);
+
+  vector<char> buffer;
+  CheckpointSnapshot::append(buffer, &header, sizeof(header));
+
+  pthread_mutex_lock(&slotLock_);
+
+  header.snapshotCycles_ = getCycles();
+  header.perfAvailableMask_ = __atomic_load_n(&perfAvailableMask_, __ATOMIC_RELAXED);
+
+  vector<uint32_t> slots;
+  for(uint32_t slot = 0; slot < getNumThreadsUsed(); ++slot)
+  {
+    slots.push_back(slot);
+  }
+  if(numThreadsRetired_ > 0)
+  {
+    slots.push_back(RETIRED_SLOT);
+  }
+  ThreadCheckpointInfo snapshot;
+  vector<CheckpointInfo> snapshotCheckpoints;
+  for(size_t slotIndex = 0; slotIndex < slots.size(); ++slotIndex)
+  {
+    uint32_t slot(slots[slotIndex]);
+    getThreadCpInfoSnapshot(slot, snapshot, snapshotCheckpoints);
+
+    uint32_t numCheckpoints(0);
+    for(uint32_t chkPoint = 0; chkPoint < snapshot.numCheckpoints_; ++chkPoint)
+    {
+      if(snapshot.checkpoints_[chkPoint].iterations_ != 0)
+      {
+        numCheckpoints = chkPoint + 1;
+      }
+    }
+    if(numCheckpoints == 0)
+    {
+      continue;
+    }
+
+    bool isRetired(slot == RETIRED_SLOT);
+    SnapshotThread thread;
+    memset(&thread, 0, sizeof(thread));
+    thread.slot_ = (isRetired ? SNAPSHOT_RETIRED_SLOT : slot);
+    thread.numCheckpoints_ = numCheckpoints;
+    thread.numThreads_ = (isRetired ? numThreadsRetired_ : 1);
+    thread.threadId_ = (uint64_t) snapshot.threadId_;
+    thread.creationCycles_ = snapshot.creationCycles_;
+    if(snapshot.histograms_ != NULL)
+    {
+      thread.flags_ |= SNAPSHOT_HISTOGRAMS;
+    }
+    if(isRetired ? retiredPerfCounted_ : snapshot.perfCounters_ != NULL)
+    {
+      thread.flags_ |= SNAPSHOT_PERF_COUNTS;
+    }
+    if(isRetired ? snapshot.cpuNanos_ != NULL : snapshot.cpuClock_ != NULL)
+    {
+      thread.flags_ |= SNAPSHOT_CPU_NANOS;
+    }
+    CheckpointSnapshot::append(buffer, &thread, sizeof(thread));
+
+    for(uint32_t chkPoint = 0; chkPoint < numCheckpoints; ++chkPoint)
+    {
+      const CheckpointInfo &cpInfo(snapshot.checkpoints_[chkPoint]);
+      SnapshotCheckpoint checkpoint;
+      memset(&checkpoint, 0, sizeof(checkpoint));
+      checkpoint.iterations_     = cpInfo.iterations_;
+      checkpoint.totalCycles_    = cpInfo.totalCycles_;
+      checkpoint.previousCycles_ = cpInfo.previousCycles_;
+      if(snapshot.segmentStats_ != NULL)
+      {
+        const SegmentStats &stats(snapshot.segmentStats_[chkPoint]);
+        checkpoint.statsCount_   = stats.getCount();
+        checkpoint.statsMin_     = stats.getMin();
+        checkpoint.statsMax_     = stats.getMax();
+        checkpoint.statsMean_    = stats.getMean();
+        checkpoint.statsM2_      = stats.getM2();
+      }
+      if(cpInfo.iterations_ != 0)
+      {
+        checkpoint.numThreads_ = (isRetired ? retiredCpHits_[chkPoint] : 1);
+      }
+      CheckpointSnapshot::append(buffer, &checkpoint, sizeof(checkpoint));
+    }
+    if(thread.flags_ & SNAPSHOT_HISTOGRAMS)
+    {
+      CheckpointSnapshot::append(buffer, snapshot.histograms_, sizeof(LatencyHistogram) * numCheckpoints);
+    }
+    if(thread.flags_ & SNAPSHOT_PERF_COUNTS)
+    {
+      CheckpointSnapshot::append(buffer, snapshot.perfCounts_, sizeof(PerfCounterInfo) * numCheckpoints);
+    }
+    if(thread.flags_ & SNAPSHOT_CPU_NANOS)
+    {
+      CheckpointSnapshot::append(buffer, snapshot.cpuNanos_, sizeof(uint64_t) * numCheckpoints);
+    }
+    ++header.numThreads_;
+  }
+
+  pthread_mutex_unlock(&slotLock_);
+
+  // The names, the domain name first
+  vector<string> names(getCheckpointNames());
+  header.namesOffset_ = buffer.size();
+  uint32_t length(domainName_.size());
+  CheckpointSnapshot::append(buffer, &length, sizeof(length));
+  CheckpointSnapshot::append(buffer, domainName_.data(), length);
+  uint32_t numNames(names.size());
+  CheckpointSnapshot::append(buffer, &numNames, sizeof(numNames));
+  for(uint32_t i = 0; i < numNames; ++i)
+  {
+    uint32_t checkpoint(FIRST_NAMED_CHECKPOINT + i);
+    length = names[i].size();
+    CheckpointSnapshot::append(buffer, &checkpoint, sizeof(checkpoint));
+    CheckpointSnapshot::append(buffer, &length, sizeof(length));
+    CheckpointSnapshot::append(buffer, names[i].data(), length);
+  }
+
+  header.fileSize_ = buffer.size();
+  memcpy(&(buffer[0]), &header, sizeof(header));
+
+  string errorStr;
+  if(!CheckpointSnapshot::writeFile(path, buffer, errorStr))
+  {
+    cout << "NOTICE: could not write the snapshot [" << path << "]: " << errorStr << endl;
+    return false;
+  }
+
+  return true;
+}
+
+// Without the monitor, or before its first bucket, each thread's rate is
+// over its own lifetime, from its creation to its latest checkpoint, for
+// each checkpoint it hit. The total is the iterations of all the threads
+// over the time from the first creation to the last checkpoint, not the
+// sum of rates over different times. The retired threads are not
+// included, their times are gone.
+void Checkpoint::dumpThroughput(ostream &out)
+{
+  vector<string> names(getCheckpointNames());
+
+  vector<ThroughputInfo> throughput;
+  if(getThroughput(throughput) > 0)
+  {
+    out << "\nThroughput (iters/sec) [EWMA 1s, EWMA 10s, EWMA 60s, window]:\n";
+    for(size_t i = 0; i < throughput.size(); ++i)
+    {
+      const ThroughputInfo &info(throughput[i]);
+      out << "Thread [" << (info.slot_ == ThroughputMonitor::ALL_THREADS ? string("all") : getThreadLabel(info.slot_))
+          << "] Checkpoint [" << getCheckpointLabel(info.checkpoint_, names)
+          << "] Iterations [" << info.iterations_
+          << "] Throughput = [" << info.ewmaPerSec_[0]
+          << ", " << info.ewmaPerSec_[1]
+          << ", " << info.ewmaPerSec_[2]
+          << ", " << info.windowPerSec_
+          << "] over [" << info.windowSeconds_ << "] sec"
+          << endl;
+    }
+    return;
+  }
+
+  // Copied under slotLock_, and formatted once it is released
+  pthread_mutex_lock(&slotLock_);
+
+  uint32_t numThreadsUsed(getNumThreadsUsed());
+  vector<vector<CheckpointInfo> > threadCheckpoints(numThreadsUsed);
+  vector<uint64_t> creationCycles(numThreadsUsed, 0);
+  ThreadCheckpointInfo snapshot;
+  for(uint32_t thread = 0; thread < numThreadsUsed; ++thread)
+  {
+    getThreadCpInfoSnapshot(thread, snapshot, threadCheckpoints[thread]);
+    creationCycles[thread] = snapshot.creationCycles_;
+  }
+
+  pthread_mutex_unlock(&slotLock_);
+
+  out << "\nThroughput (iters/sec) of each thread since its creation:\n";
+
+  vector<uint64_t> totalIterations;
+  uint64_t firstCycles(0);
+  uint64_t lastCycles(0);
+  for(uint32_t thread = 0; thread < numThreadsUsed; ++thread)
+  {
+    const vector<CheckpointInfo> &checkpoints(threadCheckpoints[thread]);
+    uint32_t numCheckpoints(checkpoints.size());
+    uint64_t endCycles(creationCycles[thread]);
+    for(uint32_t chkPoint = 0; chkPoint < numCheckpoints; ++chkPoint)
+    {
+      if(checkpoints[chkPoint].iterations_ != 0 &&
+         checkpoints[chkPoint].previousCycles_ > endCycles)
+      {
+        endCycles = checkpoints[chkPoint].previousCycles_;
+      }
+    }
+    uint64_t elapsedNanos(cyclesToNanos(endCycles - creationCycles[thread]));
+    if(elapsedNanos == 0)
+    {
+      continue;
+    }
+    double elapsedSeconds(elapsedNanos / 1000000000.0);
+    if(numCheckpoints > totalIterations.size())
+    {
+      totalIterations.resize(numCheckpoints, 0);
+    }
+    if(firstCycles == 0 || creationCycles[thread] < firstCycles)
+    {
+      firstCycles = creationCycles[thread];
+    }
+    if(endCycles > lastCycles)
+    {
+      lastCycles = endCycles;
+    }
+
+    for(uint32_t chkPoint = 0; chkPoint < numCheckpoints; ++chkPoint)
+    {
+      uint64_t iterations(checkpoints[chkPoint].iterations_);
+      if(iterations == 0)
+      {
+        continue;
+      }
+      double throughput(iterations / elapsedSeconds);
+      totalIterations[chkPoint] += iterations;
+
+      out << "Thread [" << getThreadLabel(thread)
+          << "] Checkpoint [" << getCheckpointLabel(chkPoint, names)
+          << "] Iterations [" << iterations
+          << "] over [" << elapsedSeconds
+          << "] sec, Throughput = " << throughput
+          << endl;
+    }
+  }
+
+  // A thread is only counted if it took time, so the span isn't 0
+  double totalSeconds(cyclesToNanos(lastCycles - firstCycles) / 1000000000.0);
+  for(uint32_t chkPoint = 0; chkPoint < totalIterations.size(); ++chkPoint)
+  {
+    if(totalIterations[chkPoint] != 0)
+    {
+      out << "Total Checkpoint [" << getCheckpointLabel(chkPoint, names)
+          << "] Iterations [" << totalIterations[chkPoint]
+          << "] over [" << totalSeconds
+          << "] sec, Throughput = " << totalIterations[chkPoint] / totalSeconds
+          << endl;
+    }
+  }
+}
+
+uint64_t Checkpoint::getThroughput(vector<ThroughputInfo> &throughput)
+{
+  if(throughput_ == NULL)
+  {
+    throughput.clear();
+    return 0;
+  }
+
+  return throughput_->getThroughput(throughput);
+}
+
+// private
+// The handler is installed once per signal, under the registry lock, and
+// stays installed after the domains using it are deleted. The default
+// action of SIGUSR1 would otherwise terminate the process.
+void Checkpoint::installSignalDump()
+{
+  CheckpointRegistry &registry(getCheckpointRegistry());
+  pthread_mutex_lock(&registry.lock_);
+
+  bool installed(false);
+  if(dumpSignal_ > 0 && dumpSignal_ < 64)
+  {
+    installed = ((registry.dumpSignals_ & (1ULL << dumpSignal_)) != 0);
+    if(!installed)
+    {
+      struct sigaction action;
+      memset(&action, 0, sizeof(action));
+      action.sa_handler = signalDumpHandler;
+      sigemptyset(&action.sa_mask);
+      action.sa_flags = SA_RESTART;
+      installed = (sigaction(dumpSignal_, &action, NULL) == 0);
+    }
+  }
+  if(installed)
+  {
+    registry.dumpSignals_ |= (1ULL << dumpSignal_);
+    __atomic_store_n(&(signalDomains_[domainIndex_]), this, __ATOMIC_SEQ_CST);
+  }
+
+  pthread_mutex_unlock(&registry.lock_);
+
+  if(!installed)
+  {
+    cout << "NOTICE: the dump handler could not be installed for signal ["
+         << dumpSignal_ << "], the counters will not be dumped on it"
+         << endl;
+    dumpSignal_ = 0;
+  }
+}
+
+// static private
+// The same signal is blocked while its handler runs, but another thread
+// may get it meanwhile, in which case its dump is skipped. The destructor
+// of a domain waits for signalDumpBusy_ to clear after removing it.
+void Checkpoint::signalDumpHandler(int signal)
+{
+  int savedErrno(errno);
+
+  if(!__atomic_test_and_set(&signalDumpBusy_, __ATOMIC_SEQ_CST))
+  {
+    for(int domainIndex = 0; domainIndex < MAX_DOMAINS; ++domainIndex)
+    {
+      Checkpoint *domain(__atomic_load_n(&(signalDomains_[domainIndex]), __ATOMIC_SEQ_CST));
+      if(domain != NULL && domain->dumpSignal_ == signal)
+      {
+        domain->signalDump(signal);
+      }
+    }
+    __atomic_clear(&signalDumpBusy_, __ATOMIC_SEQ_CST);
+  }
+
+  errno = savedErrno;
+}
+
+// private
+// Called from the signal handler, so only async-signal-safe calls are made:
+// no locks, no memory allocation and no iostreams. The slots are copied into
+// the preallocated scratch with their sequence locks, so each thread is
+// consistent, and slotLock_ is not taken, so a thread registering or exiting
+// during the dump may be missed, or counted both in its slot and retired.
+// The checkpoints are dumped by id, since the names are behind a lock.
+void Checkpoint::signalDump(int signal)
+{
+  SignalDumpScratch *scratch(__atomic_load_n(&signalScratch_, __ATOMIC_ACQUIRE));
+  if(scratch == NULL)
+  {
+    return;
+  }
+
+  int fd(dumpSignalFd_);
+  if(!dumpSignalPath_.empty())
+  {
+    fd = open(dumpSignalPath_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if(fd < 0)
+    {
+      return;
+    }
+  }
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  uint64_t nowMicros((now.tv_sec * (uint64_t)1000000) + (now.tv_nsec / 1000));
+
+  SignalDumpWriter out(fd, signalDumpBuffer_, SIGNAL_DUMP_BUFFER_SIZE);
+  out << "Signal dump [" << signal << "]";
+  if(!domainName_.empty())
+  {
+    out << " Domain [" << domainName_ << "]";
+  }
+  out << " Pid [" << (int) getpid()
+      << "] Clock source [" << getClockSourceStr(clockSource_)
+      << "] Taken at [" << nowMicros << "] usec\n";
+
+  for(uint32_t chkPoint = 0; chkPoint < scratch->numCheckpoints_; ++chkPoint)
+  {
+    scratch->totals_[chkPoint].iterations_ = 0;
+    scratch->totals_[chkPoint].totalCycles_ = 0;
+    scratch->totalThreads_[chkPoint] = 0;
+  }
+
+  uint32_t numSlots(getNumThreadsUsed());
+  bool hasRetired(__atomic_load_n(&numThreadsRetired_, __ATOMIC_RELAXED) != 0);
+  for(uint32_t slotIndex = 0; slotIndex <= numSlots; ++slotIndex)
+  {
+    uint32_t slot(slotIndex < numSlots ? slotIndex : RETIRED_SLOT);
+    if(slot == RETIRED_SLOT && !hasRetired)
+    {
+      break;
+    }
+
+    uint32_t numCheckpoints(copySignalDumpSlot(slot, scratch));
+    for(uint32_t chkPoint = 0; chkPoint < numCheckpoints; ++chkPoint)
+    {
+      const CheckpointInfo &currentCp(scratch->checkpoints_[chkPoint]);
+      if(currentCp.iterations_ == 0)
+      {
+        continue;
+      }
+      scratch->totals_[chkPoint].iterations_ += currentCp.iterations_;
+      scratch->totals_[chkPoint].totalCycles_ += currentCp.totalCycles_;
+      scratch->totalThreads_[chkPoint] += (slot == RETIRED_SLOT ?
+                                           __atomic_load_n(&(scratch->retiredHits_[chkPoint]), __ATOMIC_RELAXED) :
+                                           1);
+
+      uint64_t avgCycles(currentCp.totalCycles_ / currentCp.iterations_);
+      uint64_t totalCycles(currentCp.totalCycles_);
+      const char *unitPtr(getTimeResolutionStr(avgCycles, totalCycles));
+      out << "Thread [";
+      if(slot == RETIRED_SLOT)
+      {
+        out << "retired";
+      }
+      else
+      {
+        out << slot;
+      }
+      out << "] Checkpoint [" << chkPoint
+          << "] Iterations [" << currentCp.iterations_
+          << "] Time [Unit,Avg,Total] = [" << unitPtr
+          << ", " << avgCycles
+          << ", " << totalCycles << "]\n";
+    }
+  }
+
+  // Like dump(), the iterations and total of the average thread
+  for(uint32_t chkPoint = 0; chkPoint < scratch->numCheckpoints_; ++chkPoint)
+  {
+    const CheckpointInfo &totalCp(scratch->totals_[chkPoint]);
+    uint32_t numThreads(scratch->totalThreads_[chkPoint]);
+    if(numThreads > 1)
+    {
+      uint64_t iterations((uint64_t) ((double) totalCp.iterations_ / numThreads + 0.5));
+      uint64_t totalCycles((uint64_t) ((double) totalCp.totalCycles_ / numThreads + 0.5));
+      uint64_t avgCycles((uint64_t) ((double) totalCp.totalCycles_ / totalCp.iterations_ + 0.5));
+      const char *unitPtr(getTimeResolutionStr(avgCycles, totalCycles));
+      out << "Weighted Average: Checkpoint [" << chkPoint
+          << "] Threads [" << numThreads
+          << "] Iterations [" << iterations
+          << "] Time [Unit,Avg,Total] = [" << unitPtr
+          << ", " << avgCycles
+          << ", " << totalCycles << "]\n";
+    }
+  }
+  out << "End of signal dump [" << signal << "]\n";
+  out.flush();
+
+  if(fd != dumpSignalFd_)
+  {
+    close(fd);
+  }
+}
+
+// private
+// The retries are bounded like in getThreadCpInfoSnapshot(), and not done
+// at all on the slot of the interrupted thread, whose update can't finish
+// before the handler returns.
+uint32_t Checkpoint::copySignalDumpSlot(uint32_t slot, SignalDumpScratch *scratch)
+{
+  ThreadCheckpointInfo *threadCp(getThreadSlot(slot));
+  ThreadLocalSlot &tlsSlot(domainIndex_ == 0 ? tlsSlot_ : tlsDomainSlots_[domainIndex_]);
+  bool isInterrupted(tlsSlot.instanceId_ == instanceId_ && tlsSlot.threadCpInfo_ == threadCp);
+
+  const int MAX_RETRIES(1000);
+  uint32_t sequenceBefore, sequenceAfter;
+  uint32_t numCheckpoints;
+  int retries(0);
+  do
+  {
+    sequenceBefore = __atomic_load_n(&threadCp->sequence_, __ATOMIC_ACQUIRE);
+
+    // See growCheckpoints() for the order of these
+    numCheckpoints = __atomic_load_n(&threadCp->numCheckpoints_, __ATOMIC_ACQUIRE);
+    CheckpointInfo *checkpoints(__atomic_load_n(&threadCp->checkpoints_, __ATOMIC_ACQUIRE));
+    if(checkpoints == NULL)
+    {
+      // The slot is being initialized
+      numCheckpoints = 0;
+    }
+    if(numCheckpoints > scratch->numCheckpoints_)
+    {
+      numCheckpoints = scratch->numCheckpoints_;
+    }
+    memcpy(scratch->checkpoints_, checkpoints, sizeof(CheckpointInfo) * numCheckpoints);
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    sequenceAfter = __atomic_load_n(&threadCp->sequence_, __ATOMIC_RELAXED);
+  } while(useLocking_ && !isInterrupted &&
+          ((sequenceBefore & 1) || sequenceBefore != sequenceAfter) &&
+          ++retries < MAX_RETRIES);
+
+  return numCheckpoints;
+}
+
+// private
+// The arrays are allocated together. The old scratch is kept until
+// destruction, like the grown arrays, since a signal dump may be using it.
+void Checkpoint::reserveSignalScratch(uint32_t numCheckpoints)
+{
+  if(signalScratch_ != NULL && signalScratch_->numCheckpoints_ >= numCheckpoints)
+  {
+    return;
+  }
+
+  size_t headerSize(((sizeof(SignalDumpScratch) + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE) * CACHE_LINE_SIZE);
+  char *memory((char*) allocateAligned(headerSize +
+                                       sizeof(CheckpointInfo) * numCheckpoints * 2 +
+                                       sizeof(uint32_t) * numCheckpoints * 2));
+  SignalDumpScratch *scratch((SignalDumpScratch*) memory);
+  scratch->numCheckpoints_ = numCheckpoints;
+  scratch->checkpoints_ = (CheckpointInfo*) (memory + headerSize);
+  scratch->totals_ = scratch->checkpoints_ + numCheckpoints;
+  scratch->totalThreads_ = (uint32_t*) (scratch->totals_ + numCheckpoints);
+  scratch->retiredHits_ = scratch->totalThreads_ + numCheckpoints;
+  for(uint32_t chkPoint = 0; chkPoint < numCheckpoints; ++chkPoint)
+  {
+    new (&(scratch->checkpoints_[chkPoint])) CheckpointInfo();
+    new (&(scratch->totals_[chkPoint])) CheckpointInfo();
+    scratch->totalThreads_[chkPoint] = 0;
+    scratch->retiredHits_[chkPoint] = 0;
+  }
+  if(signalScratch_ != NULL)
+  {
+    for(uint32_t chkPoint = 0; chkPoint < signalScratch_->numCheckpoints_; ++chkPoint)
+    {
+      scratch->retiredHits_[chkPoint] = signalScratch_->retiredHits_[chkPoint];
+    }
+  }
+
+  if(signalScratch_ != NULL)
+  {
+    retiredArrays_.push_back(signalScratch_);
+  }
+  __atomic_store_n(&signalScratch_, scratch, __ATOMIC_RELEASE);
 }
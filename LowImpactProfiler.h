@@ -1,164 +1,1018 @@
-#ifndef LOW_IMPACT_PROFILER_H
-#define LOW_IMPACT_PROFILER_H
-
-#include <map>
-#include <string>
-#include <vector>
-#include <ostream>
-
-#include <stdint.h> // uint32_t et al
-
-#define CHECKPOINT(cpNum) Checkpoint::instance()->checkpoint(cpNum)
-#define __unlikely(condition) __builtin_expect(!!(condition), 0)
-#define __likely(condition)   __builtin_expect(!!(condition), 1)
-
-using namespace std;
-
-class Checkpoint
-{
-  public:
-    static const int MAX_CHECKPOINT=10;
-    static const int DEFAULT_MAX_THREADS=32;
-    static const string SECOND_STR;
-    static const string MICRO_SEC_STR;
-    static const string MILLI_SEC_STR;
-    static const string NANO_SEC_STR;
-
-    // Allow Checkpoints to not start gathering until ordered to do so
-    inline void setActive(bool active) { isActive_ = active; }
-
-    void setNumThreads(int numThreads);
-
-    // The Checkpoint object is a singleton, this method obtains the instance
-    static Checkpoint* instance();
-
-    // destroys the singleton instance
-    static void destroy();
-
-    // Both instance() and initialize() will initialize the checkpoints
-    // but Init provides more flexibility
-    // - locking is only necessary if dump() will be called while checkpoints are being taken
-    //   If dump() will only be called at the end, then set false for increased performance
-    // - If multithreading will not be used, set numThreads to 0
-    static void initialize(uint32_t numThreads = DEFAULT_MAX_THREADS, bool useLocking = true);
-
-    // Gather checkpoint info for the specified checkpoint
-    void checkpoint(int checkpoint);
-
-    // Dump the checkpoint info gathered to cout
-    inline void dump(bool verbose = true,
-                     bool dumpAverages = false,
-                     bool dumpThroughput = false,
-                     bool dumpThreadIds = false) {
-      dump(cout, verbose, dumpAverages, dumpThroughput, dumpThreadIds);
-    }
-    // Dump the checkpoint info gathered to the ostream provided
-    void dump(ostream &out,
-              bool verbose = true,
-              bool dumpAverages = false,
-              bool dumpThroughput = false,
-              bool dumpThreadIds = false);
-    void dumpThroughput(ostream &out);
-
-    ~Checkpoint();
-
-  protected:
-    Checkpoint(uint32_t numThreads);
-
-  private:
-    typedef struct CheckpointInfo_s {
-      uint64_t iterations_;
-      uint64_t totalCycles_;
-      uint64_t previousCycles_;
-      CheckpointInfo_s() : iterations_(0), totalCycles_(0), previousCycles_(getCycles()) {}
-      CheckpointInfo_s *operator+=(CheckpointInfo_s *cpRhs) {
-        if(this == cpRhs) {return this;}
-        this->iterations_        +=  cpRhs->iterations_;
-        this->totalCycles_       +=  cpRhs->totalCycles_;
-        this->previousCycles_    +=  cpRhs->previousCycles_;
-        return this;
-      }
-    } CheckpointInfo;
-
-    typedef struct ThreadCheckpointInfo_s {
-      CheckpointInfo checkpoints_[MAX_CHECKPOINT];
-      uint64_t creationCycles_;
-      uint32_t lastCheckpointHit_;
-      ThreadCheckpointInfo_s() : creationCycles_(getCycles()), lastCheckpointHit_(0) {}
-    } ThreadCheckpointInfo;
-
-    // internally gets the threadId and returns the corresponding ThreadCheckpointInfo
-    // uses a rw lock for internal attribute protection
-    ThreadCheckpointInfo *getThreadCpInfo();
-
-    // Returns micro-seconds since the epoch
-    static inline uint64_t getCycles() {
-      struct timespec now;
-      // CLOCK_THREAD_CPUTIME_ID appears to only count the time a thread is
-      // actively working and not when its waiting or sleeping
-      //clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
-      clock_gettime(CLOCK_REALTIME, &now);
-      return ((now.tv_sec * (uint64_t)1000000) + now.tv_nsec/(uint64_t)1000);
-    }
-
-    // returns one of SECOND_STR, MICRO_SEC_STR, or MILLI_SEC_STR
-    static const char *getTimeResolutionStr(uint64_t &avgCycles, uint64_t &totalCycles);
-
-    static Checkpoint* instance_;
-    static bool useLocking_;
-
-    // Map threadId to ThreadCheckpointInfo
-    typedef map<pthread_t, ThreadCheckpointInfo> ThreadCpInfoMapType;
-    ThreadCpInfoMapType threadCpInfoMap_;
-    pthread_rwlockattr_t rwlockAttr_;
-    pthread_rwlock_t threadCpInfoMapRwLock_;
-
-    typedef vector<pthread_t> ThreadIdVectorType;
-    ThreadIdVectorType threadIdVector_;
-
-    pthread_mutex_t checkpointLock_;
-    uint32_t threadIdCounter_;
-    int numThreads_;
-    bool isActive_;
-
-};
-
-//
-// ScopedCheckpoint
-//
-// To be used in functions or scopes, where you want a checkpoint at scope entry
-// and via the ScopedCheckpoint destruction, another checkpoint at scope exit
-// A ScopedCheckpoint object should be instantiated at scope entry with a checkpointNumber.
-// Upon ScopedCheckpoint instantiation, a checkpoint will be taken using checkpointNumber.
-// Then on scope exit, the object will be destroyed, and a checkpoint will be taken using
-// either checkpointNumber+1 or if the 2 arg ctor was used, then lastCheckpoint
-
-class ScopedCheckpoint
-{
-public:
-  ScopedCheckpoint(int checkpoint) :
-      startCheckpointNumber_(checkpoint),
-      lastCheckpointNumber_(checkpoint+1)
-  {
-    Checkpoint::instance()->checkpoint(startCheckpointNumber_);
-  }
-
-  ScopedCheckpoint(int startCheckpoint, int lastCheckpoint) :
-      startCheckpointNumber_(startCheckpoint),
-      lastCheckpointNumber_(lastCheckpoint)
-  {
-    Checkpoint::instance()->checkpoint(startCheckpointNumber_);
-  }
-
-  ~ScopedCheckpoint()
-  {
-    Checkpoint::instance()->checkpoint(lastCheckpointNumber_);
-  }
-
-private:
-  ScopedCheckpoint();
-  int startCheckpointNumber_;
-  int lastCheckpointNumber_;
-};
-
-#endif // LOW_IMPACT_PROFILER_H
+#ifndef LOW_IMPACT_PROFILER_H
+#define LOW_IMPACT_PROFILER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include <stdint.h> // uint32_t et al
+#include <pthread.h>
+#include <string.h> // memset()
+#include <time.h>   // clock_gettime() et al
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // __rdtsc(), __rdtscp()
+#define LIP_HAVE_TSC 1
+#endif
+
+#include "LatencyHistogram.h"
+#include "SegmentStats.h"
+#include "CompactHashTable.h"
+#include "ScopeTree.h"
+#include "CheckpointTrace.h"
+#include "StatsSegment.h"
+#include "IntervalReporter.h"
+#include "ThroughputMonitor.h"
+#include "CheckpointSampler.h"
+#include "PerfCounters.h"
+#include "ThreadCpuClock.h"
+#include "CpuTopology.h"
+#include "SignalDumpWriter.h"
+
+// Defining LIP_DISABLE compiles the checkpoint macros and ScopedCheckpoint
+// to nothing, their arguments are not evaluated. The profiler can still be
+// initialized and dumped, but no checkpoint is taken.
+#ifndef LIP_DISABLE
+
+#define CHECKPOINT(cpNum) Checkpoint::instance()->checkpoint(cpNum)
+
+// Named checkpoints, the name is resolved to an id the first time the
+// checkpoint is hit, and the id is kept in a function-local static
+#define CHECKPOINT_NAMED(cpName) \
+  do { \
+    static const int lipNamedCheckpointId_(Checkpoint::registerCheckpoint(cpName)); \
+    Checkpoint::instance()->checkpoint(lipNamedCheckpointId_); \
+  } while(0)
+
+// Declares a variable holding the id of a named checkpoint, resolved at
+// static-init time when used at namespace scope. Use it with CHECKPOINT(var),
+// which avoids the function-local static guard of CHECKPOINT_NAMED().
+#define CHECKPOINT_DECLARE(var, cpName) \
+  static const int var(Checkpoint::registerCheckpoint(cpName))
+
+// Same as CHECKPOINT() and CHECKPOINT_NAMED(), in a domain created with
+// Checkpoint::createDomain() instead of the global instance
+#define CHECKPOINT_DOMAIN(domain, cpNum) (domain)->checkpoint(cpNum)
+#define CHECKPOINT_NAMED_DOMAIN(domain, cpName) \
+  do { \
+    static const int lipNamedCheckpointId_(Checkpoint::registerCheckpoint(cpName)); \
+    (domain)->checkpoint(lipNamedCheckpointId_); \
+  } while(0)
+
+#else
+
+#define CHECKPOINT(cpNum) do { (void) sizeof(cpNum); } while(0)
+#define CHECKPOINT_NAMED(cpName) do { (void) sizeof(cpName); } while(0)
+#define CHECKPOINT_DECLARE(var, cpName) static const int var __attribute__((unused)) = 0
+#define CHECKPOINT_DOMAIN(domain, cpNum) do { (void) sizeof(domain); (void) sizeof(cpNum); } while(0)
+#define CHECKPOINT_NAMED_DOMAIN(domain, cpName) do { (void) sizeof(domain); (void) sizeof(cpName); } while(0)
+
+#endif // LIP_DISABLE
+
+// Checkpoint categories are bits, for example a category per subsystem.
+// The checkpoints of the categories not in LIP_CATEGORY_MASK compile to
+// nothing, category must be a compile-time constant.
+#ifndef LIP_CATEGORY_MASK
+#define LIP_CATEGORY_MASK 0xffffffffU
+#endif
+
+template<bool enabled>
+struct CheckpointCategoryEnabled
+{
+  static const bool VALUE = enabled;
+};
+
+#define CHECKPOINT_CATEGORY(category, cpNum) \
+  do { \
+    if(CheckpointCategoryEnabled<(((category) & (LIP_CATEGORY_MASK)) != 0)>::VALUE) { \
+      CHECKPOINT(cpNum); \
+    } \
+  } while(0)
+#define CHECKPOINT_DOMAIN_CATEGORY(domain, category, cpNum) \
+  do { \
+    if(CheckpointCategoryEnabled<(((category) & (LIP_CATEGORY_MASK)) != 0)>::VALUE) { \
+      CHECKPOINT_DOMAIN(domain, cpNum); \
+    } \
+  } while(0)
+
+#define __unlikely(condition) __builtin_expect(!!(condition), 0)
+#define __likely(condition)   __builtin_expect(!!(condition), 1)
+
+using namespace std;
+
+// The checkpoint fast path with compile-time policies, see "CheckpointPolicy.h"
+template<typename ThreadingPolicy,
+         typename ClockPolicy,
+         typename LockingPolicy,
+         typename FeaturePolicy,
+         uint32_t categoryMask>
+class BasicCheckpoint;
+
+class Checkpoint
+{
+  public:
+    // Numbered checkpoints are expected to be below MAX_CHECKPOINT,
+    // named checkpoints are given ids starting at FIRST_NAMED_CHECKPOINT
+    static const int MAX_CHECKPOINT=10;
+    static const int FIRST_NAMED_CHECKPOINT=MAX_CHECKPOINT;
+    // Checkpoint ids at or above this are ignored, to catch garbage ids
+    static const int MAX_CHECKPOINT_ID=(1 << 20);
+    static const int DEFAULT_MAX_THREADS=32;
+    // Domains that can exist at once, including the global instance
+    static const int MAX_DOMAINS=16;
+    static const int CACHE_LINE_SIZE=64;
+    static const string SECOND_STR;
+    static const string MICRO_SEC_STR;
+    static const string MILLI_SEC_STR;
+    static const string NANO_SEC_STR;
+
+    // The clock used to time the checkpoints
+    typedef enum {
+      // CLOCK_REALTIME truncated to micro-seconds, the original clock.
+      // It can jump when NTP adjusts the time.
+      CLOCK_SOURCE_REALTIME_USEC = 0,
+      // CLOCK_MONOTONIC_RAW in nano-seconds, not subject to NTP adjustments
+      CLOCK_SOURCE_MONOTONIC_RAW,
+      // The CPU time stamp counter read with rdtsc, calibrated against
+      // CLOCK_MONOTONIC when the profiler is initialized. Requires an
+      // invariant TSC, otherwise CLOCK_SOURCE_MONOTONIC_RAW is used instead.
+      CLOCK_SOURCE_TSC,
+      // Same as CLOCK_SOURCE_TSC, but with rdtscp, which waits for the
+      // previous instructions to execute before reading the counter
+      CLOCK_SOURCE_TSCP
+    } ClockSource;
+
+    // Profiler settings, used with initialize(const Config &)
+    typedef struct Config_s {
+      uint32_t numThreads;
+      // The thread table starts with numThreads slots, and grows in chunks up
+      // to maxThreadSlots as more threads checkpoint at once. The slot of a
+      // thread that exits is reused, and its counters are added to the retired
+      // threads of dump(), so the memory used only depends on the number of
+      // threads running at once. The table can't grow in the shared-memory
+      // segment. The threads beyond the slots share one.
+      uint32_t maxThreadSlots;
+      bool useLocking;
+      ClockSource clockSource;
+      // The cost of a checkpoint, as seen in the segment it ends, is measured
+      // when initializing for the clock source and locking mode. If set, it
+      // is subtracted from every segment time, down to 0, which makes the
+      // sub-micro-second segments meaningful. The trace timestamps and the
+      // scope tree are not corrected.
+      bool subtractOverhead;
+      // Keep a LatencyHistogram per checkpoint per thread, which
+      // adds min, max, stddev and the percentiles below to dump()
+      bool useHistograms;
+      // Keep the exact min, max, mean and stddev of each checkpoint's segment
+      // times, see "SegmentStats.h". The mean and variance cost a division per
+      // checkpoint, which is why they are not kept by default. Like the
+      // histograms, they are an array per thread beside the checkpoints.
+      bool useSegmentStats;
+      // Each thread opens a perf_event group when it registers, and the
+      // deltas of its hardware counters are kept per checkpoint, which adds
+      // the IPC and the cache and branch misses per iteration to dump(), see
+      // "PerfCounters.h". Threads that can't open the group, and the threads
+      // sharing a slot (numThreads 0, or beyond maxThreadSlots), have no counters.
+      bool usePerfCounters;
+      // Also keep the on-CPU time of each checkpoint's segments, read with
+      // the wall clock, so dump() can show the time spent off-CPU: blocked
+      // on I/O or locks, or waiting for a CPU. See "ThreadCpuClock.h" for its
+      // cost. Like the perf counters, the shared slots have no CPU time.
+      bool useCpuTime;
+      // Also read the CPU each segment ends on, see "CpuTopology.h", so
+      // dump() can break the segment times down per CPU and NUMA node, and
+      // count the segments in which the thread moved to another CPU or node.
+      // Like the CPU time, the shared slots have no CPU attribution.
+      bool useCpuAttribution;
+      // Percentiles to dump, in the range [0, 100]
+      vector<double> percentiles;
+      // Also accumulate the time and count per (previous, current) checkpoint
+      // edge, so the paths reaching a checkpoint can be told apart in dump()
+      bool useTransitions;
+      // Build a per-thread call tree from the nested ScopedCheckpoints, with
+      // inclusive and exclusive times, see "ScopeTree.h". The tree has at
+      // most scopeTreeNodes nodes and scopeTreeDepth nested scopes per thread.
+      bool useScopeTree;
+      uint32_t scopeTreeNodes;
+      uint32_t scopeTreeDepth;
+      // If set, every checkpoint is also appended to a per-thread ring
+      // that is streamed into this trace file, see "CheckpointTrace.h"
+      string tracePath;
+      // Records per thread ring, rounded up to a power of 2
+      uint32_t traceRingSize;
+      // How long the drainer sleeps when the rings are empty
+      uint32_t traceDrainMicros;
+      // If set, the per-thread counters are placed in a POSIX shared-memory
+      // object with this name (for example "/lip.myapp") that can be viewed
+      // live with lip-top, see "StatsSegment.h"
+      string shmName;
+      // Checkpoint ids per thread in the shared-memory segment, which can not
+      // grow. Ids at or above this are ignored. Raised to the number of
+      // checkpoints already registered.
+      uint32_t shmMaxCheckpoints;
+      // If set, a reporter thread appends the per-checkpoint deltas of each
+      // interval to this CSV file, see "IntervalReporter.h"
+      string intervalPath;
+      uint32_t intervalMillis;
+      // If not 0, a monitor thread keeps the current throughput of each
+      // checkpoint, per thread and for all the threads, every
+      // throughputBucketMillis: EWMAs over 1, 10 and 60 seconds, and a
+      // sliding window of throughputBuckets buckets, see "ThroughputMonitor.h"
+      uint32_t throughputBucketMillis;
+      uint32_t throughputBuckets;
+      // Sampling, to bound the overhead on very hot checkpoints, see
+      // "CheckpointSampler.h". Every checkpoint hit is counted, but only
+      // the sampled segments read the clock, and their time is scaled by the
+      // number of segments they stand for, so the times are estimates.
+      // - sampleEvery: time 1 in sampleEvery segments on average, 1 to time all
+      // - sampleMicros: if not 0, time 1 segment per thread every sampleMicros instead
+      // - sampleMaxOverheadPercent: if not 0, the sampling interval is raised
+      //   when the estimated profiler overhead goes above this percentage
+      // Sampling is not used with tracing or the scope tree, which need every timestamp.
+      uint32_t sampleEvery;
+      uint32_t sampleMicros;
+      double sampleMaxOverheadPercent;
+      // If not 0, this signal, for example SIGUSR1, dumps the iterations and
+      // times of every thread from the signal handler, without locks, memory
+      // allocation or iostreams, so a running process can be looked at without
+      // calling dump(). The dump is appended to dumpSignalPath, or written to
+      // dumpSignalFd if no path is set.
+      int dumpSignal;
+      string dumpSignalPath;
+      int dumpSignalFd;
+      Config_s() :
+        numThreads(DEFAULT_MAX_THREADS),
+        maxThreadSlots(64 * 1024),
+        useLocking(true),
+        clockSource(CLOCK_SOURCE_REALTIME_USEC),
+        subtractOverhead(false),
+        useHistograms(false),
+        useSegmentStats(false),
+        usePerfCounters(false),
+        useCpuTime(false),
+        useCpuAttribution(false),
+        useTransitions(false),
+        useScopeTree(false),
+        scopeTreeNodes(4096),
+        scopeTreeDepth(64),
+        traceRingSize(64 * 1024),
+        traceDrainMicros(1000),
+        shmMaxCheckpoints(64),
+        intervalMillis(1000),
+        throughputBucketMillis(0),
+        throughputBuckets(60),
+        sampleEvery(1),
+        sampleMicros(0),
+        sampleMaxOverheadPercent(0.0),
+        dumpSignal(0),
+        dumpSignalFd(2)
+      {
+        percentiles.push_back(50.0);
+        percentiles.push_back(99.0);
+        percentiles.push_back(99.9);
+      }
+    } Config;
+
+    // Allow Checkpoints to not start gathering until ordered to do so
+    inline void setActive(bool active) { isActive_ = active; }
+
+    void setNumThreads(int numThreads);
+
+    // The Checkpoint object is a singleton, this method obtains the instance
+    static Checkpoint* instance();
+
+    // destroys the singleton instance
+    static void destroy();
+
+    // Both instance() and initialize() will initialize the checkpoints
+    // but Init provides more flexibility
+    // - locking is only necessary if dump() will be called while checkpoints are being taken
+    //   If dump() will only be called at the end, then set false for increased performance
+    //   Locking never makes the checkpointing threads wait on each other: each thread
+    //   publishes its counters with its own sequence lock, which dump() retries on.
+    // - If multithreading will not be used, set numThreads to 0
+    // The global instance is only initialized once, the later calls are
+    // ignored, use createDomain() for a profiler with different settings
+    static void initialize(uint32_t numThreads = DEFAULT_MAX_THREADS, bool useLocking = true);
+    // Same as above, with all of the settings in a Config
+    static void initialize(const Config &config);
+
+    // Creates a profiler domain, independent of the global instance and of
+    // the other domains: it has its own thread table, clock, locking mode and
+    // dump, so each library can number its checkpoints from 0 with its own
+    // settings. The name is printed by dump(). Returns NULL if MAX_DOMAINS
+    // domains already exist. Delete the domain once no thread checkpoints in it.
+    static Checkpoint *createDomain(const string &name, const Config &config);
+
+    // Empty for the global instance
+    inline const string &getDomainName() const { return domainName_; }
+
+    // Returns a printable name for the clock source
+    static const char *getClockSourceStr(ClockSource clockSource);
+
+    // Converts a cycle count from the clock source of this domain to nano-seconds
+    inline uint64_t cyclesToNanos(uint64_t cycles) const {
+      return (uint64_t) (cycles * nanosPerCycle_);
+    }
+
+    // Gather checkpoint info for the specified checkpoint
+    void checkpoint(int checkpoint);
+
+    // Returns the current time in cycles of a clock source, as checkpoint() reads it
+    static inline uint64_t readClock(ClockSource clockSource) {
+#ifdef LIP_HAVE_TSC
+      if(clockSource == CLOCK_SOURCE_TSC) {
+        return __rdtsc();
+      }
+      if(clockSource == CLOCK_SOURCE_TSCP) {
+        unsigned int aux;
+        return __rdtscp(&aux);
+      }
+#endif
+      struct timespec now;
+      if(clockSource == CLOCK_SOURCE_MONOTONIC_RAW) {
+        clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+        return ((now.tv_sec * (uint64_t)1000000000) + now.tv_nsec);
+      }
+      // CLOCK_THREAD_CPUTIME_ID appears to only count the time a thread is
+      // actively working and not when its waiting or sleeping
+      //clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+      clock_gettime(CLOCK_REALTIME, &now);
+      return ((now.tv_sec * (uint64_t)1000000) + now.tv_nsec/(uint64_t)1000);
+    }
+
+    // Same as checkpoint(), and also enters or exits a scope of the
+    // thread's scope tree if Config::useScopeTree is set. Used by ScopedCheckpoint.
+    void enterScope(int checkpoint);
+    void exitScope(int checkpoint);
+
+    // Returns the id of the named checkpoint, registering it the first time.
+    // The same name always gets the same id. This takes a lock, so the id
+    // should be kept, as CHECKPOINT_NAMED() and CHECKPOINT_DECLARE() do.
+    static int registerCheckpoint(const string &name);
+
+    // Returns the name of a named checkpoint, or an empty string
+    static string getCheckpointName(int checkpoint);
+
+    // Number of checkpoint ids in use: MAX_CHECKPOINT plus the named checkpoints
+    static int getNumRegisteredCheckpoints();
+
+    // Dump the checkpoint info gathered to cout
+    inline void dump(bool verbose = true,
+                     bool dumpAverages = false,
+                     bool dumpThroughput = false,
+                     bool dumpThreadIds = false) {
+      dump(cout, verbose, dumpAverages, dumpThroughput, dumpThreadIds);
+    }
+    // Dump the checkpoint info gathered to the ostream provided
+    void dump(ostream &out,
+              bool verbose = true,
+              bool dumpAverages = false,
+              bool dumpThroughput = false,
+              bool dumpThreadIds = false);
+    // The current rates with Config::throughputBucketMillis, once a bucket
+    // was measured, otherwise the rates of each thread since it was created
+    void dumpThroughput(ostream &out);
+
+    typedef ThroughputMonitor::ThroughputInfo ThroughputInfo;
+
+    // Copies the current throughput of the checkpoints, see ThroughputMonitor::getThroughput().
+    // Can be called at any time, the checkpointing threads never wait on it.
+    // Returns the number of buckets measured, 0 until the first one ends or
+    // if Config::throughputBucketMillis is not set.
+    uint64_t getThroughput(vector<ThroughputInfo> &throughput);
+
+    // Writes the raw counters of all the threads to a binary snapshot file,
+    // see "CheckpointSnapshot.h", to be formatted offline by lip-report.
+    // The counters are copied under the same lock as dump(), but nothing is
+    // formatted. Returns false if the file could not be written.
+    bool snapshot(const string &path);
+
+    // Scales nano-seconds to a unit suitable for printing, as dump() does
+    // returns one of SECOND_STR, MILLI_SEC_STR, MICRO_SEC_STR, or NANO_SEC_STR
+    static const char *getTimeUnitStr(uint64_t &avgNanos, uint64_t &totalNanos);
+
+    // Picks the unit to print a time per iteration in, with the same
+    // thresholds as getTimeUnitStr(), and returns the nano-seconds per unit
+    static double getTimeUnitDivisor(double nanos, const char *&unitPtr);
+
+    // Dump the scope trees of all the threads merged, in the folded stacks
+    // format of flamegraph tools: a line per scope path, the scope names
+    // separated by ';', followed by the exclusive time in nano-seconds
+    void dumpFoldedStacks(ostream &out);
+
+    ~Checkpoint();
+
+  protected:
+    // domainIndex is 0 for the global instance, see createDomain()
+    Checkpoint(const Config &config, const string &domainName, uint32_t domainIndex);
+
+  private:
+    // Read the thread snapshots from their own threads
+    friend class IntervalReporter;
+    friend class ThroughputMonitor;
+    // Reads the number of segments sampled per thread
+    friend class CheckpointSampler;
+    // The checkpoint fast path, checkpoint() is one of its instantiations
+    template<typename, typename, typename, typename, uint32_t> friend class BasicCheckpoint;
+
+    // iterations_ and totalCycles_ must stay the first fields, they
+    // are read as StatsCounters from the shared-memory stats segment.
+    typedef struct CheckpointInfo_s {
+      uint64_t iterations_;
+      uint64_t totalCycles_;
+      uint64_t previousCycles_;
+      CheckpointInfo_s() : iterations_(0), totalCycles_(0), previousCycles_(0) {}
+      // The merged checkpoint keeps the latest previousCycles_
+      CheckpointInfo_s *operator+=(const CheckpointInfo_s *cpRhs) {
+        if(this == cpRhs) {return this;}
+        this->iterations_        +=  cpRhs->iterations_;
+        this->totalCycles_       +=  cpRhs->totalCycles_;
+        if(cpRhs->previousCycles_ > this->previousCycles_) {
+          this->previousCycles_  =   cpRhs->previousCycles_;
+        }
+        return this;
+      }
+    } CheckpointInfo;
+
+    // The time and count of a (previous, current) checkpoint edge
+    typedef struct TransitionInfo_s {
+      uint64_t iterations_;
+      uint64_t totalCycles_;
+    } TransitionInfo;
+
+    // Keyed by (previous << 32 | current)
+    typedef CompactHashTable<TransitionInfo> TransitionTable;
+
+    // The segments of a checkpoint that ended on a CPU, and those of them
+    // that started on another CPU, or on another NUMA node
+    typedef struct CpuSegmentInfo_s {
+      uint64_t iterations_;
+      uint64_t totalCycles_;
+      uint64_t migrations_;
+      uint64_t migratedCycles_;
+      uint64_t nodeMigrations_;
+    } CpuSegmentInfo;
+
+    // Keyed by (checkpoint << 32 | cpu)
+    typedef CompactHashTable<CpuSegmentInfo> CpuSegmentTable;
+
+    // Hardware counter deltas of a checkpoint's segments, indexed by PerfCounters::Counter
+    typedef struct PerfCounterInfo_s {
+      uint64_t counts_[PerfCounters::NUM_COUNTERS];
+      PerfCounterInfo_s() {
+        for(uint32_t counter = 0; counter < PerfCounters::NUM_COUNTERS; ++counter) {
+          counts_[counter] = 0;
+        }
+      }
+    } PerfCounterInfo;
+
+    // Aligned to the cache line so neighbouring threads in
+    // threadCpInfoTable_ never write to the same cache line
+    typedef struct ThreadCheckpointInfo_s {
+      // Sequence lock, odd while the thread is updating its counters
+      uint32_t sequence_;
+      uint32_t lastCheckpointHit_;
+      // The arrays have numCheckpoints_ entries, and are grown by growCheckpoints()
+      CheckpointInfo *checkpoints_;
+      // NULL if not using histograms
+      LatencyHistogram *histograms_;
+      // The timed segments, all of them unless sampling, NULL if not using the segment stats
+      SegmentStats *segmentStats_;
+      // NULL if not using perf counters
+      PerfCounterInfo *perfCounts_;
+      // NULL if the thread has no perf counters
+      PerfCounters *perfCounters_;
+      // On-CPU nanoseconds per checkpoint, NULL if not using the CPU time
+      uint64_t *cpuNanos_;
+      // NULL if the thread has no CPU time
+      ThreadCpuClock *cpuClock_;
+      // NULL if not tracing
+      TraceRing *traceRing_;
+      // NULL if not using transitions
+      TransitionTable *transitions_;
+      // NULL if not using the scope tree
+      ScopeTree *scopeTree_;
+      // NULL if not using the CPU attribution, lastCpu_ is where the previous segment ended
+      CpuSegmentTable *cpuSegments_;
+      uint32_t lastCpu_;
+      uint32_t numCheckpoints_;
+      // Sampling state, see sampledCheckpoint()
+      bool segmentSampled_;
+      uint32_t sampleCountdown_;
+      uint32_t sampleEpoch_;
+      uint32_t sampleWeight_;
+      uint32_t epochSegments_;
+      uint32_t segmentsSinceSample_;
+      uint32_t randomState_;
+      uint64_t numSampled_;
+      uint64_t creationCycles_;
+      pthread_t threadId_;
+      ThreadCheckpointInfo_s() :
+        sequence_(0), lastCheckpointHit_(0), checkpoints_(NULL), histograms_(NULL),
+        segmentStats_(NULL), perfCounts_(NULL), perfCounters_(NULL), cpuNanos_(NULL), cpuClock_(NULL), traceRing_(NULL),
+        transitions_(NULL), scopeTree_(NULL), cpuSegments_(NULL), lastCpu_(0), numCheckpoints_(0),
+        segmentSampled_(false), sampleCountdown_(0), sampleEpoch_(0), sampleWeight_(1),
+        epochSegments_(0), segmentsSinceSample_(0), randomState_(1), numSampled_(0), creationCycles_(0), threadId_(0) {}
+    } __attribute__((aligned(CACHE_LINE_SIZE))) ThreadCheckpointInfo;
+
+    // The named checkpoints, names_[id - FIRST_NAMED_CHECKPOINT] is the name of id.
+    // The names are shared by all the domains. The registry also holds a bit
+    // per domain index in use, and the domains with a stats segment, which
+    // are given the names registered after their creation, and a bit per
+    // signal whose dump handler is installed.
+    typedef struct CheckpointRegistry_s {
+      pthread_mutex_t lock_;
+      vector<string> names_;
+      map<string, int> ids_;
+      uint32_t domainsUsed_;
+      Checkpoint *statsDomains_[MAX_DOMAINS];
+      uint64_t dumpSignals_;
+      CheckpointRegistry_s() : domainsUsed_(1), dumpSignals_(0) {
+        pthread_mutex_init(&lock_, NULL);
+        memset(statsDomains_, 0, sizeof(statsDomains_));
+      }
+    } CheckpointRegistry;
+
+    // The slot of the exited threads' counters, see getThreadSlot()
+    static const uint32_t RETIRED_SLOT=0xffffffff;
+    // Slots per chunk the thread table grows by
+    static const uint32_t THREAD_CHUNK_SIZE=64;
+
+    // Function-local static, so checkpoints can be registered during static-init
+    static CheckpointRegistry &getCheckpointRegistry();
+
+    // Returns the checkpoint name, or its number if its not named
+    static string getCheckpointLabel(int checkpoint, const vector<string> &names);
+
+    // Returns a copy of the registered checkpoint names
+    static vector<string> getCheckpointNames();
+
+    // Each thread caches a pointer to its slot in threadCpInfoTable_, in tlsSlot_
+    // for the global instance and per domain index for the domains. The instanceId
+    // is checked so a stale pointer from a destroyed instance, or from a previous
+    // domain with the same index, is never used
+    typedef struct ThreadLocalSlot_s {
+      uint64_t instanceId_;
+      ThreadCheckpointInfo *threadCpInfo_;
+      uint32_t slot_;
+    } ThreadLocalSlot;
+
+    // The writer side of a thread's sequence lock. Only the thread writes
+    // to its ThreadCheckpointInfo, so the lock is just 2 stores, and the
+    // fences keep the counter stores between them
+    inline void beginThreadUpdate(ThreadCheckpointInfo *threadCp) {
+      if(__unlikely(useLocking_)) {
+        __atomic_store_n(&threadCp->sequence_, threadCp->sequence_ + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+      }
+    }
+    inline void endThreadUpdate(ThreadCheckpointInfo *threadCp) {
+      if(__unlikely(useLocking_)) {
+        __atomic_store_n(&threadCp->sequence_, threadCp->sequence_ + 1, __ATOMIC_RELEASE);
+      }
+    }
+
+    // returns the calling thread's ThreadCheckpointInfo
+    // After the first call on a thread, this is just a thread-local load.
+    // The global instance's slot is checked first and not indexed, which
+    // keeps its fast path as cheap as when it was the only instance.
+    inline ThreadCheckpointInfo *getThreadCpInfo() {
+      if(__likely(tlsSlot_.instanceId_ == instanceId_)) {
+        return tlsSlot_.threadCpInfo_;
+      }
+      ThreadLocalSlot &domainSlot(tlsDomainSlots_[domainIndex_]);
+      if(__likely(domainSlot.instanceId_ == instanceId_)) {
+        return domainSlot.threadCpInfo_;
+      }
+      return registerThread();
+    }
+
+    // slow path of getThreadCpInfo(): claims a slot for the thread, and
+    // sets the thread exit hook that retires it
+    ThreadCheckpointInfo *registerThread();
+
+    // Returns a slot freed by an exited thread, or the next new slot, growing
+    // the table if needed. Returns the overflow slot threadTableSize_ if the
+    // table can't grow. Called with slotLock_ held.
+    uint32_t claimSlot();
+
+    // Returns the ThreadCheckpointInfo of a slot: in threadCpInfoTable_, in
+    // a chunk of the grown table, or retiredCpInfo_ for RETIRED_SLOT
+    inline ThreadCheckpointInfo *getThreadSlot(uint32_t slot) const {
+      if(__likely(slot <= threadTableSize_)) {
+        return &(threadCpInfoTable_[slot]);
+      }
+      if(slot == RETIRED_SLOT) {
+        return retiredCpInfo_;
+      }
+      slot -= threadTableSize_ + 1;
+      ThreadCheckpointInfo *chunk(__atomic_load_n(&(threadCpInfoChunks_[slot / THREAD_CHUNK_SIZE]), __ATOMIC_ACQUIRE));
+      return &(chunk[slot % THREAD_CHUNK_SIZE]);
+    }
+
+    // The thread exit hook, a destructor of threadExitKey_
+    static void threadExitHook(void *profiler);
+
+    // Adds the calling thread's counters to the retired threads, and frees its slot
+    void retireThread();
+
+    // Adds the counters of a slot to retiredCpInfo_, called with slotLock_ held
+    void addToRetired(ThreadCheckpointInfo *threadCp);
+
+    // Merges the checkpoints of a thread into the pairwise reduction of dump().
+    // partials[i] holds the merge of partialThreads[i] threads, a power of 2
+    // decreasing with i, so merging a thread is like a binary increment: the
+    // partials of equal size are merged as the carry, and the reduction is a
+    // balanced tree kept in log(threads) partials. T is CheckpointInfo or
+    // SegmentStats, see mergeCounters().
+    template<typename T>
+    static void reduceCheckpoints(vector<vector<T> > &partials,
+                                  vector<uint32_t> &partialThreads,
+                                  const T *checkpoints,
+                                  uint32_t numCheckpoints);
+
+    // Merges the partials into their first entry, returns it or NULL if empty
+    template<typename T>
+    static vector<T> *finishReduction(vector<vector<T> > &partials);
+
+    // Merges the checkpoints of rhs into lhs, growing lhs if needed
+    template<typename T>
+    static void mergeCheckpoints(vector<T> &lhs, const vector<T> &rhs);
+
+    static inline void mergeCounters(CheckpointInfo &lhs, const CheckpointInfo &rhs) { lhs += &rhs; }
+    static inline void mergeCounters(SegmentStats &lhs, const SegmentStats &rhs) { lhs.merge(rhs); }
+
+    // Frees the arrays and objects of a slot, and its checkpoints if freeCheckpoints
+    void freeThreadCpInfo(ThreadCheckpointInfo *threadCp, bool freeCheckpoints);
+
+    // The thread of a slot as dumped: its number, or "retired"
+    static string getThreadLabel(uint32_t slot);
+
+    // (re)initializes the ThreadCheckpointInfo in the table slot
+    void initThreadCpInfo(uint32_t slot);
+
+    // Opens the perf counters of the calling thread, with a NOTICE the
+    // first time they can't be opened
+    void openPerfCounters(ThreadCheckpointInfo *threadCp);
+
+    // Creates the CPU clock of the calling thread, with a NOTICE the
+    // first time it needs a system call per checkpoint
+    void openCpuClock(ThreadCheckpointInfo *threadCp);
+
+    // checkpoint() when sampling: counts the hit, and only reads the clock
+    // if the segment ending or the segment starting here is sampled
+    void sampledCheckpoint(ThreadCheckpointInfo *threadCp, int checkpoint);
+
+    // Measures overheadNanos_ and overheadVariance_ with checkpoints
+    // on a private ThreadCheckpointInfo, so no thread slot is used
+    void calibrateOverhead();
+    void calibrationCheckpoint(ThreadCheckpointInfo *threadCp, int checkpoint);
+
+    // Attributes a segment of checkpoint to the CPU it ends on, as a migration
+    // if the thread's previous segment ended on another CPU. weight is the
+    // number of segments it stands for when sampling.
+    inline void recordCpuSegment(ThreadCheckpointInfo *threadCp, int checkpoint, uint64_t elapsedCycles, uint32_t weight) {
+      uint32_t cpu(cpuTopology_->getCurrentCpu());
+      CpuSegmentInfo &cpuSegment((*threadCp->cpuSegments_)[((uint64_t) checkpoint << 32) | cpu]);
+      cpuSegment.iterations_  += weight;
+      cpuSegment.totalCycles_ += elapsedCycles * weight;
+      if(__unlikely(cpu != threadCp->lastCpu_)) {
+        cpuSegment.migrations_     += weight;
+        cpuSegment.migratedCycles_ += elapsedCycles * weight;
+        if(cpuTopology_->getNode(cpu) != cpuTopology_->getNode(threadCp->lastCpu_)) {
+          cpuSegment.nodeMigrations_ += weight;
+        }
+        threadCp->lastCpu_ = cpu;
+      }
+    }
+
+    static void addCpuSegment(CpuSegmentInfo &lhs, const CpuSegmentInfo &rhs);
+
+    // Dumps the segments per CPU and per NUMA node, sorted by checkpoint
+    void dumpCpuSegments(ostream &out,
+                         const string &prefix,
+                         vector<CpuSegmentTable::Entry> &cpuSegments,
+                         const vector<string> &names);
+    // A line of dumpCpuSegments(), label is the CPU or node
+    void dumpCpuSegment(ostream &out,
+                        const string &prefix,
+                        uint32_t checkpoint,
+                        const string &label,
+                        const CpuSegmentInfo &cpuSegment,
+                        const vector<string> &names);
+
+    // Removes the calibrated overhead from a segment, overheadCycles_ is 0
+    // if Config::subtractOverhead is not set
+    inline uint64_t subtractOverhead(uint64_t elapsedCycles) const {
+      return (elapsedCycles > overheadCycles_ ? elapsedCycles - overheadCycles_ : 0);
+    }
+
+    // slow path of checkpoint(): grows the thread's arrays to hold checkpoint
+    // returns false if the checkpoint id is invalid
+    bool growCheckpoints(ThreadCheckpointInfo *threadCp, int checkpoint);
+
+    // Used by growCheckpoints(): publishes a copy of array with numCheckpoints
+    // entries, the new ones value-initialized, and retires the old one
+    template<typename T>
+    void growArray(T *&array, uint32_t oldNumCheckpoints, uint32_t numCheckpoints);
+
+    // Copies the counters of a thread slot, consistent with respect to the
+    // thread's sequence lock if useLocking_ is set. The snapshot's checkpoints_
+    // will point into the checkpoints vector. The histograms, segment stats,
+    // perf counts and CPU times are not copied, they are read directly and may be off by the
+    // samples recorded while dumping. The transitions and the scope tree nodes are copied if
+    // transitions and scopeNodes are not NULL.
+    void getThreadCpInfoSnapshot(uint32_t slot,
+                                 ThreadCheckpointInfo &snapshot,
+                                 vector<CheckpointInfo> &checkpoints,
+                                 vector<TransitionTable::Entry> *transitions = NULL,
+                                 vector<ScopeTree::ScopeNode> *scopeNodes = NULL,
+                                 vector<CpuSegmentTable::Entry> *cpuSegments = NULL);
+
+    // The counters of a thread slot that dump() formats, copied under
+    // slotLock_ and up to the last checkpoint hit. numHits_ is the number
+    // of threads that hit each checkpoint, only kept for the retired threads.
+    typedef struct DumpedThread_s {
+      uint32_t slot_;
+      bool hasPerfCounts_;
+      bool hasCpuTime_;
+      vector<CheckpointInfo> checkpoints_;
+      vector<LatencyHistogram> histograms_;
+      vector<SegmentStats> segmentStats_;
+      vector<PerfCounterInfo> perfCounts_;
+      vector<uint64_t> cpuNanos_;
+      vector<uint32_t> numHits_;
+      vector<TransitionTable::Entry> transitions_;
+      vector<CpuSegmentTable::Entry> cpuSegments_;
+    } DumpedThread;
+
+    // Copies the counters of the slot for dump(), called with slotLock_ held.
+    // Returns false if no checkpoint was hit on the slot.
+    bool copyDumpedThread(uint32_t slot, DumpedThread &thread);
+
+    // Preallocated for the signal dump: a copy of a slot's checkpoints, the
+    // totals of all the threads, and retiredCpHits_, which the handler can't
+    // read since it is reallocated, numCheckpoints_ of each. retiredHits_ is
+    // updated under growLock_.
+    typedef struct SignalDumpScratch_s {
+      uint32_t numCheckpoints_;
+      CheckpointInfo *checkpoints_;
+      CheckpointInfo *totals_;
+      uint32_t *totalThreads_;
+      uint32_t *retiredHits_;
+    } SignalDumpScratch;
+
+    static const uint32_t SIGNAL_DUMP_BUFFER_SIZE=4096;
+
+    // Installs signalDumpHandler() for Config::dumpSignal, once per signal.
+    // The handler stays installed, and only dumps the domains in signalDomains_.
+    void installSignalDump();
+
+    // The signal handler, dumps the domains using the signal
+    static void signalDumpHandler(int signal);
+
+    // Dumps the counters of all the threads, from the signal handler
+    void signalDump(int signal);
+
+    // getThreadCpInfoSnapshot() for the signal dump: copies the checkpoints of
+    // the slot into the scratch, up to its size, and returns the number copied
+    uint32_t copySignalDumpSlot(uint32_t slot, SignalDumpScratch *scratch);
+
+    // Grows signalScratch_ to hold numCheckpoints, called with growLock_ held
+    void reserveSignalScratch(uint32_t numCheckpoints);
+
+    // Returns a new tree with the scope trees of all the threads merged
+    // NULL if not using the scope tree
+    ScopeTree *getMergedScopeTree();
+
+    // Cache line aligned allocation, rounded up to a whole number of cache lines
+    // so it shares no cache lines with other allocations. Freed with free()
+    static void *allocateAligned(size_t size);
+
+    // number of slots that have been claimed, the slots below it are the ones
+    // to read with getThreadSlot(), and the retired threads with RETIRED_SLOT
+    inline uint32_t getNumThreadsUsed() const {
+      return __atomic_load_n(&numSlots_, __ATOMIC_ACQUIRE);
+    }
+
+    // Returns the current time in cycles of the clock source of this domain,
+    // use cyclesToNanos() to convert
+    inline uint64_t getCycles() const {
+      return readClock(clockSource_);
+    }
+
+    // Sets clockSource_ and nanosPerCycle_, calibrating the TSC if needed
+    void initializeClock(ClockSource clockSource);
+
+    // Converts avgCycles and totalCycles to a time unit suitable for printing
+    // returns one of SECOND_STR, MILLI_SEC_STR, MICRO_SEC_STR, or NANO_SEC_STR
+    const char *getTimeResolutionStr(uint64_t &avgCycles, uint64_t &totalCycles) const;
+
+    // Dumps the min, max, stddev and percentiles of the histogram
+    void dumpLatency(ostream &out, const LatencyHistogram &histogram);
+
+    // Dumps the min, max, mean and stddev of the timed segments
+    void dumpSegmentStats(ostream &out, const SegmentStats &stats);
+
+    // Dumps the IPC and the misses per iteration
+    void dumpPerfCounters(ostream &out, const PerfCounterInfo &counts, uint64_t iterations);
+
+    // Dumps the average on-CPU and off-CPU time and the CPU utilization
+    void dumpCpuTime(ostream &out, uint64_t cpuNanos, uint64_t wallCycles, uint64_t iterations);
+
+    // Dumps a line per scope, indented by depth
+    void dumpScopeTree(ostream &out,
+                       const vector<ScopeTree::ScopeNode> &nodes,
+                       uint32_t node,
+                       int depth,
+                       const vector<string> &names);
+
+    // Dumps the folded stacks of the node and its children, path is the
+    // folded stack of the node's parent
+    void dumpFoldedStacks(ostream &out,
+                          const vector<ScopeTree::ScopeNode> &nodes,
+                          uint32_t node,
+                          const string &path,
+                          const vector<string> &names);
+
+    // Dumps a line per edge, sorted by checkpoint, each line starts with prefix
+    void dumpTransitions(ostream &out,
+                         const string &prefix,
+                         vector<TransitionTable::Entry> &transitions,
+                         const vector<string> &names);
+
+    static Checkpoint* instance_;
+    static uint64_t instanceIdCounter_;
+    static __thread ThreadLocalSlot tlsSlot_;
+    // Indexed by domainIndex_, entry 0 is not used
+    static __thread ThreadLocalSlot tlsDomainSlots_[MAX_DOMAINS];
+
+    bool useLocking_;
+    ClockSource clockSource_;
+    double nanosPerCycle_;
+    string domainName_;
+
+    // The initial table of per-thread slots, in thread registration order.
+    // The extra slot at index threadTableSize_ is shared by any threads registered
+    // beyond maxThreadSlots_.
+    ThreadCheckpointInfo *threadCpInfoTable_;
+    // The slots beyond the overflow slot, THREAD_CHUNK_SIZE per chunk, allocated
+    // when more threads checkpoint at once than the table has slots for
+    ThreadCheckpointInfo **threadCpInfoChunks_;
+    uint32_t maxThreadSlots_;
+    // Recursive, it serializes registering and retiring the threads with
+    // the readers of all the slots: dump(), the interval reporter and the sampler
+    pthread_mutex_t slotLock_;
+    // The slots of the exited threads, reused before claiming new ones
+    vector<uint32_t> freeSlots_;
+    // The slots claimed so far, including the overflow slot once the slots
+    // beyond it are used, see getNumThreadsUsed()
+    uint32_t numSlots_;
+    // The counters of the exited threads, and per checkpoint the number of
+    // exited threads that hit it, for the averages
+    ThreadCheckpointInfo *retiredCpInfo_;
+    vector<uint32_t> retiredCpHits_;
+    uint64_t numThreadsRetired_;
+    bool retiredPerfCounted_;
+    // The threads that shared the overflow slot
+    uint64_t numThreadsShared_;
+    // Its destructor retires the thread's slot, not used with numThreads 0
+    pthread_key_t threadExitKey_;
+    bool useThreadExitKey_;
+    // Arrays replaced by growCheckpoints(), only freed on destruction
+    // since dump() may still be reading them
+    vector<void*> retiredArrays_;
+    pthread_mutex_t growLock_;
+    bool useHistograms_;
+    bool useSegmentStats_;
+    bool usePerfCounters_;
+    bool perfNoticed_;
+    bool useCpuTime_;
+    bool cpuClockNoticed_;
+    // NULL if not using the CPU attribution
+    CpuTopology *cpuTopology_;
+    // Bit per PerfCounters::Counter opened by any thread
+    uint32_t perfAvailableMask_;
+    bool useTransitions_;
+    bool useScopeTree_;
+    uint32_t scopeTreeNodes_;
+    uint32_t scopeTreeDepth_;
+    // Calibrated checkpoint overhead, see Config::subtractOverhead
+    double overheadNanos_;
+    double overheadVariance_;
+    uint64_t overheadCycles_;
+    bool subtractOverhead_;
+    vector<double> percentiles_;
+    // NULL if not tracing
+    CheckpointTrace *trace_;
+    // NULL if the counters are not in shared-memory, otherwise it holds
+    // threadCpInfoTable_ and the checkpoints_ arrays
+    StatsSegment *stats_;
+    bool shmFullNoticed_;
+    // NULL if not reporting intervals
+    IntervalReporter *reporter_;
+    // NULL if not monitoring the throughput
+    ThroughputMonitor *throughput_;
+    // NULL if not sampling
+    CheckpointSampler *sampler_;
+    // Config::dumpSignal, 0 if not dumping on a signal
+    int dumpSignal_;
+    string dumpSignalPath_;
+    int dumpSignalFd_;
+    // Grown by reserveSignalScratch(), NULL if not dumping on a signal
+    SignalDumpScratch *signalScratch_;
+    // The domains dumped by the signal handler, by domain index. The handler
+    // sets signalDumpBusy_ while dumping, into the shared signalDumpBuffer_.
+    static Checkpoint *signalDomains_[MAX_DOMAINS];
+    static bool signalDumpBusy_;
+    static char signalDumpBuffer_[SIGNAL_DUMP_BUFFER_SIZE];
+    uint32_t threadTableSize_;
+    uint64_t instanceId_;
+    uint32_t domainIndex_;
+
+    uint32_t threadIdCounter_;
+    int numThreads_;
+    bool isActive_;
+
+};
+
+//
+// ScopedCheckpoint
+//
+// To be used in functions or scopes, where you want a checkpoint at scope entry
+// and via the ScopedCheckpoint destruction, another checkpoint at scope exit
+// A ScopedCheckpoint object should be instantiated at scope entry with a checkpointNumber.
+// Upon ScopedCheckpoint instantiation, a checkpoint will be taken using checkpointNumber.
+// Then on scope exit, the object will be destroyed, and a checkpoint will be taken using
+// either checkpointNumber+1 or if the 2 arg ctor was used, then lastCheckpoint
+// With Checkpoint::Config::useScopeTree set, nested ScopedCheckpoints also build
+// a call tree of the scopes, named by their start checkpoint.
+// The ctors taking a domain checkpoint in it instead of the global instance.
+
+#ifndef LIP_DISABLE
+
+class ScopedCheckpoint
+{
+public:
+  ScopedCheckpoint(int checkpoint) :
+      profiler_(Checkpoint::instance()),
+      startCheckpointNumber_(checkpoint),
+      lastCheckpointNumber_(checkpoint+1)
+  {
+    profiler_->enterScope(startCheckpointNumber_);
+  }
+
+  ScopedCheckpoint(int startCheckpoint, int lastCheckpoint) :
+      profiler_(Checkpoint::instance()),
+      startCheckpointNumber_(startCheckpoint),
+      lastCheckpointNumber_(lastCheckpoint)
+  {
+    profiler_->enterScope(startCheckpointNumber_);
+  }
+
+  ScopedCheckpoint(Checkpoint *domain, int checkpoint) :
+      profiler_(domain),
+      startCheckpointNumber_(checkpoint),
+      lastCheckpointNumber_(checkpoint+1)
+  {
+    profiler_->enterScope(startCheckpointNumber_);
+  }
+
+  ScopedCheckpoint(Checkpoint *domain, int startCheckpoint, int lastCheckpoint) :
+      profiler_(domain),
+      startCheckpointNumber_(startCheckpoint),
+      lastCheckpointNumber_(lastCheckpoint)
+  {
+    profiler_->enterScope(startCheckpointNumber_);
+  }
+
+  ~ScopedCheckpoint()
+  {
+    profiler_->exitScope(lastCheckpointNumber_);
+  }
+
+private:
+  ScopedCheckpoint();
+  Checkpoint *profiler_;
+  int startCheckpointNumber_;
+  int lastCheckpointNumber_;
+};
+
+#else
+
+class ScopedCheckpoint
+{
+public:
+  ScopedCheckpoint(int) {}
+  ScopedCheckpoint(int, int) {}
+  ScopedCheckpoint(Checkpoint *, int) {}
+  ScopedCheckpoint(Checkpoint *, int, int) {}
+};
+
+#endif // LIP_DISABLE
+
+#include "CheckpointPolicy.h"
+
+#endif // LOW_IMPACT_PROFILER_H
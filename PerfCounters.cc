@@ -0,0 +1,129 @@
+
+#include <errno.h>
+#include <string.h>     // memset(), strerror()
+#include <sys/mman.h>   // mmap()
+#include <sys/syscall.h>
+
+#include "PerfCounters.h"
+
+using namespace std;
+
+// static
+const char *PerfCounters::getCounterName(uint32_t counter)
+{
+  switch(counter)
+  {
+    case INSTRUCTIONS:  return "Instructions";
+    case CYCLES:        return "Cycles";
+    case LLC_MISSES:    return "LLCMisses";
+    case BRANCH_MISSES: return "BranchMisses";
+  }
+
+  return "Unknown";
+}
+
+// The first counter opened leads the group, the others are left out
+// if they can't be opened, for example LLC misses on some virtual machines
+PerfCounters::PerfCounters() :
+    groupFd_(-1),
+    useRdpmc_(false)
+{
+  const uint64_t EVENTS[NUM_COUNTERS] = {
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+  };
+
+  uint32_t numOpened(0);
+  long pageSize(sysconf(_SC_PAGESIZE));
+  for(uint32_t counter = 0; counter < NUM_COUNTERS; ++counter)
+  {
+    fds_[counter] = -1;
+    groupIndex_[counter] = NUM_COUNTERS;
+    pages_[counter] = NULL;
+    previousCounts_[counter] = 0;
+
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.config         = EVENTS[counter];
+    attr.read_format    = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+
+    // This thread, on any CPU
+    int fd(syscall(__NR_perf_event_open, &attr, 0, -1, groupFd_, 0));
+    if(fd < 0)
+    {
+      if(groupFd_ < 0 && counter == NUM_COUNTERS - 1)
+      {
+        errorStr_ = string("perf_event_open() failed: ") + strerror(errno);
+        if(errno == EACCES || errno == EPERM)
+        {
+          errorStr_ += ", see /proc/sys/kernel/perf_event_paranoid";
+        }
+      }
+      continue;
+    }
+
+    fds_[counter] = fd;
+    groupIndex_[counter] = numOpened++;
+    if(groupFd_ < 0)
+    {
+      groupFd_ = fd;
+    }
+
+    void *page(mmap(NULL, pageSize, PROT_READ, MAP_SHARED, fd, 0));
+    if(page != MAP_FAILED)
+    {
+      pages_[counter] = (volatile perf_event_mmap_page*) page;
+    }
+  }
+
+  if(groupFd_ < 0)
+  {
+    return;
+  }
+
+  // rdpmc is only used if all the opened counters allow it
+#if defined(__x86_64__) || defined(__i386__)
+  useRdpmc_ = true;
+  for(uint32_t counter = 0; counter < NUM_COUNTERS; ++counter)
+  {
+    if(fds_[counter] >= 0 && (pages_[counter] == NULL || !pages_[counter]->cap_user_rdpmc))
+    {
+      useRdpmc_ = false;
+    }
+  }
+#endif
+
+  uint64_t counts[NUM_COUNTERS];
+  read(counts);
+  for(uint32_t counter = 0; counter < NUM_COUNTERS; ++counter)
+  {
+    previousCounts_[counter] = counts[counter];
+  }
+}
+
+// The group leader is closed last
+PerfCounters::~PerfCounters()
+{
+  long pageSize(sysconf(_SC_PAGESIZE));
+  for(int counter = NUM_COUNTERS - 1; counter >= 0; --counter)
+  {
+    if(pages_[counter] != NULL)
+    {
+      munmap((void*) pages_[counter], pageSize);
+    }
+    if(fds_[counter] >= 0 && fds_[counter] != groupFd_)
+    {
+      close(fds_[counter]);
+    }
+  }
+  if(groupFd_ >= 0)
+  {
+    close(groupFd_);
+  }
+}
@@ -0,0 +1,130 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <string>
+
+#include <stdint.h> // uint32_t et al
+#include <unistd.h> // read()
+#include <linux/perf_event.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // __rdpmc()
+#endif
+
+using namespace std;
+
+//
+// PerfCounters
+//
+// A perf_event group of hardware counters for the calling thread:
+// instructions, cycles, last level cache misses and branch misses, in user
+// space only. The counters the CPU or the kernel don't support are left
+// out, and read as 0.
+//
+// The counters are read with rdpmc from the events' mmap pages when the
+// kernel allows it (x86, /sys/bus/event_source/devices/cpu/rdpmc), which
+// takes tens of cycles, otherwise with a read() of the group, which is a
+// system call. Either way, only the thread that opened the group may read it.
+//
+
+class PerfCounters
+{
+public:
+  typedef enum {
+    INSTRUCTIONS = 0,
+    CYCLES,
+    LLC_MISSES,
+    BRANCH_MISSES,
+    NUM_COUNTERS
+  } Counter;
+
+  static const char *getCounterName(uint32_t counter);
+
+  // Opens the group for the calling thread, check isOpen()
+  PerfCounters();
+  ~PerfCounters();
+
+  inline bool isOpen() const { return groupFd_ >= 0; }
+  inline const string &getErrorStr() const { return errorStr_; }
+  inline bool isAvailable(uint32_t counter) const { return fds_[counter] >= 0; }
+  inline bool usesRdpmc() const { return useRdpmc_; }
+
+  // Sets deltas to the counts since the previous call, or since opening
+  inline void readDeltas(uint64_t deltas[NUM_COUNTERS])
+  {
+    uint64_t counts[NUM_COUNTERS];
+    read(counts);
+    for(uint32_t counter = 0; counter < NUM_COUNTERS; ++counter)
+    {
+      deltas[counter] = counts[counter] - previousCounts_[counter];
+      previousCounts_[counter] = counts[counter];
+    }
+  }
+
+private:
+  PerfCounters(const PerfCounters &);
+  PerfCounters &operator=(const PerfCounters &);
+
+  inline void read(uint64_t counts[NUM_COUNTERS])
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    if(useRdpmc_)
+    {
+      for(uint32_t counter = 0; counter < NUM_COUNTERS; ++counter)
+      {
+        counts[counter] = (pages_[counter] != NULL ? readPage(pages_[counter]) : 0);
+      }
+      return;
+    }
+#endif
+
+    // PERF_FORMAT_GROUP: the number of events, then their values in opening order
+    uint64_t values[1 + NUM_COUNTERS];
+    if(::read(groupFd_, values, sizeof(values)) < (ssize_t) sizeof(uint64_t))
+    {
+      values[0] = 0;
+    }
+    for(uint32_t counter = 0; counter < NUM_COUNTERS; ++counter)
+    {
+      uint32_t index(groupIndex_[counter]);
+      counts[counter] = (index < values[0] ? values[1 + index] : previousCounts_[counter]);
+    }
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  // The kernel updates the page under its sequence lock when the event
+  // is scheduled, the count is its offset plus the hardware counter
+  static inline uint64_t readPage(volatile perf_event_mmap_page *page)
+  {
+    uint32_t sequence;
+    int64_t count;
+    do
+    {
+      sequence = page->lock;
+      __asm__ __volatile__("" : : : "memory");
+      uint32_t index(page->index);
+      count = page->offset;
+      if(index != 0)
+      {
+        // The counter is pmc_width bits wide, and sign extended
+        uint32_t shift(64 - page->pmc_width);
+        count += ((int64_t) (__rdpmc(index - 1) << shift)) >> shift;
+      }
+      __asm__ __volatile__("" : : : "memory");
+    } while(page->lock != sequence);
+
+    return count;
+  }
+#endif
+
+  int groupFd_;
+  int fds_[NUM_COUNTERS];
+  // Index of the counter in the group read, NUM_COUNTERS if not available
+  uint32_t groupIndex_[NUM_COUNTERS];
+  volatile perf_event_mmap_page *pages_[NUM_COUNTERS];
+  bool useRdpmc_;
+  uint64_t previousCounts_[NUM_COUNTERS];
+  string errorStr_;
+};
+
+#endif // PERF_COUNTERS_H
@@ -0,0 +1,220 @@
+#ifndef SCOPE_TREE_H
+#define SCOPE_TREE_H
+
+#include <vector>
+
+#include <stdint.h> // uint32_t et al
+
+using namespace std;
+
+//
+// ScopeTree
+//
+// A per-thread call tree of nested scopes, built from ScopedCheckpoint
+// entries and exits. Each node is a scope, identified by its entry
+// checkpoint, under the path of scopes that were open when it was
+// entered. The nodes keep the call count and the inclusive time, and
+// the time spent in child scopes, so the exclusive time is the
+// difference.
+//
+// The nodes and the scope stack are pre-allocated, so push() and pop()
+// never allocate. Scopes entered when the nodes are used up, or deeper
+// than maxDepth, are not recorded and are counted as dropped.
+//
+// The nodes are never moved and are published after being initialized,
+// so another thread can copy them with copyNodes(), using the owning
+// thread's sequence lock to retry inconsistent copies.
+//
+
+class ScopeTree
+{
+public:
+  static const uint32_t ROOT_NODE = 0;
+  static const uint32_t INVALID_NODE = ~((uint32_t) 0);
+
+  typedef struct ScopeNode_s {
+    uint32_t checkpoint_;
+    uint32_t parent_;
+    uint32_t firstChild_;
+    uint32_t nextSibling_;
+    uint64_t calls_;
+    uint64_t inclusiveCycles_;
+    uint64_t childCycles_;
+  } ScopeNode;
+
+  ScopeTree(uint32_t maxNodes, uint32_t maxDepth) :
+      nodes_(new ScopeNode[maxNodes + 1]),
+      stack_(new ScopeFrame[maxDepth]),
+      maxNodes_(maxNodes + 1),
+      maxDepth_(maxDepth),
+      numNodes_(0),
+      depth_(0),
+      numDropped_(0)
+  {
+    reset();
+  }
+
+  ~ScopeTree()
+  {
+    delete [] nodes_;
+    delete [] stack_;
+  }
+
+  // Removes all of the nodes and open scopes
+  void reset()
+  {
+    initNode(ROOT_NODE, INVALID_NODE, INVALID_NODE);
+    __atomic_store_n(&numNodes_, 1, __ATOMIC_RELEASE);
+    depth_ = 0;
+    numDropped_ = 0;
+  }
+
+  // Enters the scope of checkpoint
+  inline void push(uint32_t checkpoint, uint64_t cycles)
+  {
+    if(__builtin_expect(depth_ >= maxDepth_, 0))
+    {
+      // Only counted, so the matching pop() is known to be a dropped scope
+      ++depth_;
+      ++numDropped_;
+      return;
+    }
+
+    uint32_t parent(depth_ == 0 ? ROOT_NODE : stack_[depth_ - 1].node_);
+    uint32_t node(parent == INVALID_NODE ? INVALID_NODE : findOrAddChild(parent, checkpoint));
+    if(node == INVALID_NODE)
+    {
+      ++numDropped_;
+    }
+
+    stack_[depth_].node_ = node;
+    stack_[depth_].startCycles_ = cycles;
+    ++depth_;
+  }
+
+  // Exits the innermost scope, a pop() without a push() is ignored
+  inline void pop(uint64_t cycles)
+  {
+    if(__builtin_expect(depth_ == 0, 0))
+    {
+      return;
+    }
+    --depth_;
+    if(__builtin_expect(depth_ >= maxDepth_, 0))
+    {
+      return;
+    }
+
+    const ScopeFrame &frame(stack_[depth_]);
+    if(frame.node_ == INVALID_NODE)
+    {
+      return;
+    }
+
+    uint64_t elapsedCycles(cycles - frame.startCycles_);
+    ScopeNode &node(nodes_[frame.node_]);
+    ++node.calls_;
+    node.inclusiveCycles_ += elapsedCycles;
+    nodes_[node.parent_].childCycles_ += elapsedCycles;
+  }
+
+  inline uint32_t getNumNodes() const { return __atomic_load_n(&numNodes_, __ATOMIC_ACQUIRE); }
+  inline uint64_t getNumDropped() const { return numDropped_; }
+
+  // Copies the nodes, node i of the copy is node i of the tree.
+  // May be called from any thread, see the class comment.
+  void copyNodes(vector<ScopeNode> &nodes) const
+  {
+    uint32_t numNodes(getNumNodes());
+    nodes.assign(nodes_, nodes_ + numNodes);
+  }
+
+  // Adds the nodes copied from another tree, matching the nodes by the
+  // checkpoints on their path from the root, and its number of dropped
+  // scopes. Only called when dumping, from one thread.
+  void merge(const vector<ScopeNode> &nodes, uint64_t numDropped)
+  {
+    numDropped_ += numDropped;
+    if(!nodes.empty())
+    {
+      mergeNode(nodes, ROOT_NODE, ROOT_NODE);
+    }
+  }
+
+private:
+  ScopeTree();
+  ScopeTree(const ScopeTree &);
+  ScopeTree &operator=(const ScopeTree &);
+
+  typedef struct ScopeFrame_s {
+    uint32_t node_;
+    uint64_t startCycles_;
+  } ScopeFrame;
+
+  inline void initNode(uint32_t node, uint32_t checkpoint, uint32_t parent)
+  {
+    ScopeNode &scopeNode(nodes_[node]);
+    scopeNode.checkpoint_ = checkpoint;
+    scopeNode.parent_ = parent;
+    scopeNode.firstChild_ = INVALID_NODE;
+    scopeNode.nextSibling_ = INVALID_NODE;
+    scopeNode.calls_ = 0;
+    scopeNode.inclusiveCycles_ = 0;
+    scopeNode.childCycles_ = 0;
+  }
+
+  // returns INVALID_NODE if all the nodes are used
+  inline uint32_t findOrAddChild(uint32_t parent, uint32_t checkpoint)
+  {
+    for(uint32_t child = nodes_[parent].firstChild_; child != INVALID_NODE; child = nodes_[child].nextSibling_)
+    {
+      if(nodes_[child].checkpoint_ == checkpoint)
+      {
+        return child;
+      }
+    }
+
+    if(numNodes_ >= maxNodes_)
+    {
+      return INVALID_NODE;
+    }
+
+    // The node is published before it is linked in
+    uint32_t child(numNodes_);
+    initNode(child, checkpoint, parent);
+    nodes_[child].nextSibling_ = nodes_[parent].firstChild_;
+    __atomic_store_n(&numNodes_, numNodes_ + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&(nodes_[parent].firstChild_), child, __ATOMIC_RELEASE);
+
+    return child;
+  }
+
+  void mergeNode(const vector<ScopeNode> &nodes, uint32_t fromNode, uint32_t toNode)
+  {
+    for(uint32_t fromChild = nodes[fromNode].firstChild_;
+        fromChild != INVALID_NODE && fromChild < nodes.size();
+        fromChild = nodes[fromChild].nextSibling_)
+    {
+      uint32_t toChild(findOrAddChild(toNode, nodes[fromChild].checkpoint_));
+      if(toChild == INVALID_NODE)
+      {
+        numDropped_ += nodes[fromChild].calls_;
+        continue;
+      }
+      nodes_[toChild].calls_           += nodes[fromChild].calls_;
+      nodes_[toChild].inclusiveCycles_ += nodes[fromChild].inclusiveCycles_;
+      nodes_[toChild].childCycles_     += nodes[fromChild].childCycles_;
+      mergeNode(nodes, fromChild, toChild);
+    }
+  }
+
+  ScopeNode *nodes_;
+  ScopeFrame *stack_;
+  uint32_t maxNodes_;
+  uint32_t maxDepth_;
+  uint32_t numNodes_;
+  uint32_t depth_;
+  uint64_t numDropped_;
+};
+
+#endif // SCOPE_TREE_H
@@ -0,0 +1,82 @@
+#ifndef SEGMENT_STATS_H
+#define SEGMENT_STATS_H
+
+#include <math.h>   // sqrt()
+#include <stdint.h> // uint32_t et al
+
+//
+// SegmentStats
+//
+// The streaming count, min, max, mean and variance of a checkpoint's
+// segment times. The mean and the sum of squared differences from it (M2)
+// are updated with Welford's algorithm, which unlike a sum of squares does
+// not lose the variance to cancellation when the times are large and close.
+//
+// Two SegmentStats are combined with merge(), the parallel form of the
+// update from Chan et al., so the per-thread stats can be reduced in any
+// order. Merging them pairwise, as Checkpoint::dump() does, also keeps the
+// rounding error growing with the log of the number of threads.
+//
+// Zeroed memory is a valid empty SegmentStats, as in the stats segment.
+//
+
+class SegmentStats
+{
+public:
+  SegmentStats() : count_(0), min_(0), max_(0), mean_(0.0), m2_(0.0) {}
+  // From the fields of a snapshot, see "CheckpointSnapshot.h"
+  SegmentStats(uint64_t count, uint64_t min, uint64_t max, double mean, double m2) :
+    count_(count), min_(min), max_(max), mean_(mean), m2_(m2) {}
+
+  inline void record(uint64_t value)
+  {
+    ++count_;
+    if(value < min_ || count_ == 1) { min_ = value; }
+    if(value > max_) { max_ = value; }
+    double delta(value - mean_);
+    mean_ += delta / count_;
+    m2_ += delta * (value - mean_);
+  }
+
+  void merge(const SegmentStats &rhs)
+  {
+    if(this == &rhs || rhs.count_ == 0) { return; }
+    if(count_ == 0)
+    {
+      *this = rhs;
+      return;
+    }
+
+    uint64_t count(count_ + rhs.count_);
+    double delta(rhs.mean_ - mean_);
+    double rhsShare((double) rhs.count_ / count);
+    mean_ += delta * rhsShare;
+    m2_ += rhs.m2_ + delta * delta * count_ * rhsShare;
+    count_ = count;
+    if(rhs.min_ < min_) { min_ = rhs.min_; }
+    if(rhs.max_ > max_) { max_ = rhs.max_; }
+  }
+
+  inline uint64_t getCount() const { return count_; }
+  inline uint64_t getMin()   const { return min_; }
+  inline uint64_t getMax()   const { return max_; }
+  inline double   getMean()  const { return mean_; }
+  inline double   getM2()    const { return m2_; }
+
+  // The sample variance, 0 with less than 2 values
+  inline double getVariance() const
+  {
+    return (count_ < 2 ? 0.0 : m2_ / (count_ - 1));
+  }
+
+  inline double getStdDev() const { return sqrt(getVariance()); }
+
+private:
+  uint64_t count_;
+  uint64_t min_;
+  uint64_t max_;
+  double mean_;
+  double m2_;
+};
+
+#endif // SEGMENT_STATS_H
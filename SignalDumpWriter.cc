@@ -0,0 +1,108 @@
+
+#include <errno.h>
+#include <unistd.h> // write()
+
+#include "SignalDumpWriter.h"
+
+SignalDumpWriter::SignalDumpWriter(int fd, char *buffer, uint32_t bufferSize) :
+    fd_(fd),
+    buffer_(buffer),
+    bufferSize_(bufferSize),
+    length_(0),
+    failed_(false)
+{
+}
+
+SignalDumpWriter::~SignalDumpWriter()
+{
+  flush();
+}
+
+SignalDumpWriter &SignalDumpWriter::operator<<(const char *str)
+{
+  uint32_t length(0);
+  while(str[length] != '\0')
+  {
+    ++length;
+  }
+  append(str, length);
+
+  return *this;
+}
+
+SignalDumpWriter &SignalDumpWriter::operator<<(const string &str)
+{
+  append(str.data(), str.size());
+
+  return *this;
+}
+
+// The digits are formatted backwards, from the lowest one
+SignalDumpWriter &SignalDumpWriter::operator<<(uint64_t value)
+{
+  char digits[20];
+  uint32_t numDigits(0);
+  do
+  {
+    digits[sizeof(digits) - ++numDigits] = '0' + (value % 10);
+    value /= 10;
+  } while(value != 0);
+  append(digits + sizeof(digits) - numDigits, numDigits);
+
+  return *this;
+}
+
+SignalDumpWriter &SignalDumpWriter::operator<<(uint32_t value)
+{
+  return *this << (uint64_t) value;
+}
+
+SignalDumpWriter &SignalDumpWriter::operator<<(int value)
+{
+  if(value < 0)
+  {
+    append("-", 1);
+    return *this << (uint64_t) -(int64_t) value;
+  }
+
+  return *this << (uint64_t) value;
+}
+
+void SignalDumpWriter::flush()
+{
+  uint32_t written(0);
+  while(written < length_ && !failed_)
+  {
+    ssize_t retval(write(fd_, buffer_ + written, length_ - written));
+    if(retval < 0)
+    {
+      if(errno != EINTR)
+      {
+        failed_ = true;
+      }
+      continue;
+    }
+    written += retval;
+  }
+  length_ = 0;
+}
+
+// private
+void SignalDumpWriter::append(const char *data, uint32_t length)
+{
+  while(length > 0)
+  {
+    if(length_ == bufferSize_)
+    {
+      flush();
+    }
+    uint32_t chunk(bufferSize_ - length_ < length ? bufferSize_ - length_ : length);
+    for(uint32_t i = 0; i < chunk; ++i)
+    {
+      buffer_[length_ + i] = data[i];
+    }
+    length_ += chunk;
+    data += chunk;
+    length -= chunk;
+  }
+}
@@ -0,0 +1,50 @@
+#ifndef SIGNAL_DUMP_WRITER_H
+#define SIGNAL_DUMP_WRITER_H
+
+#include <string>
+
+#include <stdint.h> // uint32_t et al
+
+using namespace std;
+
+//
+// SignalDumpWriter
+//
+// Formats text into a caller-provided buffer and writes it to a file
+// descriptor with write() when the buffer is full, or when flushed. Only
+// async-signal-safe calls are made, nothing is allocated and no locks are
+// taken, so it can be used from a signal handler, where iostreams and
+// printf() can not. Integers only, the doubles are left to the callers.
+//
+// Write errors are not reported, the rest of the output is dropped.
+//
+class SignalDumpWriter
+{
+public:
+  SignalDumpWriter(int fd, char *buffer, uint32_t bufferSize);
+  // Flushes the buffer
+  ~SignalDumpWriter();
+
+  SignalDumpWriter &operator<<(const char *str);
+  SignalDumpWriter &operator<<(const string &str);
+  SignalDumpWriter &operator<<(uint64_t value);
+  SignalDumpWriter &operator<<(uint32_t value);
+  SignalDumpWriter &operator<<(int value);
+
+  // Writes the buffer, retrying the partial and interrupted writes
+  void flush();
+
+private:
+  SignalDumpWriter();
+  SignalDumpWriter(const SignalDumpWriter &);
+
+  void append(const char *data, uint32_t length);
+
+  int fd_;
+  char *buffer_;
+  uint32_t bufferSize_;
+  uint32_t length_;
+  bool failed_;
+};
+
+#endif // SIGNAL_DUMP_WRITER_H
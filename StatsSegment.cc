@@ -0,0 +1,232 @@
+
+#include <iostream>
+
+#include <errno.h>
+#include <fcntl.h>    // O_* constants
+#include <string.h>   // memcpy, strerror()
+#include <unistd.h>   // ftruncate(), getpid()
+#include <sys/mman.h> // shm_open(), mmap()
+#include <sys/stat.h> // fstat()
+
+#include "StatsSegment.h"
+
+using namespace std;
+
+static const uint64_t STATS_SEGMENT_ALIGNMENT = 64;
+
+static inline uint64_t alignOffset(uint64_t offset)
+{
+  return ((offset + STATS_SEGMENT_ALIGNMENT - 1) / STATS_SEGMENT_ALIGNMENT) * STATS_SEGMENT_ALIGNMENT;
+}
+
+//
+// StatsSegment
+//
+
+StatsSegment::StatsSegment(const string &name, const StatsSegmentHeader &layout) :
+    name_(name),
+    segment_(NULL),
+    segmentSize_(0),
+    header_(NULL)
+{
+  StatsSegmentHeader header(layout);
+  memcpy(header.magic_, STATS_SEGMENT_MAGIC, sizeof(header.magic_));
+  header.version_           = STATS_SEGMENT_VERSION;
+  header.headerSize_        = sizeof(StatsSegmentHeader);
+  header.pid_               = getpid();
+  header.numNames_          = 0;
+  header.maxNames_          = layout.maxNames_;
+  header.namesOffset_       = alignOffset(sizeof(StatsSegmentHeader));
+  header.threadTableOffset_ = alignOffset(header.namesOffset_ + header.maxNames_ * sizeof(StatsSegmentName));
+  header.checkpointsOffset_ = alignOffset(header.threadTableOffset_ + (uint64_t) header.numThreadSlots_ * header.threadStride_);
+  header.checkpointsStride_ = alignOffset((uint64_t) header.numCheckpoints_ * header.checkpointSize_);
+  segmentSize_ = header.checkpointsOffset_ + (uint64_t) header.numThreadSlots_ * header.checkpointsStride_;
+
+  int fd(shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644));
+  if(fd < 0)
+  {
+    cout << "NOTICE: could not create shared-memory stats segment [" << name
+         << "]: " << strerror(errno) << ", using private memory instead"
+         << endl;
+    return;
+  }
+
+  if(ftruncate(fd, segmentSize_) != 0)
+  {
+    cout << "NOTICE: could not size shared-memory stats segment [" << name
+         << "]: " << strerror(errno) << ", using private memory instead"
+         << endl;
+    close(fd);
+    shm_unlink(name.c_str());
+    return;
+  }
+
+  void *segment(mmap(NULL, segmentSize_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+  close(fd);
+  if(segment == MAP_FAILED)
+  {
+    cout << "NOTICE: could not map shared-memory stats segment [" << name
+         << "]: " << strerror(errno) << ", using private memory instead"
+         << endl;
+    shm_unlink(name.c_str());
+    return;
+  }
+
+  // The segment is zero filled, the magic is stored last so a reader
+  // never sees a valid magic with an incomplete header
+  segment_ = (char*) segment;
+  header_ = (StatsSegmentHeader*) segment_;
+  memcpy(header_, &header, sizeof(header));
+  memset(header_->magic_, 0, sizeof(header_->magic_));
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(header_->magic_, STATS_SEGMENT_MAGIC, sizeof(header_->magic_));
+}
+
+StatsSegment::~StatsSegment()
+{
+  if(segment_ != NULL)
+  {
+    munmap(segment_, segmentSize_);
+    shm_unlink(name_.c_str());
+  }
+}
+
+void StatsSegment::addName(uint32_t checkpoint, const string &name)
+{
+  uint32_t numNames(header_->numNames_);
+  if(numNames >= header_->maxNames_)
+  {
+    return;
+  }
+
+  StatsSegmentName *segmentName((StatsSegmentName*) (segment_ + header_->namesOffset_) + numNames);
+  segmentName->checkpoint_ = checkpoint;
+  size_t nameLength(name.size() < sizeof(segmentName->name_) ? name.size() : sizeof(segmentName->name_) - 1);
+  memcpy(segmentName->name_, name.data(), nameLength);
+  segmentName->name_[nameLength] = '\0';
+
+  __atomic_store_n(&header_->numNames_, numNames + 1, __ATOMIC_RELEASE);
+}
+
+//
+// StatsSegmentReader
+//
+
+StatsSegmentReader::StatsSegmentReader(const string &name) :
+    segment_(NULL),
+    segmentSize_(0),
+    header_(NULL)
+{
+  int fd(shm_open(name.c_str(), O_RDONLY, 0));
+  if(fd < 0)
+  {
+    errorStr_ = string("could not open shared-memory stats segment: ") + strerror(errno);
+    return;
+  }
+
+  struct stat segmentStat;
+  if(fstat(fd, &segmentStat) != 0 || segmentStat.st_size < (off_t) sizeof(StatsSegmentHeader))
+  {
+    errorStr_ = "shared-memory stats segment is too short";
+    close(fd);
+    return;
+  }
+  segmentSize_ = segmentStat.st_size;
+
+  void *segment(mmap(NULL, segmentSize_, PROT_READ, MAP_SHARED, fd, 0));
+  close(fd);
+  if(segment == MAP_FAILED)
+  {
+    errorStr_ = string("could not map shared-memory stats segment: ") + strerror(errno);
+    return;
+  }
+  segment_ = (const char*) segment;
+
+  const StatsSegmentHeader *header((const StatsSegmentHeader*) segment_);
+  if(memcmp(header->magic_, STATS_SEGMENT_MAGIC, sizeof(header->magic_)) != 0)
+  {
+    errorStr_ = "not a stats segment, or it is still being created";
+    return;
+  }
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if(header->version_ != STATS_SEGMENT_VERSION || header->headerSize_ != sizeof(StatsSegmentHeader))
+  {
+    errorStr_ = "unsupported stats segment version";
+    return;
+  }
+  if(header->checkpointSize_ < sizeof(StatsCounters) ||
+     header->sequenceOffset_ + sizeof(uint32_t) > header->threadStride_ ||
+     header->lastCheckpointOffset_ + sizeof(uint32_t) > header->threadStride_ ||
+     header->namesOffset_ + (uint64_t) header->maxNames_ * sizeof(StatsSegmentName) > segmentSize_ ||
+     header->threadTableOffset_ + (uint64_t) header->numThreadSlots_ * header->threadStride_ > segmentSize_ ||
+     (uint64_t) header->numCheckpoints_ * header->checkpointSize_ > header->checkpointsStride_ ||
+     header->checkpointsOffset_ + (uint64_t) header->numThreadSlots_ * header->checkpointsStride_ > segmentSize_)
+  {
+    errorStr_ = "stats segment layout does not fit in the segment";
+    return;
+  }
+
+  header_ = header;
+}
+
+StatsSegmentReader::~StatsSegmentReader()
+{
+  if(segment_ != NULL)
+  {
+    munmap((void*) segment_, segmentSize_);
+  }
+}
+
+bool StatsSegmentReader::readThread(uint32_t slot, vector<StatsCounters> &counters) const
+{
+  if(slot >= header_->numThreadSlots_)
+  {
+    return false;
+  }
+
+  const uint32_t *sequence((const uint32_t*) (segment_ + header_->threadTableOffset_ +
+                                              (uint64_t) slot * header_->threadStride_ +
+                                              header_->sequenceOffset_));
+  const char *checkpoints(segment_ + header_->checkpointsOffset_ + (uint64_t) slot * header_->checkpointsStride_);
+  counters.resize(header_->numCheckpoints_);
+
+  // Same protocol as Checkpoint::getThreadCpInfoSnapshot()
+  const int MAX_RETRIES(10000);
+  for(int retries = 0; retries < MAX_RETRIES; ++retries)
+  {
+    uint32_t sequenceBefore(__atomic_load_n(sequence, __ATOMIC_ACQUIRE));
+    for(uint32_t chkPoint = 0; chkPoint < header_->numCheckpoints_; ++chkPoint)
+    {
+      memcpy(&(counters[chkPoint]), checkpoints + (uint64_t) chkPoint * header_->checkpointSize_, sizeof(StatsCounters));
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint32_t sequenceAfter(__atomic_load_n(sequence, __ATOMIC_RELAXED));
+
+    if(!header_->useLocking_ || ((sequenceBefore & 1) == 0 && sequenceBefore == sequenceAfter))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+string StatsSegmentReader::getCheckpointName(uint32_t checkpoint) const
+{
+  uint32_t numNames(__atomic_load_n(&header_->numNames_, __ATOMIC_ACQUIRE));
+  if(numNames > header_->maxNames_)
+  {
+    numNames = header_->maxNames_;
+  }
+
+  const StatsSegmentName *names((const StatsSegmentName*) (segment_ + header_->namesOffset_));
+  for(uint32_t i = 0; i < numNames; ++i)
+  {
+    if(names[i].checkpoint_ == checkpoint)
+    {
+      return string(names[i].name_, strnlen(names[i].name_, sizeof(names[i].name_)));
+    }
+  }
+
+  return string();
+}
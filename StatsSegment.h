@@ -0,0 +1,150 @@
+#ifndef STATS_SEGMENT_H
+#define STATS_SEGMENT_H
+
+#include <string>
+#include <vector>
+
+#include <stdint.h> // uint32_t et al
+
+using namespace std;
+
+//
+// Shared-memory stats segment layout, version 1
+//
+// A named POSIX shared-memory object holding the live per-thread
+// counters, so they can be read by another process (see lipTopMain.cc)
+// without signals, locks or pausing the profiled threads.
+// All fields are in host byte order, all offsets are from the start
+// of the segment.
+//
+// StatsSegmentHeader, at offset 0
+//
+// StatsSegmentName x maxNames_, at namesOffset_
+//   Only the first numNames_ are valid, numNames_ is stored after the
+//   name is written.
+//
+// Thread slot x numThreadSlots_, at threadTableOffset_, threadStride_ bytes each
+//   The last slot is shared by the threads registered beyond the number
+//   of threads configured. Each slot has a uint32_t sequence lock at
+//   sequenceOffset_, which is odd while the thread is updating its
+//   counters, and the uint32_t last checkpoint hit at lastCheckpointOffset_.
+//   The rest of the slot is private to the profiler.
+//
+// Checkpoint array x numThreadSlots_, at checkpointsOffset_, checkpointsStride_ bytes each
+//   numCheckpoints_ entries of checkpointSize_ bytes each, the first 2
+//   fields of an entry are the uint64_t iterations and the uint64_t
+//   total cycles. Cycles are converted with nanosPerCycle_.
+//
+
+typedef struct StatsSegmentHeader_s {
+  char     magic_[8];              // STATS_SEGMENT_MAGIC, not NULL terminated
+  uint32_t version_;               // STATS_SEGMENT_VERSION
+  uint32_t headerSize_;            // sizeof(StatsSegmentHeader)
+  uint32_t pid_;                   // of the profiled process
+  uint32_t clockSource_;           // Checkpoint::ClockSource
+  double   nanosPerCycle_;
+  uint32_t useLocking_;            // if 0 the sequence locks are never taken
+  uint32_t numThreadSlots_;
+  uint32_t threadTableOffset_;
+  uint32_t threadStride_;
+  uint32_t sequenceOffset_;
+  uint32_t lastCheckpointOffset_;
+  uint64_t checkpointsOffset_;
+  uint32_t checkpointsStride_;
+  uint32_t checkpointSize_;
+  uint32_t numCheckpoints_;        // per thread slot, fixed for the life of the segment
+  uint32_t namesOffset_;
+  uint32_t maxNames_;
+  uint32_t numNames_;
+} StatsSegmentHeader;
+
+typedef struct StatsSegmentName_s {
+  uint32_t checkpoint_;
+  char     name_[60];              // NULL terminated, truncated if longer
+} StatsSegmentName;
+
+// The first 2 fields of a checkpoint entry
+typedef struct StatsCounters_s {
+  uint64_t iterations_;
+  uint64_t totalCycles_;
+} StatsCounters;
+
+static const char STATS_SEGMENT_MAGIC[8] = {'L', 'I', 'P', 'S', 'T', 'A', 'T', 'S'};
+static const uint32_t STATS_SEGMENT_VERSION = 1;
+
+//
+// StatsSegment
+//
+// The profiler side: creates the segment and hands out the memory for
+// the thread table and the checkpoint arrays. The segment is removed
+// when the StatsSegment is destroyed.
+//
+class StatsSegment
+{
+public:
+  // The layout fields of the header that describe a thread slot and a
+  // checkpoint entry are taken from layout, the rest are filled in here
+  StatsSegment(const string &name, const StatsSegmentHeader &layout);
+  ~StatsSegment();
+
+  // false if the segment could not be created
+  inline bool isOpen() const { return header_ != NULL; }
+
+  inline const string &getName() const { return name_; }
+  inline uint32_t getNumCheckpoints() const { return header_->numCheckpoints_; }
+
+  inline void *getThreadTable() { return segment_ + header_->threadTableOffset_; }
+  inline void *getCheckpoints(uint32_t slot) {
+    return segment_ + header_->checkpointsOffset_ + (uint64_t) slot * header_->checkpointsStride_;
+  }
+
+  // Publishes the name of a named checkpoint, names beyond maxNames_ are ignored.
+  // Only one thread at a time may add names.
+  void addName(uint32_t checkpoint, const string &name);
+
+private:
+  StatsSegment();
+  StatsSegment(const StatsSegment &);
+
+  string name_;
+  char *segment_;
+  uint64_t segmentSize_;
+  StatsSegmentHeader *header_;
+};
+
+//
+// StatsSegmentReader
+//
+// The viewer side: maps an existing segment read-only
+//
+class StatsSegmentReader
+{
+public:
+  StatsSegmentReader(const string &name);
+  ~StatsSegmentReader();
+
+  // false if the segment could not be opened or is not a valid segment
+  inline bool isOpen() const { return header_ != NULL; }
+  inline const string &getErrorStr() const { return errorStr_; }
+
+  inline const StatsSegmentHeader &getHeader() const { return *header_; }
+
+  // Copies the counters of a thread slot, consistent with respect to the
+  // slot's sequence lock. Returns false if a consistent copy could not
+  // be taken, which can happen on the shared overflow slot.
+  bool readThread(uint32_t slot, vector<StatsCounters> &counters) const;
+
+  // Returns the name of a named checkpoint, or an empty string
+  string getCheckpointName(uint32_t checkpoint) const;
+
+private:
+  StatsSegmentReader();
+  StatsSegmentReader(const StatsSegmentReader &);
+
+  string errorStr_;
+  const char *segment_;
+  uint64_t segmentSize_;
+  const StatsSegmentHeader *header_;
+};
+
+#endif // STATS_SEGMENT_H
@@ -0,0 +1,58 @@
+
+#include <errno.h>
+#include <string.h>     // memset(), strerror()
+#include <unistd.h>     // close(), sysconf()
+#include <sys/mman.h>   // mmap()
+#include <sys/syscall.h>
+
+#include "ThreadCpuClock.h"
+
+using namespace std;
+
+ThreadCpuClock::ThreadCpuClock() :
+    fd_(-1),
+    page_(NULL),
+    syncLock_(0),
+    syncCpuNanos_(0),
+    syncWallNanos_(0),
+    previousCpuNanos_(readCpuNanos())
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size   = sizeof(attr);
+  attr.type   = PERF_TYPE_SOFTWARE;
+  attr.config = PERF_COUNT_SW_TASK_CLOCK;
+
+  // This thread, on any CPU
+  fd_ = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  if(fd_ < 0)
+  {
+    errorStr_ = string("perf_event_open() failed: ") + strerror(errno);
+    return;
+  }
+
+  void *page(mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd_, 0));
+  if(page == MAP_FAILED)
+  {
+    errorStr_ = string("could not map the perf event: ") + strerror(errno);
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+  page_ = (volatile perf_event_mmap_page*) page;
+
+  // So the first read resyncs
+  syncLock_ = page_->lock + 1;
+}
+
+ThreadCpuClock::~ThreadCpuClock()
+{
+  if(page_ != NULL)
+  {
+    munmap((void*) page_, sysconf(_SC_PAGESIZE));
+  }
+  if(fd_ >= 0)
+  {
+    close(fd_);
+  }
+}
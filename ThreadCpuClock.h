@@ -0,0 +1,91 @@
+#ifndef THREAD_CPU_CLOCK_H
+#define THREAD_CPU_CLOCK_H
+
+#include <string>
+
+#include <stdint.h> // uint32_t et al
+#include <time.h>   // clock_gettime()
+#include <linux/perf_event.h>
+
+using namespace std;
+
+//
+// ThreadCpuClock
+//
+// The on-CPU time of the calling thread, read alongside the wall clock.
+//
+// CLOCK_THREAD_CPUTIME_ID is a system call, which would cost more than the
+// checkpoint itself. But while a thread is not switched out, its on-CPU
+// time advances exactly like the wall clock. So the clock opens a perf
+// task-clock event for the thread, only to watch the sequence lock of its
+// mmap page, which the kernel updates when the thread is switched in or
+// out. While the lock is unchanged, the on-CPU time is extrapolated from
+// the wall clock, and the system call is only made to resync after a
+// switch, in the segments that were off-CPU.
+//
+// If the event can't be opened or mapped, every read is a system call.
+// Only the thread that created the clock may read it.
+//
+
+class ThreadCpuClock
+{
+public:
+  // For the calling thread, check usesSwitchDetection()
+  ThreadCpuClock();
+  ~ThreadCpuClock();
+
+  inline bool usesSwitchDetection() const { return page_ != NULL; }
+  inline const string &getErrorStr() const { return errorStr_; }
+
+  // Returns the on-CPU nanoseconds since the previous call, or since the
+  // clock was created, given the wall clock nanoseconds read just before
+  inline uint64_t getDeltaNanos(uint64_t wallNanos)
+  {
+    uint64_t cpuNanos;
+    if(page_ != NULL && page_->lock == syncLock_)
+    {
+      cpuNanos = syncCpuNanos_ + (wallNanos - syncWallNanos_);
+    }
+    else
+    {
+      if(page_ != NULL)
+      {
+        syncLock_ = page_->lock;
+      }
+      cpuNanos = readCpuNanos();
+      syncCpuNanos_ = cpuNanos;
+      syncWallNanos_ = wallNanos;
+    }
+
+    // The extrapolation may get ahead of the thread's clock, for example
+    // when the hypervisor preempts the virtual CPU, the delta is then 0
+    uint64_t deltaNanos(cpuNanos > previousCpuNanos_ ? cpuNanos - previousCpuNanos_ : 0);
+    if(cpuNanos > previousCpuNanos_)
+    {
+      previousCpuNanos_ = cpuNanos;
+    }
+
+    return deltaNanos;
+  }
+
+private:
+  ThreadCpuClock(const ThreadCpuClock &);
+  ThreadCpuClock &operator=(const ThreadCpuClock &);
+
+  static inline uint64_t readCpuNanos()
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return ((now.tv_sec * (uint64_t)1000000000) + now.tv_nsec);
+  }
+
+  int fd_;
+  volatile perf_event_mmap_page *page_;
+  uint32_t syncLock_;
+  uint64_t syncCpuNanos_;
+  uint64_t syncWallNanos_;
+  uint64_t previousCpuNanos_;
+  string errorStr_;
+};
+
+#endif // THREAD_CPU_CLOCK_H
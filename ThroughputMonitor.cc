@@ -0,0 +1,296 @@
+#include <iostream>
+
+#include <errno.h>
+#include <math.h>   // exp()
+#include <string.h> // strerror()
+#include <time.h>   // clock_gettime()
+
+#include "LowImpactProfiler.h"
+#include "ThroughputMonitor.h"
+
+using namespace std;
+
+const uint32_t ThroughputMonitor::NUM_EWMA;
+const uint32_t ThroughputMonitor::EWMA_SECONDS[NUM_EWMA] = {1, 10, 60};
+const uint32_t ThroughputMonitor::ALL_THREADS;
+
+ThroughputMonitor::ThroughputMonitor(Checkpoint *profiler, uint32_t bucketMillis, uint32_t numBuckets) :
+    profiler_(profiler),
+    bucketMillis_(bucketMillis > 0 ? bucketMillis : 1),
+    numBuckets_(numBuckets > 0 ? numBuckets : 1),
+    previousCycles_(profiler_->getCycles()),
+    numUpdates_(0),
+    bucketIndex_(0),
+    isRunning_(false),
+    stopMonitor_(false)
+{
+  pthread_mutex_init(&ratesLock_, NULL);
+  pthread_mutex_init(&stopLock_, NULL);
+  pthread_condattr_t conditionAttr;
+  pthread_condattr_init(&conditionAttr);
+  pthread_condattr_setclock(&conditionAttr, CLOCK_MONOTONIC);
+  pthread_cond_init(&stopCondition_, &conditionAttr);
+  pthread_condattr_destroy(&conditionAttr);
+
+  int retval(pthread_create(&monitorThread_, NULL, monitorEntryPoint, this));
+  if(retval != 0)
+  {
+    cout << "NOTICE: could not create the throughput monitor thread: " << strerror(retval)
+         << ", throughput monitoring disabled"
+         << endl;
+    return;
+  }
+  isRunning_ = true;
+}
+
+ThroughputMonitor::~ThroughputMonitor()
+{
+  stop();
+  pthread_cond_destroy(&stopCondition_);
+  pthread_mutex_destroy(&stopLock_);
+  pthread_mutex_destroy(&ratesLock_);
+}
+
+void ThroughputMonitor::stop()
+{
+  if(!isRunning_)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&stopLock_);
+  stopMonitor_ = true;
+  pthread_cond_signal(&stopCondition_);
+  pthread_mutex_unlock(&stopLock_);
+
+  pthread_join(monitorThread_, NULL);
+  isRunning_ = false;
+}
+
+uint64_t ThroughputMonitor::getThroughput(vector<ThroughputInfo> &throughput)
+{
+  throughput.clear();
+
+  pthread_mutex_lock(&ratesLock_);
+  copyRates(ALL_THREADS, allThreads_, throughput);
+  for(uint32_t slot = 0; slot < threads_.size(); ++slot)
+  {
+    copyRates(slot, threads_[slot], throughput);
+  }
+  uint64_t numUpdates(numUpdates_);
+  pthread_mutex_unlock(&ratesLock_);
+
+  return numUpdates;
+}
+
+// static private
+void *ThroughputMonitor::monitorEntryPoint(void *monitor)
+{
+  ((ThroughputMonitor*) monitor)->run();
+  return NULL;
+}
+
+// private
+// The wake-up times are advanced from the previous one, so the buckets
+// don't drift by the time it takes to update. A partial bucket is not
+// measured when stopping, it would skew the rates.
+void ThroughputMonitor::run()
+{
+  struct timespec wakeUp;
+  clock_gettime(CLOCK_MONOTONIC, &wakeUp);
+
+  pthread_mutex_lock(&stopLock_);
+  while(!stopMonitor_)
+  {
+    wakeUp.tv_sec  += bucketMillis_ / 1000;
+    wakeUp.tv_nsec += (bucketMillis_ % 1000) * 1000000;
+    if(wakeUp.tv_nsec >= 1000000000)
+    {
+      wakeUp.tv_nsec -= 1000000000;
+      ++wakeUp.tv_sec;
+    }
+
+    int retval(0);
+    while(!stopMonitor_ && retval != ETIMEDOUT)
+    {
+      retval = pthread_cond_timedwait(&stopCondition_, &stopLock_, &wakeUp);
+    }
+    if(stopMonitor_)
+    {
+      break;
+    }
+
+    pthread_mutex_unlock(&stopLock_);
+    update();
+    pthread_mutex_lock(&stopLock_);
+  }
+  pthread_mutex_unlock(&stopLock_);
+}
+
+// private
+// All the threads are read under the slot lock, so the iterations of a
+// thread that exits are in its slot or in the retired threads, never in
+// both, and the sum of all the threads never goes back.
+void ThroughputMonitor::update()
+{
+  Checkpoint::ThreadCheckpointInfo snapshot;
+  vector<Checkpoint::CheckpointInfo> checkpoints;
+  vector<vector<uint64_t> > threadIterations;
+  vector<uint64_t> creationCycles;
+  vector<uint64_t> allIterations;
+
+  pthread_mutex_lock(&profiler_->slotLock_);
+
+  uint64_t nowCycles(profiler_->getCycles());
+  uint32_t numThreadsUsed(profiler_->getNumThreadsUsed());
+  threadIterations.resize(numThreadsUsed);
+  creationCycles.resize(numThreadsUsed, 0);
+  for(uint32_t slotIndex = 0; slotIndex <= numThreadsUsed; ++slotIndex)
+  {
+    uint32_t slot(slotIndex < numThreadsUsed ? slotIndex : Checkpoint::RETIRED_SLOT);
+    profiler_->getThreadCpInfoSnapshot(slot, snapshot, checkpoints);
+    if(snapshot.numCheckpoints_ > allIterations.size())
+    {
+      allIterations.resize(snapshot.numCheckpoints_, 0);
+    }
+    for(uint32_t chkPoint = 0; chkPoint < snapshot.numCheckpoints_; ++chkPoint)
+    {
+      allIterations[chkPoint] += checkpoints[chkPoint].iterations_;
+    }
+    if(slot != Checkpoint::RETIRED_SLOT)
+    {
+      threadIterations[slot].resize(snapshot.numCheckpoints_);
+      for(uint32_t chkPoint = 0; chkPoint < snapshot.numCheckpoints_; ++chkPoint)
+      {
+        threadIterations[slot][chkPoint] = checkpoints[chkPoint].iterations_;
+      }
+      creationCycles[slot] = snapshot.creationCycles_;
+    }
+  }
+
+  pthread_mutex_unlock(&profiler_->slotLock_);
+
+  pthread_mutex_lock(&ratesLock_);
+
+  uint64_t elapsedNanos(profiler_->cyclesToNanos(nowCycles - previousCycles_));
+  double elapsedSeconds(elapsedNanos > 0 ? elapsedNanos / 1000000000.0 : bucketMillis_ / 1000.0);
+  updateRates(allThreads_, allIterations, elapsedSeconds);
+
+  // A new thread in a slot starts over, its first bucket from its creation
+  if(numThreadsUsed > threads_.size())
+  {
+    threads_.resize(numThreadsUsed);
+  }
+  for(uint32_t slot = 0; slot < numThreadsUsed; ++slot)
+  {
+    ThreadRates &rates(threads_[slot]);
+    double threadSeconds(elapsedSeconds);
+    if(rates.creationCycles_ != creationCycles[slot])
+    {
+      rates = ThreadRates();
+      rates.creationCycles_ = creationCycles[slot];
+      if(creationCycles[slot] > previousCycles_ && creationCycles[slot] < nowCycles)
+      {
+        uint64_t threadNanos(profiler_->cyclesToNanos(nowCycles - creationCycles[slot]));
+        threadSeconds = (threadNanos > 0 ? threadNanos / 1000000000.0 : elapsedSeconds);
+      }
+    }
+    updateRates(rates, threadIterations[slot], threadSeconds);
+  }
+
+  previousCycles_ = nowCycles;
+  bucketIndex_ = (bucketIndex_ + 1) % numBuckets_;
+  ++numUpdates_;
+
+  pthread_mutex_unlock(&ratesLock_);
+}
+
+// private
+// The EWMAs decay by exp(-elapsed / window) per bucket, so buckets of
+// any length, or late, weigh as much as the time they cover
+void ThroughputMonitor::updateRates(ThreadRates &rates, const vector<uint64_t> &iterations, double elapsedSeconds)
+{
+  if(rates.bucketSeconds_.empty())
+  {
+    rates.bucketSeconds_.resize(numBuckets_, 0.0);
+  }
+  rates.bucketSeconds_[bucketIndex_] = elapsedSeconds;
+  if(iterations.size() > rates.checkpoints_.size())
+  {
+    rates.checkpoints_.resize(iterations.size());
+  }
+
+  double decay[NUM_EWMA];
+  for(uint32_t i = 0; i < NUM_EWMA; ++i)
+  {
+    decay[i] = exp(-elapsedSeconds / EWMA_SECONDS[i]);
+  }
+
+  for(uint32_t chkPoint = 0; chkPoint < rates.checkpoints_.size(); ++chkPoint)
+  {
+    CheckpointRates &cpRates(rates.checkpoints_[chkPoint]);
+    uint64_t currentIterations(chkPoint < iterations.size() ? iterations[chkPoint] : cpRates.iterations_);
+    uint64_t bucketIterations(currentIterations > cpRates.iterations_ ? currentIterations - cpRates.iterations_ : 0);
+    cpRates.iterations_ = currentIterations;
+    double perSec(bucketIterations / elapsedSeconds);
+
+    if(cpRates.buckets_.empty())
+    {
+      if(bucketIterations == 0)
+      {
+        continue;
+      }
+      // The first bucket hit starts the EWMAs
+      cpRates.buckets_.resize(numBuckets_, 0);
+      for(uint32_t i = 0; i < NUM_EWMA; ++i)
+      {
+        cpRates.ewmaPerSec_[i] = perSec;
+      }
+    }
+    else
+    {
+      for(uint32_t i = 0; i < NUM_EWMA; ++i)
+      {
+        cpRates.ewmaPerSec_[i] = perSec + decay[i] * (cpRates.ewmaPerSec_[i] - perSec);
+      }
+    }
+    cpRates.buckets_[bucketIndex_] = bucketIterations;
+  }
+}
+
+// private
+void ThroughputMonitor::copyRates(uint32_t slot, const ThreadRates &rates, vector<ThroughputInfo> &throughput) const
+{
+  double windowSeconds(0.0);
+  for(uint32_t bucket = 0; bucket < rates.bucketSeconds_.size(); ++bucket)
+  {
+    windowSeconds += rates.bucketSeconds_[bucket];
+  }
+
+  for(uint32_t chkPoint = 0; chkPoint < rates.checkpoints_.size(); ++chkPoint)
+  {
+    const CheckpointRates &cpRates(rates.checkpoints_[chkPoint]);
+    if(cpRates.buckets_.empty())
+    {
+      continue;
+    }
+
+    uint64_t windowIterations(0);
+    for(uint32_t bucket = 0; bucket < numBuckets_; ++bucket)
+    {
+      windowIterations += cpRates.buckets_[bucket];
+    }
+
+    ThroughputInfo info;
+    info.slot_ = slot;
+    info.checkpoint_ = chkPoint;
+    info.iterations_ = cpRates.iterations_;
+    for(uint32_t i = 0; i < NUM_EWMA; ++i)
+    {
+      info.ewmaPerSec_[i] = cpRates.ewmaPerSec_[i];
+    }
+    info.windowPerSec_ = (windowSeconds > 0.0 ? windowIterations / windowSeconds : 0.0);
+    info.windowSeconds_ = windowSeconds;
+    throughput.push_back(info);
+  }
+}
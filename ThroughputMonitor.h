@@ -0,0 +1,126 @@
+#ifndef THROUGHPUT_MONITOR_H
+#define THROUGHPUT_MONITOR_H
+
+#include <vector>
+
+#include <pthread.h>
+#include <stdint.h> // uint32_t et al
+
+using namespace std;
+
+class Checkpoint;
+
+//
+// ThroughputMonitor
+//
+// A thread that wakes up every bucketMillis and reads the iterations of
+// every thread and checkpoint, with the per-thread sequence locks, so the
+// checkpointing threads never wait on it. From the iterations of each
+// bucket it keeps the current rates, per thread and checkpoint, and per
+// checkpoint for all the threads together:
+//
+// - exponentially weighted moving averages over 1, 10 and 60 seconds, like
+//   the load averages. They start at the rate of the first bucket, not at 0.
+// - the rate over a sliding window of the last numBuckets buckets
+//
+// getThroughput() copies the rates at any time. A slot reused by a new
+// thread starts its rates over, the threads that exited are only counted
+// in the rates of all the threads. The EWMA over 1 second is only
+// meaningful with buckets of 1 second or less.
+//
+class ThroughputMonitor
+{
+public:
+  static const uint32_t NUM_EWMA=3;
+  // The EWMA windows, in seconds: 1, 10 and 60
+  static const uint32_t EWMA_SECONDS[NUM_EWMA];
+  // The slot of the rates of all the threads together
+  static const uint32_t ALL_THREADS=0xfffffffe;
+
+  // The rates of a checkpoint, in iterations per second
+  typedef struct ThroughputInfo_s {
+    // A thread slot, or ALL_THREADS
+    uint32_t slot_;
+    uint32_t checkpoint_;
+    // Since the thread was created, for ALL_THREADS since the profiler was
+    uint64_t iterations_;
+    // By EWMA_SECONDS
+    double ewmaPerSec_[NUM_EWMA];
+    double windowPerSec_;
+    // The time the window covers, less than numBuckets buckets until it is full
+    double windowSeconds_;
+  } ThroughputInfo;
+
+  ThroughputMonitor(Checkpoint *profiler, uint32_t bucketMillis, uint32_t numBuckets);
+  // Stops the monitor if stop() wasn't called
+  ~ThroughputMonitor();
+
+  // false if the thread could not be started
+  inline bool isRunning() const { return isRunning_; }
+
+  // Waits for the thread to exit, the rates are kept
+  void stop();
+
+  // Copies the rates of the checkpoints hit, those of all the threads
+  // first, then per thread slot. Returns the number of buckets measured
+  // so far, the rates are empty until the first one.
+  uint64_t getThroughput(vector<ThroughputInfo> &throughput);
+
+  inline uint32_t getBucketMillis() const { return bucketMillis_; }
+  inline uint32_t getNumBuckets() const { return numBuckets_; }
+
+private:
+  ThroughputMonitor();
+  ThroughputMonitor(const ThroughputMonitor &);
+
+  // The rates of a checkpoint, buckets_ is allocated on the first hit
+  typedef struct CheckpointRates_s {
+    uint64_t iterations_;
+    double ewmaPerSec_[NUM_EWMA];
+    vector<uint64_t> buckets_;
+    CheckpointRates_s() : iterations_(0) {
+      for(uint32_t i = 0; i < NUM_EWMA; ++i) {
+        ewmaPerSec_[i] = 0.0;
+      }
+    }
+  } CheckpointRates;
+
+  // The rates of all the checkpoints of a thread, or of all the threads.
+  // bucketSeconds_ is the length of each bucket in the window, 0 for
+  // those before the thread was created.
+  typedef struct ThreadRates_s {
+    uint64_t creationCycles_;
+    vector<double> bucketSeconds_;
+    vector<CheckpointRates> checkpoints_;
+    ThreadRates_s() : creationCycles_(0) {}
+  } ThreadRates;
+
+  static void *monitorEntryPoint(void *monitor);
+  void run();
+  // Reads the iterations and updates the rates with the bucket that ends now
+  void update();
+  // Adds a bucket of elapsedSeconds to rates, with the iterations read
+  void updateRates(ThreadRates &rates, const vector<uint64_t> &iterations, double elapsedSeconds);
+  void copyRates(uint32_t slot, const ThreadRates &rates, vector<ThroughputInfo> &throughput) const;
+
+  Checkpoint *profiler_;
+  uint32_t bucketMillis_;
+  uint32_t numBuckets_;
+  uint64_t previousCycles_;
+  uint64_t numUpdates_;
+  // The bucket of the window the next update() fills, the same for all the rates
+  uint32_t bucketIndex_;
+
+  // Written by update() and read by getThroughput() under ratesLock_
+  ThreadRates allThreads_;
+  vector<ThreadRates> threads_;
+  pthread_mutex_t ratesLock_;
+
+  pthread_t monitorThread_;
+  pthread_mutex_t stopLock_;
+  pthread_cond_t stopCondition_;
+  bool isRunning_;
+  bool stopMonitor_;
+};
+
+#endif // THROUGHPUT_MONITOR_H
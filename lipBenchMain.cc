@@ -0,0 +1,361 @@
+/*
+ * lipBenchMain.cc
+ *
+ * lipBench: measures what a CHECKPOINT() costs, per checkpoint and in
+ * aggregate throughput, for 1 to 2x the number of cores threads, in the
+ * profiler modes that change the hot path, against an empty loop baseline.
+ * The results are written as CSV, so runs can be compared to catch
+ * regressions in the hot path.
+ */
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+
+#include <pthread.h>
+#include <stdint.h>  // uint32_t et al
+#include <time.h>    // clock_gettime()
+#include <unistd.h>  // sysconf()
+
+#include <CmdLineParser.h>
+
+#include "LowImpactProfiler.h"
+
+using namespace std;
+
+const string ARG_NUM_CHECKPOINTS = "-n";
+const string ARG_MAX_THREADS     = "-t";
+const string ARG_LIP_CLOCK       = "-c";
+const string ARG_OUTPUT_PATH     = "-o";
+
+struct ConfigInput
+{
+  // Command line options
+  uint32_t numCheckpoints;
+  uint32_t maxThreads;
+  uint32_t lipClock;
+  string outputPath;
+
+  ConfigInput() : numCheckpoints(10000000), maxThreads(0), lipClock(0), outputPath("-") {}
+};
+
+// The profiler modes benchmarked, each is a different path through checkpoint()
+typedef enum {
+  SCENARIO_BASELINE = 0, // the loop without checkpoints
+  SCENARIO_LOCKING,      // useLocking
+  SCENARIO_NO_LOCKING,
+  SCENARIO_INACTIVE,     // setActive(false)
+  SCENARIO_SHARED_SLOT,  // numThreads 0, all the threads share slot 0
+  SCENARIO_DOMAIN,       // useLocking, in a domain instead of the global instance
+  SCENARIO_STATIC,       // StaticCheckpoint, the policies fixed at compile time
+  NUM_SCENARIOS
+} Scenario;
+
+const char *SCENARIO_NAMES[NUM_SCENARIOS] = {
+  "baseline",
+  "locking",
+  "noLocking",
+  "inactive",
+  "sharedSlot",
+  "domain",
+  "static"
+};
+
+// The fastest path: a fixed clock, no locking and the counters only
+#ifdef LIP_HAVE_TSC
+typedef TscClockPolicy StaticClockPolicy;
+#else
+typedef MonotonicRawClockPolicy StaticClockPolicy;
+#endif
+typedef BasicCheckpoint<MultiThreadedPolicy,
+                        StaticClockPolicy,
+                        NoLockingPolicy,
+                        CountersOnlyPolicy,
+                        ALL_CHECKPOINT_CATEGORIES> StaticCheckpoint;
+
+struct BenchThread
+{
+  Scenario scenario;
+  // NULL to checkpoint in the global instance
+  Checkpoint *domain;
+  uint32_t numCheckpoints;
+  pthread_barrier_t *startBarrier;
+  uint64_t elapsedNanos;
+};
+
+void loadCmdLine(CmdLineParser &clp)
+{
+  clp.setMainHelpText("Low Impact Profiler checkpoint overhead benchmark");
+
+  //
+  // Optional args
+  //
+  // Checkpoints per thread
+  clp.addCmdLineOption(new CmdLineOptionInt(ARG_NUM_CHECKPOINTS,
+                                            string("Number of checkpoints per thread and run"),
+                                            10000000));
+  // Max threads
+  clp.addCmdLineOption(new CmdLineOptionInt(ARG_MAX_THREADS,
+                                            string("Maximum number of threads, 0 for 2x the number of cores"),
+                                            0));
+  // LIP clock source
+  clp.addCmdLineOption(new CmdLineOptionInt(ARG_LIP_CLOCK,
+                                            string("LIP clock source: 0 realtime usec, 1 monotonic raw, 2 TSC, 3 TSCP"),
+                                            0));
+  // Output path
+  clp.addCmdLineOption(new CmdLineOptionStr(ARG_OUTPUT_PATH,
+                                            string("CSV results file, - for stdout"),
+                                            string("-")));
+}
+
+bool parseCommandLine(int argc, char **argv, CmdLineParser &clp, ConfigInput &config)
+{
+  if(!clp.parseCmdLine(argc, argv))
+  {
+    clp.printUsage();
+    return false;
+  }
+
+  config.numCheckpoints =  ((CmdLineOptionInt*)  clp.getCmdLineOption(ARG_NUM_CHECKPOINTS))->getValue();
+  config.maxThreads     =  ((CmdLineOptionInt*)  clp.getCmdLineOption(ARG_MAX_THREADS))->getValue();
+  config.lipClock       =  ((CmdLineOptionInt*)  clp.getCmdLineOption(ARG_LIP_CLOCK))->getValue();
+  config.outputPath     =  ((CmdLineOptionStr*)  clp.getCmdLineOption(ARG_OUTPUT_PATH))->getValue();
+
+  // The checkpoints are hit in pairs
+  if(config.numCheckpoints < 2)
+  {
+    config.numCheckpoints = 2;
+  }
+  config.numCheckpoints -= config.numCheckpoints % 2;
+  if(config.maxThreads == 0)
+  {
+    long numCores(sysconf(_SC_NPROCESSORS_ONLN));
+    config.maxThreads = 2 * (numCores > 0 ? numCores : 1);
+  }
+
+  return true;
+}
+
+uint64_t getNanos()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((now.tv_sec * (uint64_t)1000000000) + now.tv_nsec);
+}
+
+// The checkpoints alternate between 2 ids, like a loop with a start
+// and an end checkpoint. The baseline loop has the same compiler barrier
+// the call to checkpoint() is, so only the checkpoint cost differs.
+void *benchEntryPoint(void *userData)
+{
+  BenchThread *bench((BenchThread*) userData);
+  uint32_t numPairs(bench->numCheckpoints / 2);
+
+  // Registers the thread before timing
+  if(bench->scenario == SCENARIO_STATIC)
+  {
+    StaticCheckpoint::checkpoint(bench->domain, 0);
+  }
+  else if(bench->domain != NULL)
+  {
+    CHECKPOINT_DOMAIN(bench->domain, 0);
+  }
+  else if(bench->scenario != SCENARIO_BASELINE)
+  {
+    CHECKPOINT(0);
+  }
+
+  pthread_barrier_wait(bench->startBarrier);
+  uint64_t startNanos(getNanos());
+
+  if(bench->scenario == SCENARIO_BASELINE)
+  {
+    for(uint32_t i = 0; i < numPairs; ++i)
+    {
+      __asm__ __volatile__("" : : : "memory");
+      __asm__ __volatile__("" : : : "memory");
+    }
+  }
+  else if(bench->scenario == SCENARIO_STATIC)
+  {
+    for(uint32_t i = 0; i < numPairs; ++i)
+    {
+      StaticCheckpoint::checkpoint(bench->domain, 0);
+      StaticCheckpoint::checkpoint(bench->domain, 1);
+    }
+  }
+  else if(bench->domain != NULL)
+  {
+    for(uint32_t i = 0; i < numPairs; ++i)
+    {
+      CHECKPOINT_DOMAIN(bench->domain, 0);
+      CHECKPOINT_DOMAIN(bench->domain, 1);
+    }
+  }
+  else
+  {
+    for(uint32_t i = 0; i < numPairs; ++i)
+    {
+      CHECKPOINT(0);
+      CHECKPOINT(1);
+    }
+  }
+
+  bench->elapsedNanos = getNanos() - startNanos;
+
+  return NULL;
+}
+
+// Returns the average nanoseconds per checkpoint of the threads,
+// and the checkpoints per second of all the threads together.
+// Returns false if the scenario can't be run, like the static
+// scenario when its clock source is not available.
+bool runBench(const ConfigInput &input,
+              Scenario scenario,
+              uint32_t numThreads,
+              double &nanosPerCheckpoint,
+              double &checkpointsPerSec)
+{
+  Checkpoint *domain(NULL);
+  if(scenario != SCENARIO_BASELINE)
+  {
+    Checkpoint::Config lipConfig;
+    lipConfig.numThreads = (scenario == SCENARIO_SHARED_SLOT ? 0 : numThreads);
+    lipConfig.useLocking = (scenario != SCENARIO_NO_LOCKING);
+    lipConfig.clockSource = (Checkpoint::ClockSource) input.lipClock;
+    if(scenario == SCENARIO_DOMAIN)
+    {
+      domain = Checkpoint::createDomain("lipBench", lipConfig);
+    }
+    else if(scenario == SCENARIO_STATIC)
+    {
+      domain = StaticCheckpoint::createDomain("lipBench", lipConfig);
+      if(domain == NULL)
+      {
+        return false;
+      }
+    }
+    else
+    {
+      Checkpoint::initialize(lipConfig);
+      Checkpoint::instance()->setActive(scenario != SCENARIO_INACTIVE);
+    }
+  }
+
+  pthread_barrier_t startBarrier;
+  pthread_barrier_init(&startBarrier, NULL, numThreads);
+
+  vector<BenchThread> benchThreads(numThreads);
+  vector<pthread_t> threadIds(numThreads);
+  for(uint32_t i = 0; i < numThreads; ++i)
+  {
+    benchThreads[i].scenario = scenario;
+    benchThreads[i].domain = domain;
+    benchThreads[i].numCheckpoints = input.numCheckpoints;
+    benchThreads[i].startBarrier = &startBarrier;
+    benchThreads[i].elapsedNanos = 0;
+    pthread_create(&threadIds[i], NULL, benchEntryPoint, &benchThreads[i]);
+  }
+
+  uint64_t totalNanos(0);
+  uint64_t maxNanos(1);
+  for(uint32_t i = 0; i < numThreads; ++i)
+  {
+    pthread_join(threadIds[i], NULL);
+    totalNanos += benchThreads[i].elapsedNanos;
+    if(benchThreads[i].elapsedNanos > maxNanos)
+    {
+      maxNanos = benchThreads[i].elapsedNanos;
+    }
+  }
+  pthread_barrier_destroy(&startBarrier);
+
+  uint64_t checkpointsPerThread(input.numCheckpoints);
+  nanosPerCheckpoint = (double) totalNanos / ((uint64_t) numThreads * checkpointsPerThread);
+  checkpointsPerSec = ((double) numThreads * checkpointsPerThread * 1000000000.0) / maxNanos;
+
+  if(domain != NULL)
+  {
+    delete domain;
+  }
+  else if(scenario != SCENARIO_BASELINE)
+  {
+    Checkpoint::destroy();
+  }
+
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  // Handle the Command line args
+  CmdLineParser clp;
+  loadCmdLine(clp);
+
+  ConfigInput input;
+  if(!parseCommandLine(argc, argv, clp, input))
+  {
+    cerr << "Error parsing command line arguments, exiting" << endl;
+    return 1;
+  }
+
+  ofstream outputFile;
+  if(input.outputPath != "-")
+  {
+    outputFile.open(input.outputPath.c_str(), ios::out | ios::trunc);
+    if(!outputFile.is_open())
+    {
+      cerr << "ERROR opening output file [" << input.outputPath << "]" << endl;
+      return 1;
+    }
+  }
+  ostream &out(outputFile.is_open() ? outputFile : cout);
+
+  // 1, 2, 4... and maxThreads
+  vector<uint32_t> threadCounts;
+  for(uint32_t numThreads = 1; numThreads < input.maxThreads; numThreads *= 2)
+  {
+    threadCounts.push_back(numThreads);
+  }
+  threadCounts.push_back(input.maxThreads);
+
+  out << "scenario,threads,clockSource,checkpointsPerThread,nanosPerCheckpoint,overheadNanos,checkpointsPerSec\n";
+  for(size_t i = 0; i < threadCounts.size(); ++i)
+  {
+    uint32_t numThreads(threadCounts[i]);
+    double baselineNanos(0.0);
+    for(int scenario = 0; scenario < NUM_SCENARIOS; ++scenario)
+    {
+      double nanosPerCheckpoint, checkpointsPerSec;
+      if(!runBench(input, (Scenario) scenario, numThreads, nanosPerCheckpoint, checkpointsPerSec))
+      {
+        cerr << "Threads [" << numThreads
+             << "] " << SCENARIO_NAMES[scenario]
+             << " skipped"
+             << endl;
+        continue;
+      }
+      if(scenario == SCENARIO_BASELINE)
+      {
+        baselineNanos = nanosPerCheckpoint;
+      }
+
+      out << SCENARIO_NAMES[scenario]
+          << "," << numThreads
+          << "," << (scenario == SCENARIO_STATIC ? (uint32_t) StaticClockPolicy::CLOCK_SOURCE : input.lipClock)
+          << "," << input.numCheckpoints
+          << "," << nanosPerCheckpoint
+          << "," << (nanosPerCheckpoint - baselineNanos)
+          << "," << (uint64_t) checkpointsPerSec
+          << "\n" << flush;
+
+      cerr << "Threads [" << numThreads
+           << "] " << SCENARIO_NAMES[scenario]
+           << " [" << nanosPerCheckpoint << "] nanos per checkpoint"
+           << endl;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,1390 @@
+/*
+ * lipReportMain.cc
+ *
+ * lip-report: formats one or more snapshot files written with
+ * Checkpoint::snapshot(), as text like Checkpoint::dump(), CSV or JSON.
+ * All the unit scaling, merging of the threads and throughput
+ * calculations are done here, offline, instead of in the profiled process.
+ *
+ * With baseline snapshots, the candidate snapshots are compared to them
+ * instead, and the exit status is 2 if a checkpoint regressed beyond the
+ * threshold, so a performance gate can run it unattended.
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm> // sort()
+
+#include <math.h>    // erfc(), sqrt()
+#include <stdint.h>  // uint32_t et al
+
+#include <CmdLineParser.h>
+
+#include "LowImpactProfiler.h"
+#include "CheckpointSnapshot.h"
+
+using namespace std;
+
+const string ARG_SNAPSHOT_FILES = "-i";
+const string ARG_FORMAT         = "-f";
+const string ARG_OUTPUT_PATH    = "-o";
+const string ARG_PER_THREAD     = "-t";
+const string ARG_MERGE          = "-m";
+const string ARG_BASELINE_FILES = "-b";
+const string ARG_THRESHOLD      = "-r";
+
+const string FORMAT_TEXT = "text";
+const string FORMAT_CSV  = "csv";
+const string FORMAT_JSON = "json";
+
+// The percentiles of the histograms, the profiler's Config::percentiles are not in the snapshot
+const double PERCENTILES[] = {50.0, 99.0, 99.9};
+const char *PERCENTILE_NAMES[] = {"p50", "p99", "p99.9"};
+const int NUM_PERCENTILES = 3;
+
+// The comparisons are made at 95% confidence
+const double CONFIDENCE_Z = 1.959964;
+const double SIGNIFICANCE = 0.05;
+
+// Exit status when a checkpoint regressed, 1 is for errors
+const int EXIT_REGRESSED = 2;
+
+struct ConfigInput
+{
+  // Command line options
+  vector<string> snapshotFiles;
+  string format;
+  string outputPath;
+  bool perThread;
+  bool merge;
+  vector<string> baselineFiles;
+  uint32_t thresholdPercent;
+
+  ConfigInput() : format(FORMAT_TEXT), outputPath("-"), perThread(false), merge(false), thresholdPercent(5) {}
+};
+
+// The counters of a checkpoint on a thread, or merged for all the threads.
+// The times are in nano-seconds, except in the histogram.
+struct ReportRow
+{
+  string thread;
+  uint32_t checkpoint;
+  string label;
+  uint32_t numThreads;
+  uint64_t iterations;
+  double totalNanos;
+  // Iterations per second, summed over the threads
+  double itersPerSec;
+  SegmentStats stats;
+  bool hasHistogram;
+  bool mixedHistograms;
+  double histogramNanosPerCycle;
+  LatencyHistogram histogram;
+  // The misses are per iteration of the threads that had perf counters
+  bool hasPerfCounts;
+  uint32_t perfAvailableMask;
+  uint64_t perfIterations;
+  uint64_t perfCounts[PerfCounters::NUM_COUNTERS];
+  bool hasCpuTime;
+  uint64_t cpuIterations;
+  double cpuNanos;
+  double cpuWallNanos;
+
+  ReportRow() : checkpoint(0), numThreads(0), iterations(0), totalNanos(0.0), itersPerSec(0.0),
+                hasHistogram(false), mixedHistograms(false), histogramNanosPerCycle(0.0),
+                hasPerfCounts(false), perfAvailableMask(0), perfIterations(0),
+                hasCpuTime(false), cpuIterations(0), cpuNanos(0.0), cpuWallNanos(0.0)
+  {
+    for(uint32_t counter = 0; counter < PerfCounters::NUM_COUNTERS; ++counter)
+    {
+      perfCounts[counter] = 0;
+    }
+  }
+};
+
+// A snapshot, or all the snapshots merged
+struct Report
+{
+  string source;
+  string domainName;
+  uint64_t pid;
+  string clockSource;
+  uint64_t snapshotMicros;
+  uint32_t numThreads;
+  vector<ReportRow> threadRows;
+  // Per checkpoint label, in the order they were first seen
+  vector<ReportRow> totalRows;
+  map<string, size_t> totalIndex;
+
+  Report() : pid(0), snapshotMicros(0), numThreads(0) {}
+};
+
+void loadCmdLine(CmdLineParser &clp)
+{
+  clp.setMainHelpText("Format Low Impact Profiler snapshot files");
+
+  //
+  // Optional args
+  //
+  // Snapshot files
+  clp.addCmdLineOption(new CmdLineOptionStr(ARG_SNAPSHOT_FILES,
+                                            string("Snapshot files written with Checkpoint::snapshot(), separated by commas"),
+                                            string("lip.snapshot")));
+  // Output format
+  clp.addCmdLineOption(new CmdLineOptionStr(ARG_FORMAT,
+                                            string("Output format: text, csv or json"),
+                                            FORMAT_TEXT));
+  // Output path
+  clp.addCmdLineOption(new CmdLineOptionStr(ARG_OUTPUT_PATH,
+                                            string("Output file, - for stdout"),
+                                            string("-")));
+  // Per thread
+  clp.addCmdLineOption(new CmdLineOptionFlag(ARG_PER_THREAD,
+                                             string("Also show each thread in the text output, csv and json always have them"),
+                                             false));
+  // Merge
+  clp.addCmdLineOption(new CmdLineOptionFlag(ARG_MERGE,
+                                             string("Merge the snapshots into one report, for example of several processes"),
+                                             false));
+  // Baseline
+  clp.addCmdLineOption(new CmdLineOptionStr(ARG_BASELINE_FILES,
+                                            string("Baseline snapshot files, separated by commas, to compare the snapshots to"),
+                                            string("")));
+  // Regression threshold
+  clp.addCmdLineOption(new CmdLineOptionInt(ARG_THRESHOLD,
+                                            string("Regression threshold in percent, when comparing"),
+                                            5));
+}
+
+// Splits a list of files separated by commas
+void splitFiles(const string &fileList, vector<string> &files)
+{
+  istringstream fileStream(fileList);
+  string file;
+  while(getline(fileStream, file, ','))
+  {
+    if(!file.empty())
+    {
+      files.push_back(file);
+    }
+  }
+}
+
+bool parseCommandLine(int argc, char **argv, CmdLineParser &clp, ConfigInput &config)
+{
+  if(!clp.parseCmdLine(argc, argv))
+  {
+    clp.printUsage();
+    return false;
+  }
+
+  string snapshotFiles;
+  snapshotFiles     =  ((CmdLineOptionStr*)   clp.getCmdLineOption(ARG_SNAPSHOT_FILES))->getValue();
+  config.format     =  ((CmdLineOptionStr*)   clp.getCmdLineOption(ARG_FORMAT))->getValue();
+  config.outputPath =  ((CmdLineOptionStr*)   clp.getCmdLineOption(ARG_OUTPUT_PATH))->getValue();
+  config.perThread  =  ((CmdLineOptionFlag*)  clp.getCmdLineOption(ARG_PER_THREAD))->getValue();
+  config.merge      =  ((CmdLineOptionFlag*)  clp.getCmdLineOption(ARG_MERGE))->getValue();
+  string baselineFiles;
+  baselineFiles     =  ((CmdLineOptionStr*)   clp.getCmdLineOption(ARG_BASELINE_FILES))->getValue();
+  config.thresholdPercent = ((CmdLineOptionInt*) clp.getCmdLineOption(ARG_THRESHOLD))->getValue();
+
+  splitFiles(snapshotFiles, config.snapshotFiles);
+  splitFiles(baselineFiles, config.baselineFiles);
+
+  if(config.snapshotFiles.empty())
+  {
+    cerr << "No snapshot files given" << endl;
+    return false;
+  }
+  if(config.format != FORMAT_TEXT && config.format != FORMAT_CSV && config.format != FORMAT_JSON)
+  {
+    cerr << "Unknown output format [" << config.format << "]" << endl;
+    return false;
+  }
+
+  return true;
+}
+
+//
+// Building the reports
+//
+
+// Adds a thread's row to the total of its checkpoint
+void addToTotal(Report &report, const ReportRow &row)
+{
+  map<string, size_t>::const_iterator iter(report.totalIndex.find(row.label));
+  if(iter == report.totalIndex.end())
+  {
+    iter = report.totalIndex.insert(make_pair(row.label, report.totalRows.size())).first;
+    report.totalRows.push_back(ReportRow());
+    report.totalRows.back().thread = "all";
+    report.totalRows.back().checkpoint = row.checkpoint;
+    report.totalRows.back().label = row.label;
+  }
+  ReportRow &total(report.totalRows[iter->second]);
+
+  total.numThreads  += row.numThreads;
+  total.iterations  += row.iterations;
+  total.totalNanos  += row.totalNanos;
+  total.itersPerSec += row.itersPerSec;
+  total.stats.merge(row.stats);
+
+  // The histogram buckets are in cycles, so only the
+  // snapshots of the same clock calibration are merged
+  if(row.hasHistogram && !total.mixedHistograms)
+  {
+    if(!total.hasHistogram)
+    {
+      total.hasHistogram = true;
+      total.histogramNanosPerCycle = row.histogramNanosPerCycle;
+      total.histogram = row.histogram;
+    }
+    else if(total.histogramNanosPerCycle == row.histogramNanosPerCycle)
+    {
+      total.histogram.merge(row.histogram);
+    }
+    else
+    {
+      total.hasHistogram = false;
+      total.mixedHistograms = true;
+    }
+  }
+
+  if(row.hasPerfCounts)
+  {
+    total.hasPerfCounts = true;
+    total.perfAvailableMask |= row.perfAvailableMask;
+    total.perfIterations += row.perfIterations;
+    for(uint32_t counter = 0; counter < PerfCounters::NUM_COUNTERS; ++counter)
+    {
+      total.perfCounts[counter] += row.perfCounts[counter];
+    }
+  }
+
+  if(row.hasCpuTime)
+  {
+    total.hasCpuTime = true;
+    total.cpuIterations += row.cpuIterations;
+    total.cpuNanos += row.cpuNanos;
+    total.cpuWallNanos += row.cpuWallNanos;
+  }
+}
+
+// Adds the threads of a snapshot to the report, their labels
+// are prefixed with the pid when several snapshots are merged
+void addSnapshot(const CheckpointSnapshot &snapshot, bool prefixPid, Report &report)
+{
+  const SnapshotFileHeader &header(snapshot.getHeader());
+  const double nanosPerCycle(header.nanosPerCycle_);
+
+  for(uint32_t index = 0; index < snapshot.getNumThreads(); ++index)
+  {
+    const SnapshotThread &thread(snapshot.getThread(index));
+    const SnapshotCheckpoint *checkpoints(snapshot.getCheckpoints(index));
+    const LatencyHistogram *histograms(snapshot.getHistograms(index));
+    const uint64_t *perfCounts(snapshot.getPerfCounts(index));
+    const uint64_t *cpuNanos(snapshot.getCpuNanos(index));
+
+    ostringstream threadLabel;
+    if(prefixPid)
+    {
+      threadLabel << header.pid_ << "/";
+    }
+    if(thread.slot_ == SNAPSHOT_RETIRED_SLOT)
+    {
+      threadLabel << "retired";
+    }
+    else
+    {
+      threadLabel << thread.slot_;
+    }
+    report.numThreads += thread.numThreads_;
+
+    for(uint32_t chkPoint = 0; chkPoint < thread.numCheckpoints_; ++chkPoint)
+    {
+      const SnapshotCheckpoint &checkpoint(checkpoints[chkPoint]);
+      if(checkpoint.iterations_ == 0)
+      {
+        continue;
+      }
+
+      ReportRow row;
+      row.thread = threadLabel.str();
+      row.checkpoint = chkPoint;
+      row.label = snapshot.getCheckpointLabel(chkPoint);
+      row.numThreads = checkpoint.numThreads_;
+      row.iterations = checkpoint.iterations_;
+      row.totalNanos = checkpoint.totalCycles_ * nanosPerCycle;
+
+      // From the thread's registration to its last hit of the checkpoint
+      if(checkpoint.previousCycles_ > thread.creationCycles_)
+      {
+        double elapsedNanos((checkpoint.previousCycles_ - thread.creationCycles_) * nanosPerCycle);
+        row.itersPerSec = (checkpoint.iterations_ * 1000000000.0) / elapsedNanos;
+      }
+
+      row.stats = SegmentStats(checkpoint.statsCount_,
+                               (uint64_t) (checkpoint.statsMin_ * nanosPerCycle),
+                               (uint64_t) (checkpoint.statsMax_ * nanosPerCycle),
+                               checkpoint.statsMean_ * nanosPerCycle,
+                               checkpoint.statsM2_ * nanosPerCycle * nanosPerCycle);
+      if(histograms != NULL)
+      {
+        row.hasHistogram = true;
+        row.histogramNanosPerCycle = nanosPerCycle;
+        row.histogram = histograms[chkPoint];
+      }
+      if(perfCounts != NULL)
+      {
+        row.hasPerfCounts = true;
+        row.perfAvailableMask = header.perfAvailableMask_;
+        row.perfIterations = checkpoint.iterations_;
+        for(uint32_t counter = 0; counter < PerfCounters::NUM_COUNTERS; ++counter)
+        {
+          row.perfCounts[counter] = perfCounts[chkPoint * PerfCounters::NUM_COUNTERS + counter];
+        }
+      }
+      if(cpuNanos != NULL)
+      {
+        row.hasCpuTime = true;
+        row.cpuIterations = checkpoint.iterations_;
+        row.cpuNanos = cpuNanos[chkPoint];
+        row.cpuWallNanos = row.totalNanos;
+      }
+
+      addToTotal(report, row);
+      report.threadRows.push_back(row);
+    }
+  }
+}
+
+// All the snapshots as one report, the threads are labelled
+// with their pid when there are several snapshots
+void buildMergedReport(const vector<CheckpointSnapshot*> &snapshots, Report &report)
+{
+  report.source = "merged";
+  for(size_t i = 0; i < snapshots.size(); ++i)
+  {
+    addSnapshot(*snapshots[i], snapshots.size() > 1, report);
+    report.source += (i == 0 ? " " : ",") + snapshots[i]->getPath();
+  }
+  for(size_t i = 0; i < report.totalRows.size(); ++i)
+  {
+    if(report.totalRows[i].mixedHistograms)
+    {
+      cerr << "NOTICE: the snapshots have different clock calibrations, "
+           << "their latency histograms are not merged" << endl;
+      break;
+    }
+  }
+  report.clockSource = Checkpoint::getClockSourceStr((Checkpoint::ClockSource) snapshots[0]->getHeader().clockSource_);
+}
+
+//
+// Formatting
+//
+
+// The on-CPU time is capped at the wall time, as in dump()
+double getOnCpuNanos(const ReportRow &row)
+{
+  return (row.cpuNanos < row.cpuWallNanos ? row.cpuNanos : row.cpuWallNanos);
+}
+
+bool hasIpc(const ReportRow &row)
+{
+  const uint32_t IPC_MASK((1 << PerfCounters::INSTRUCTIONS) | (1 << PerfCounters::CYCLES));
+  return (row.hasPerfCounts &&
+          (row.perfAvailableMask & IPC_MASK) == IPC_MASK &&
+          row.perfCounts[PerfCounters::CYCLES] != 0);
+}
+
+bool hasMisses(const ReportRow &row, uint32_t counter)
+{
+  return (row.hasPerfCounts &&
+          (row.perfAvailableMask & (1 << counter)) != 0 &&
+          row.perfIterations != 0);
+}
+
+// The totals are shown as the average thread, like the "Weighted Average" of dump()
+void printTextRow(ostream &out, const ReportRow &row, bool isTotal)
+{
+  double numThreads(isTotal && row.numThreads > 0 ? row.numThreads : 1);
+  uint64_t iterations((uint64_t) (row.iterations / numThreads + 0.5));
+  uint64_t totalNanos((uint64_t) (row.totalNanos / numThreads + 0.5));
+  uint64_t avgNanos((uint64_t) (row.totalNanos / row.iterations + 0.5));
+  const char *unitPtr(Checkpoint::getTimeUnitStr(avgNanos, totalNanos));
+
+  if(isTotal)
+  {
+    out << "Weighted Average: Checkpoint [" << row.label
+        << "] Threads [" << row.numThreads << "]";
+  }
+  else
+  {
+    out << "Thread [" << row.thread
+        << "] Checkpoint [" << row.label << "]";
+  }
+  out << " Iterations [" << iterations
+      << "] Time [Unit,Avg,Total] = [" << unitPtr
+      << ", " << avgNanos
+      << ", " << totalNanos << "]";
+
+  if(row.stats.getCount() != 0)
+  {
+    double divisor(Checkpoint::getTimeUnitDivisor(row.stats.getMean(), unitPtr));
+    out << " Stats [Unit,Min,Max,Mean,StdDev] = [" << unitPtr
+        << ", " << (uint64_t) (row.stats.getMin() / divisor)
+        << ", " << (uint64_t) (row.stats.getMax() / divisor)
+        << ", " << (row.stats.getMean() / divisor)
+        << ", " << (row.stats.getStdDev() / divisor) << "]";
+  }
+
+  if(row.hasHistogram)
+  {
+    double nanosPerCycle(row.histogramNanosPerCycle);
+    double divisor(Checkpoint::getTimeUnitDivisor(row.histogram.getValueAtPercentile(50.0) * nanosPerCycle, unitPtr));
+    double scale(nanosPerCycle / divisor);
+    out << " Latency [Unit,Min,Max,StdDev] = [" << unitPtr
+        << ", " << (uint64_t) (row.histogram.getMin() * scale)
+        << ", " << (uint64_t) (row.histogram.getMax() * scale)
+        << ", " << (uint64_t) (row.histogram.getStdDev() * scale) << "]";
+    out << " Percentiles [";
+    for(int i = 0; i < NUM_PERCENTILES; ++i)
+    {
+      out << (i == 0 ? "" : ",") << PERCENTILE_NAMES[i];
+    }
+    out << "] = [";
+    for(int i = 0; i < NUM_PERCENTILES; ++i)
+    {
+      out << (i == 0 ? "" : ", ")
+          << (uint64_t) (row.histogram.getValueAtPercentile(PERCENTILES[i]) * scale);
+    }
+    out << "]";
+  }
+
+  if(row.hasPerfCounts)
+  {
+    out << " Counters [IPC,LLCMisses,BranchMisses] = [";
+    if(hasIpc(row))
+    {
+      out << ((double) row.perfCounts[PerfCounters::INSTRUCTIONS] / row.perfCounts[PerfCounters::CYCLES]);
+    }
+    else
+    {
+      out << "n/a";
+    }
+    const uint32_t MISSES[2] = {PerfCounters::LLC_MISSES, PerfCounters::BRANCH_MISSES};
+    for(int i = 0; i < 2; ++i)
+    {
+      out << ", ";
+      if(hasMisses(row, MISSES[i]))
+      {
+        out << ((double) row.perfCounts[MISSES[i]] / row.perfIterations);
+      }
+      else
+      {
+        out << "n/a";
+      }
+    }
+    out << "]";
+  }
+
+  if(row.hasCpuTime && row.cpuIterations != 0)
+  {
+    double onCpuNanos(getOnCpuNanos(row));
+    double divisor(Checkpoint::getTimeUnitDivisor(row.cpuWallNanos / row.cpuIterations, unitPtr));
+    double scale(1.0 / (divisor * row.cpuIterations));
+    out << " CPU [Unit,AvgOnCpu,AvgOffCpu,Utilization] = [" << unitPtr
+        << ", " << (uint64_t) (onCpuNanos * scale)
+        << ", " << (uint64_t) ((row.cpuWallNanos - onCpuNanos) * scale)
+        << ", " << (row.cpuWallNanos > 0 ? (100.0 * onCpuNanos / row.cpuWallNanos) : 100.0) << "%]";
+  }
+
+  out << "\n";
+}
+
+// The throughput of the last checkpoint, the one closing the loops
+void printTextThroughput(ostream &out, const Report &report)
+{
+  const ReportRow *lastTotal(NULL);
+  for(size_t i = 0; i < report.totalRows.size(); ++i)
+  {
+    if(lastTotal == NULL || report.totalRows[i].checkpoint > lastTotal->checkpoint)
+    {
+      lastTotal = &(report.totalRows[i]);
+    }
+  }
+  if(lastTotal == NULL)
+  {
+    return;
+  }
+
+  out << "\nThroughput for each thread cp[" << lastTotal->label << "]:\n";
+  for(size_t i = 0; i < report.threadRows.size(); ++i)
+  {
+    const ReportRow &row(report.threadRows[i]);
+    if(row.label == lastTotal->label)
+    {
+      out << "Thread[" << row.thread << "] iterations = " << row.iterations
+          << ", throughput (iters/sec) = " << row.itersPerSec << "\n";
+    }
+  }
+  out << "\nTotal Throughput (iters/sec) = " << lastTotal->itersPerSec << "\n";
+}
+
+void printText(ostream &out, const Report &report, bool perThread)
+{
+  out << "Snapshot [" << report.source << "]";
+  if(!report.domainName.empty())
+  {
+    out << " Domain [" << report.domainName << "]";
+  }
+  if(report.pid != 0)
+  {
+    out << " Pid [" << report.pid << "]";
+  }
+  out << " Clock source [" << report.clockSource
+      << "] Threads [" << report.numThreads << "]";
+  if(report.snapshotMicros != 0)
+  {
+    out << " Taken at [" << report.snapshotMicros << "] usec";
+  }
+  out << "\n\n";
+
+  if(perThread && !report.threadRows.empty())
+  {
+    for(size_t i = 0; i < report.threadRows.size(); ++i)
+    {
+      printTextRow(out, report.threadRows[i], false);
+    }
+    out << "\n";
+  }
+
+  for(size_t i = 0; i < report.totalRows.size(); ++i)
+  {
+    printTextRow(out, report.totalRows[i], true);
+  }
+
+  printTextThroughput(out, report);
+  out << endl;
+}
+
+// Checkpoint names are quoted if they hold CSV separators or quotes
+string getCsvField(const string &field)
+{
+  if(field.find_first_of(",\"\n") == string::npos)
+  {
+    return field;
+  }
+
+  string quoted("\"");
+  for(size_t i = 0; i < field.size(); ++i)
+  {
+    quoted += field[i];
+    if(field[i] == '"')
+    {
+      quoted += '"';
+    }
+  }
+  quoted += '"';
+
+  return quoted;
+}
+
+string getJsonString(const string &str)
+{
+  string quoted("\"");
+  for(size_t i = 0; i < str.size(); ++i)
+  {
+    char ch(str[i]);
+    if(ch == '"' || ch == '\\')
+    {
+      quoted += '\\';
+    }
+    quoted += ((unsigned char) ch < 0x20 ? ' ' : ch);
+  }
+  quoted += '"';
+
+  return quoted;
+}
+
+void printCsvHeader(ostream &out)
+{
+  out << "snapshot,domain,thread,checkpoint,threads,iterations,totalNanos,avgNanos,itersPerSec"
+      << ",minNanos,maxNanos,meanNanos,stdDevNanos";
+  for(int i = 0; i < NUM_PERCENTILES; ++i)
+  {
+    out << "," << PERCENTILE_NAMES[i] << "Nanos";
+  }
+  out << ",ipc,llcMissesPerIter,branchMissesPerIter,avgOnCpuNanos,avgOffCpuNanos\n";
+}
+
+// The fields that don't apply are left empty
+void printCsvRow(ostream &out, const Report &report, const ReportRow &row)
+{
+  out << getCsvField(report.source)
+      << "," << getCsvField(report.domainName)
+      << "," << row.thread
+      << "," << getCsvField(row.label)
+      << "," << row.numThreads
+      << "," << row.iterations
+      << "," << (uint64_t) row.totalNanos
+      << "," << (row.totalNanos / row.iterations)
+      << "," << row.itersPerSec;
+
+  if(row.stats.getCount() != 0)
+  {
+    out << "," << row.stats.getMin()
+        << "," << row.stats.getMax()
+        << "," << row.stats.getMean()
+        << "," << row.stats.getStdDev();
+  }
+  else
+  {
+    out << ",,,,";
+  }
+
+  for(int i = 0; i < NUM_PERCENTILES; ++i)
+  {
+    out << ",";
+    if(row.hasHistogram)
+    {
+      out << (uint64_t) (row.histogram.getValueAtPercentile(PERCENTILES[i]) * row.histogramNanosPerCycle);
+    }
+  }
+
+  out << ",";
+  if(hasIpc(row))
+  {
+    out << ((double) row.perfCounts[PerfCounters::INSTRUCTIONS] / row.perfCounts[PerfCounters::CYCLES]);
+  }
+  out << ",";
+  if(hasMisses(row, PerfCounters::LLC_MISSES))
+  {
+    out << ((double) row.perfCounts[PerfCounters::LLC_MISSES] / row.perfIterations);
+  }
+  out << ",";
+  if(hasMisses(row, PerfCounters::BRANCH_MISSES))
+  {
+    out << ((double) row.perfCounts[PerfCounters::BRANCH_MISSES] / row.perfIterations);
+  }
+
+  if(row.hasCpuTime && row.cpuIterations != 0)
+  {
+    double onCpuNanos(getOnCpuNanos(row));
+    out << "," << (onCpuNanos / row.cpuIterations)
+        << "," << ((row.cpuWallNanos - onCpuNanos) / row.cpuIterations);
+  }
+  else
+  {
+    out << ",,";
+  }
+  out << "\n";
+}
+
+void printCsv(ostream &out, const Report &report)
+{
+  for(size_t i = 0; i < report.threadRows.size(); ++i)
+  {
+    printCsvRow(out, report, report.threadRows[i]);
+  }
+  for(size_t i = 0; i < report.totalRows.size(); ++i)
+  {
+    printCsvRow(out, report, report.totalRows[i]);
+  }
+}
+
+// The objects that don't apply are left out
+void printJsonRow(ostream &out, const ReportRow &row)
+{
+  out << "{\"thread\":" << getJsonString(row.thread)
+      << ",\"checkpoint\":" << getJsonString(row.label)
+      << ",\"threads\":" << row.numThreads
+      << ",\"iterations\":" << row.iterations
+      << ",\"totalNanos\":" << (uint64_t) row.totalNanos
+      << ",\"avgNanos\":" << (row.totalNanos / row.iterations)
+      << ",\"itersPerSec\":" << row.itersPerSec;
+
+  if(row.stats.getCount() != 0)
+  {
+    out << ",\"stats\":{\"count\":" << row.stats.getCount()
+        << ",\"minNanos\":" << row.stats.getMin()
+        << ",\"maxNanos\":" << row.stats.getMax()
+        << ",\"meanNanos\":" << row.stats.getMean()
+        << ",\"stdDevNanos\":" << row.stats.getStdDev() << "}";
+  }
+
+  if(row.hasHistogram)
+  {
+    double nanosPerCycle(row.histogramNanosPerCycle);
+    out << ",\"latency\":{\"minNanos\":" << (uint64_t) (row.histogram.getMin() * nanosPerCycle)
+        << ",\"maxNanos\":" << (uint64_t) (row.histogram.getMax() * nanosPerCycle)
+        << ",\"stdDevNanos\":" << (uint64_t) (row.histogram.getStdDev() * nanosPerCycle);
+    for(int i = 0; i < NUM_PERCENTILES; ++i)
+    {
+      out << ",\"" << PERCENTILE_NAMES[i] << "Nanos\":"
+          << (uint64_t) (row.histogram.getValueAtPercentile(PERCENTILES[i]) * nanosPerCycle);
+    }
+    out << "}";
+  }
+
+  if(row.hasPerfCounts)
+  {
+    out << ",\"counters\":{\"iterations\":" << row.perfIterations;
+    for(uint32_t counter = 0; counter < PerfCounters::NUM_COUNTERS; ++counter)
+    {
+      if(row.perfAvailableMask & (1 << counter))
+      {
+        out << ",\"" << PerfCounters::getCounterName(counter) << "\":" << row.perfCounts[counter];
+      }
+    }
+    out << "}";
+  }
+
+  if(row.hasCpuTime && row.cpuIterations != 0)
+  {
+    double onCpuNanos(getOnCpuNanos(row));
+    out << ",\"cpu\":{\"avgOnCpuNanos\":" << (onCpuNanos / row.cpuIterations)
+        << ",\"avgOffCpuNanos\":" << ((row.cpuWallNanos - onCpuNanos) / row.cpuIterations) << "}";
+  }
+
+  out << "}";
+}
+
+void printJson(ostream &out, const Report &report, bool first)
+{
+  out << (first ? "" : ",\n")
+      << "{\"snapshot\":" << getJsonString(report.source)
+      << ",\"domain\":" << getJsonString(report.domainName)
+      << ",\"pid\":" << report.pid
+      << ",\"clockSource\":" << getJsonString(report.clockSource)
+      << ",\"snapshotMicros\":" << report.snapshotMicros
+      << ",\"threads\":" << report.numThreads
+      << ",\n \"threadRows\":[";
+  for(size_t i = 0; i < report.threadRows.size(); ++i)
+  {
+    out << (i == 0 ? "\n  " : ",\n  ");
+    printJsonRow(out, report.threadRows[i]);
+  }
+  out << "],\n \"totalRows\":[";
+  for(size_t i = 0; i < report.totalRows.size(); ++i)
+  {
+    out << (i == 0 ? "\n  " : ",\n  ");
+    printJsonRow(out, report.totalRows[i]);
+  }
+  out << "]}";
+}
+
+void printReport(ostream &out, const ConfigInput &input, const Report &report, bool first)
+{
+  if(input.format == FORMAT_TEXT)
+  {
+    printText(out, report, input.perThread);
+  }
+  else if(input.format == FORMAT_CSV)
+  {
+    printCsv(out, report);
+  }
+  else
+  {
+    printJson(out, report, first);
+  }
+}
+
+//
+// Comparing a candidate to a baseline
+//
+
+// A checkpoint of the baseline and the candidate. The deltas are in percent
+// of the baseline, and so are the bounds of their confidence intervals.
+struct Comparison
+{
+  string label;
+  bool hasBaseline;
+  bool hasCandidate;
+  double baselineNanos;
+  double candidateNanos;
+  double latencyDelta;
+  // From the segment stats, Welch's interval of the difference of the means
+  bool hasLatencyCi;
+  double latencyCiLow;
+  double latencyCiHigh;
+  // From the histograms, the percentile deltas and a Mann-Whitney U test,
+  // z is positive when the candidate's segments are longer
+  bool hasHistograms;
+  double percentileDeltas[NUM_PERCENTILES];
+  double mannWhitneyZ;
+  double mannWhitneyP;
+  double baselineItersPerSec;
+  double candidateItersPerSec;
+  double throughputDelta;
+  // From the rates of the threads, Welch's interval of the difference of the means
+  bool hasThroughputCi;
+  double throughputCiLow;
+  double throughputCiHigh;
+  bool latencyRegressed;
+  bool throughputRegressed;
+
+  Comparison() : hasBaseline(false), hasCandidate(false), baselineNanos(0.0), candidateNanos(0.0),
+                 latencyDelta(0.0), hasLatencyCi(false), latencyCiLow(0.0), latencyCiHigh(0.0),
+                 hasHistograms(false), mannWhitneyZ(0.0), mannWhitneyP(1.0),
+                 baselineItersPerSec(0.0), candidateItersPerSec(0.0), throughputDelta(0.0),
+                 hasThroughputCi(false), throughputCiLow(0.0), throughputCiHigh(0.0),
+                 latencyRegressed(false), throughputRegressed(false)
+  {
+    for(int i = 0; i < NUM_PERCENTILES; ++i)
+    {
+      percentileDeltas[i] = 0.0;
+    }
+  }
+};
+
+// The values of the non-empty histogram buckets, with their count in each run
+struct RankBucket
+{
+  double nanos;
+  double baselineCount;
+  double candidateCount;
+
+  bool operator<(const RankBucket &rhs) const { return nanos < rhs.nanos; }
+};
+
+double getDeltaPercent(double baseline, double candidate)
+{
+  return (baseline != 0.0 ? (100.0 * (candidate - baseline)) / baseline : 0.0);
+}
+
+// Welch's confidence interval of candidate - baseline, in percent of baseline.
+// Returns false with less than 2 samples on a side.
+bool getWelchInterval(double baselineMean, double baselineVariance, double baselineCount,
+                      double candidateMean, double candidateVariance, double candidateCount,
+                      double &low, double &high)
+{
+  if(baselineCount < 2 || candidateCount < 2 || baselineMean == 0.0)
+  {
+    return false;
+  }
+
+  double delta(candidateMean - baselineMean);
+  double margin(CONFIDENCE_Z * sqrt(baselineVariance / baselineCount + candidateVariance / candidateCount));
+  low  = (100.0 * (delta - margin)) / baselineMean;
+  high = (100.0 * (delta + margin)) / baselineMean;
+  return true;
+}
+
+// The Mann-Whitney U test of the two histograms, with the normal approximation
+// and the correction for ties, the values in a bucket being tied. The buckets
+// are ranked in nano-seconds, so runs with different clock calibrations compare.
+void getMannWhitney(const ReportRow &baseline, const ReportRow &candidate, double &z, double &pValue)
+{
+  vector<RankBucket> buckets;
+  const ReportRow *rows[2] = {&baseline, &candidate};
+  for(int run = 0; run < 2; ++run)
+  {
+    for(int i = 0; i < LatencyHistogram::NUM_BUCKETS; ++i)
+    {
+      uint64_t count(rows[run]->histogram.getBucketCount(i));
+      if(count != 0)
+      {
+        RankBucket bucket;
+        bucket.nanos = LatencyHistogram::getBucketLowValue(i) * rows[run]->histogramNanosPerCycle;
+        bucket.baselineCount = (run == 0 ? count : 0);
+        bucket.candidateCount = (run == 1 ? count : 0);
+        buckets.push_back(bucket);
+      }
+    }
+  }
+  sort(buckets.begin(), buckets.end());
+
+  double baselineCount(baseline.histogram.getCount());
+  double candidateCount(candidate.histogram.getCount());
+  double numValues(baselineCount + candidateCount);
+  double candidateRanks(0.0);
+  double tieSum(0.0);
+  double rank(0.0);
+  for(size_t i = 0; i < buckets.size(); )
+  {
+    // The buckets of both runs with the same value are one tie
+    double tiedBaseline(0.0), tiedCandidate(0.0);
+    double nanos(buckets[i].nanos);
+    for(; i < buckets.size() && buckets[i].nanos == nanos; ++i)
+    {
+      tiedBaseline += buckets[i].baselineCount;
+      tiedCandidate += buckets[i].candidateCount;
+    }
+    double tied(tiedBaseline + tiedCandidate);
+    candidateRanks += tiedCandidate * (rank + (tied + 1.0) / 2.0);
+    tieSum += tied * tied * tied - tied;
+    rank += tied;
+  }
+
+  double u(candidateRanks - candidateCount * (candidateCount + 1.0) / 2.0);
+  double mean(baselineCount * candidateCount / 2.0);
+  double variance((baselineCount * candidateCount / 12.0) *
+                  ((numValues + 1.0) - tieSum / (numValues * (numValues - 1.0))));
+
+  z = (variance > 0.0 ? (u - mean) / sqrt(variance) : 0.0);
+  pValue = erfc(fabs(z) / sqrt(2.0));
+}
+
+// The mean and sample variance of the rates of the threads that hit the checkpoint,
+// the retired threads are left out, their rate being that of several threads
+void getThreadRates(const Report &report, const string &label, double &mean, double &variance, double &count)
+{
+  vector<double> rates;
+  double sum(0.0);
+  for(size_t i = 0; i < report.threadRows.size(); ++i)
+  {
+    const ReportRow &row(report.threadRows[i]);
+    if(row.label == label && row.numThreads == 1 && row.itersPerSec > 0.0)
+    {
+      rates.push_back(row.itersPerSec);
+      sum += row.itersPerSec;
+    }
+  }
+
+  count = rates.size();
+  mean = (rates.empty() ? 0.0 : sum / count);
+  variance = 0.0;
+  for(size_t i = 0; i < rates.size(); ++i)
+  {
+    variance += (rates[i] - mean) * (rates[i] - mean);
+  }
+  if(rates.size() > 1)
+  {
+    variance /= (count - 1);
+  }
+}
+
+// The latency regressed if the lower bound of its interval is above the
+// threshold, or without the segment stats, if the Mann-Whitney test is
+// significant and the average is above the threshold. Without either, only
+// the averages are compared. The throughput is compared the same way.
+void compareRows(const Report &baselineReport, const ReportRow &baseline,
+                 const Report &candidateReport, const ReportRow &candidate,
+                 double threshold, Comparison &comparison)
+{
+  comparison.baselineNanos = baseline.totalNanos / baseline.iterations;
+  comparison.candidateNanos = candidate.totalNanos / candidate.iterations;
+  comparison.latencyDelta = getDeltaPercent(comparison.baselineNanos, comparison.candidateNanos);
+
+  comparison.hasLatencyCi = getWelchInterval(baseline.stats.getMean(), baseline.stats.getVariance(), baseline.stats.getCount(),
+                                             candidate.stats.getMean(), candidate.stats.getVariance(), candidate.stats.getCount(),
+                                             comparison.latencyCiLow, comparison.latencyCiHigh);
+  if(comparison.hasLatencyCi)
+  {
+    comparison.latencyDelta = getDeltaPercent(baseline.stats.getMean(), candidate.stats.getMean());
+  }
+
+  comparison.hasHistograms = (baseline.hasHistogram && candidate.hasHistogram &&
+                              baseline.histogram.getCount() != 0 && candidate.histogram.getCount() != 0);
+  if(comparison.hasHistograms)
+  {
+    for(int i = 0; i < NUM_PERCENTILES; ++i)
+    {
+      comparison.percentileDeltas[i] =
+        getDeltaPercent(baseline.histogram.getValueAtPercentile(PERCENTILES[i]) * baseline.histogramNanosPerCycle,
+                        candidate.histogram.getValueAtPercentile(PERCENTILES[i]) * candidate.histogramNanosPerCycle);
+    }
+    getMannWhitney(baseline, candidate, comparison.mannWhitneyZ, comparison.mannWhitneyP);
+  }
+
+  if(comparison.hasLatencyCi)
+  {
+    comparison.latencyRegressed = (comparison.latencyCiLow > threshold);
+  }
+  else if(comparison.hasHistograms)
+  {
+    comparison.latencyRegressed = (comparison.mannWhitneyP < SIGNIFICANCE &&
+                                   comparison.mannWhitneyZ > 0.0 &&
+                                   comparison.latencyDelta > threshold);
+  }
+  else
+  {
+    comparison.latencyRegressed = (comparison.latencyDelta > threshold);
+  }
+
+  comparison.baselineItersPerSec = baseline.itersPerSec;
+  comparison.candidateItersPerSec = candidate.itersPerSec;
+  comparison.throughputDelta = getDeltaPercent(baseline.itersPerSec, candidate.itersPerSec);
+
+  double baselineMean, baselineVariance, baselineCount;
+  double candidateMean, candidateVariance, candidateCount;
+  getThreadRates(baselineReport, baseline.label, baselineMean, baselineVariance, baselineCount);
+  getThreadRates(candidateReport, candidate.label, candidateMean, candidateVariance, candidateCount);
+  comparison.hasThroughputCi = getWelchInterval(baselineMean, baselineVariance, baselineCount,
+                                                candidateMean, candidateVariance, candidateCount,
+                                                comparison.throughputCiLow, comparison.throughputCiHigh);
+  if(comparison.hasThroughputCi)
+  {
+    comparison.throughputRegressed = (comparison.throughputCiHigh < -threshold);
+  }
+  else
+  {
+    comparison.throughputRegressed = (comparison.throughputDelta < -threshold);
+  }
+}
+
+// Compares the checkpoints by label, those of only one run are listed but not compared
+void compareReports(const Report &baseline, const Report &candidate, double threshold,
+                    vector<Comparison> &comparisons)
+{
+  for(size_t i = 0; i < baseline.totalRows.size(); ++i)
+  {
+    const ReportRow &baselineRow(baseline.totalRows[i]);
+    Comparison comparison;
+    comparison.label = baselineRow.label;
+    comparison.hasBaseline = true;
+
+    map<string, size_t>::const_iterator iter(candidate.totalIndex.find(baselineRow.label));
+    if(iter != candidate.totalIndex.end())
+    {
+      comparison.hasCandidate = true;
+      compareRows(baseline, baselineRow, candidate, candidate.totalRows[iter->second], threshold, comparison);
+    }
+    comparisons.push_back(comparison);
+  }
+
+  for(size_t i = 0; i < candidate.totalRows.size(); ++i)
+  {
+    if(baseline.totalIndex.find(candidate.totalRows[i].label) == baseline.totalIndex.end())
+    {
+      Comparison comparison;
+      comparison.label = candidate.totalRows[i].label;
+      comparison.hasCandidate = true;
+      comparisons.push_back(comparison);
+    }
+  }
+}
+
+void printComparisonText(ostream &out,
+                         const Report &baseline,
+                         const Report &candidate,
+                         uint32_t thresholdPercent,
+                         const vector<Comparison> &comparisons)
+{
+  out << "Baseline [" << baseline.source << "] Threads [" << baseline.numThreads
+      << "] Candidate [" << candidate.source << "] Threads [" << candidate.numThreads
+      << "] Threshold [" << thresholdPercent << "%] Confidence [95%]\n\n";
+
+  uint32_t numRegressed(0);
+  for(size_t i = 0; i < comparisons.size(); ++i)
+  {
+    const Comparison &comparison(comparisons[i]);
+    out << "Checkpoint [" << comparison.label << "]";
+    if(!comparison.hasBaseline || !comparison.hasCandidate)
+    {
+      out << " only in the " << (comparison.hasBaseline ? "baseline" : "candidate") << "\n";
+      continue;
+    }
+
+    const char *unitPtr;
+    double divisor(Checkpoint::getTimeUnitDivisor(comparison.baselineNanos, unitPtr));
+    out << " Latency [Unit,Baseline,Candidate,Delta] = [" << unitPtr
+        << ", " << (comparison.baselineNanos / divisor)
+        << ", " << (comparison.candidateNanos / divisor)
+        << ", " << comparison.latencyDelta << "%]";
+    if(comparison.hasLatencyCi)
+    {
+      out << " CI [" << comparison.latencyCiLow << "%, " << comparison.latencyCiHigh << "%]";
+    }
+    if(comparison.hasHistograms)
+    {
+      out << " Percentiles [";
+      for(int p = 0; p < NUM_PERCENTILES; ++p)
+      {
+        out << (p == 0 ? "" : ",") << PERCENTILE_NAMES[p];
+      }
+      out << "] Delta = [";
+      for(int p = 0; p < NUM_PERCENTILES; ++p)
+      {
+        out << (p == 0 ? "" : ", ") << comparison.percentileDeltas[p] << "%";
+      }
+      out << "] MannWhitney [z,p] = [" << comparison.mannWhitneyZ
+          << ", " << comparison.mannWhitneyP << "]";
+    }
+    out << " Throughput [Baseline,Candidate,Delta] = [" << comparison.baselineItersPerSec
+        << ", " << comparison.candidateItersPerSec
+        << ", " << comparison.throughputDelta << "%]";
+    if(comparison.hasThroughputCi)
+    {
+      out << " CI [" << comparison.throughputCiLow << "%, " << comparison.throughputCiHigh << "%]";
+    }
+    if(comparison.latencyRegressed || comparison.throughputRegressed)
+    {
+      ++numRegressed;
+      out << " REGRESSED [" << (comparison.latencyRegressed ? "latency" : "")
+          << (comparison.latencyRegressed && comparison.throughputRegressed ? "," : "")
+          << (comparison.throughputRegressed ? "throughput" : "") << "]";
+    }
+    out << "\n";
+  }
+
+  out << "\nCheckpoints regressed [" << numRegressed << "] of [" << comparisons.size() << "]" << endl;
+}
+
+void printComparisonCsv(ostream &out, const vector<Comparison> &comparisons)
+{
+  out << "checkpoint,baselineNanos,candidateNanos,latencyDeltaPercent,latencyCiLowPercent,latencyCiHighPercent";
+  for(int i = 0; i < NUM_PERCENTILES; ++i)
+  {
+    out << "," << PERCENTILE_NAMES[i] << "DeltaPercent";
+  }
+  out << ",mannWhitneyZ,mannWhitneyP,baselineItersPerSec,candidateItersPerSec"
+      << ",throughputDeltaPercent,throughputCiLowPercent,throughputCiHighPercent,regressed\n";
+
+  for(size_t i = 0; i < comparisons.size(); ++i)
+  {
+    const Comparison &comparison(comparisons[i]);
+    out << getCsvField(comparison.label);
+    if(!comparison.hasBaseline || !comparison.hasCandidate)
+    {
+      out << ",,,,,";
+      for(int p = 0; p < NUM_PERCENTILES; ++p)
+      {
+        out << ",";
+      }
+      out << ",,,,,,,,\n";
+      continue;
+    }
+
+    out << "," << comparison.baselineNanos
+        << "," << comparison.candidateNanos
+        << "," << comparison.latencyDelta;
+    if(comparison.hasLatencyCi)
+    {
+      out << "," << comparison.latencyCiLow << "," << comparison.latencyCiHigh;
+    }
+    else
+    {
+      out << ",,";
+    }
+    for(int p = 0; p < NUM_PERCENTILES; ++p)
+    {
+      out << ",";
+      if(comparison.hasHistograms)
+      {
+        out << comparison.percentileDeltas[p];
+      }
+    }
+    if(comparison.hasHistograms)
+    {
+      out << "," << comparison.mannWhitneyZ << "," << comparison.mannWhitneyP;
+    }
+    else
+    {
+      out << ",,";
+    }
+    out << "," << comparison.baselineItersPerSec
+        << "," << comparison.candidateItersPerSec
+        << "," << comparison.throughputDelta;
+    if(comparison.hasThroughputCi)
+    {
+      out << "," << comparison.throughputCiLow << "," << comparison.throughputCiHigh;
+    }
+    else
+    {
+      out << ",,";
+    }
+    out << "," << (comparison.latencyRegressed || comparison.throughputRegressed ? 1 : 0) << "\n";
+  }
+}
+
+void printComparisonJson(ostream &out,
+                         const Report &baseline,
+                         const Report &candidate,
+                         uint32_t thresholdPercent,
+                         const vector<Comparison> &comparisons)
+{
+  out << "{\"baseline\":" << getJsonString(baseline.source)
+      << ",\"candidate\":" << getJsonString(candidate.source)
+      << ",\"thresholdPercent\":" << thresholdPercent
+      << ",\"confidence\":0.95"
+      << ",\n \"checkpoints\":[";
+  for(size_t i = 0; i < comparisons.size(); ++i)
+  {
+    const Comparison &comparison(comparisons[i]);
+    out << (i == 0 ? "\n  " : ",\n  ")
+        << "{\"checkpoint\":" << getJsonString(comparison.label)
+        << ",\"inBaseline\":" << (comparison.hasBaseline ? "true" : "false")
+        << ",\"inCandidate\":" << (comparison.hasCandidate ? "true" : "false");
+    if(comparison.hasBaseline && comparison.hasCandidate)
+    {
+      out << ",\"latency\":{\"baselineNanos\":" << comparison.baselineNanos
+          << ",\"candidateNanos\":" << comparison.candidateNanos
+          << ",\"deltaPercent\":" << comparison.latencyDelta;
+      if(comparison.hasLatencyCi)
+      {
+        out << ",\"ciLowPercent\":" << comparison.latencyCiLow
+            << ",\"ciHighPercent\":" << comparison.latencyCiHigh;
+      }
+      if(comparison.hasHistograms)
+      {
+        for(int p = 0; p < NUM_PERCENTILES; ++p)
+        {
+          out << ",\"" << PERCENTILE_NAMES[p] << "DeltaPercent\":" << comparison.percentileDeltas[p];
+        }
+        out << ",\"mannWhitneyZ\":" << comparison.mannWhitneyZ
+            << ",\"mannWhitneyP\":" << comparison.mannWhitneyP;
+      }
+      out << ",\"regressed\":" << (comparison.latencyRegressed ? "true" : "false") << "}";
+      out << ",\"throughput\":{\"baselineItersPerSec\":" << comparison.baselineItersPerSec
+          << ",\"candidateItersPerSec\":" << comparison.candidateItersPerSec
+          << ",\"deltaPercent\":" << comparison.throughputDelta;
+      if(comparison.hasThroughputCi)
+      {
+        out << ",\"ciLowPercent\":" << comparison.throughputCiLow
+            << ",\"ciHighPercent\":" << comparison.throughputCiHigh;
+      }
+      out << ",\"regressed\":" << (comparison.throughputRegressed ? "true" : "false") << "}";
+    }
+    out << "}";
+  }
+  out << "\n]}\n";
+}
+
+// Loads the snapshots, all of them are validated before anything is printed
+bool loadSnapshots(const vector<string> &files, vector<CheckpointSnapshot*> &snapshots)
+{
+  for(size_t i = 0; i < files.size(); ++i)
+  {
+    CheckpointSnapshot *snapshot(new CheckpointSnapshot(files[i]));
+    snapshots.push_back(snapshot);
+    if(!snapshot->isOpen())
+    {
+      cerr << "ERROR reading snapshot file [" << files[i] << "]: "
+           << snapshot->getErrorStr() << endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void deleteSnapshots(vector<CheckpointSnapshot*> &snapshots)
+{
+  for(size_t i = 0; i < snapshots.size(); ++i)
+  {
+    delete snapshots[i];
+  }
+  snapshots.clear();
+}
+
+int main(int argc, char **argv)
+{
+  // Handle the Command line args
+  CmdLineParser clp;
+  loadCmdLine(clp);
+
+  ConfigInput input;
+  if(!parseCommandLine(argc, argv, clp, input))
+  {
+    cerr << "Error parsing command line arguments, exiting" << endl;
+    return 1;
+  }
+
+  vector<CheckpointSnapshot*> snapshots;
+  vector<CheckpointSnapshot*> baselineSnapshots;
+  if(!loadSnapshots(input.snapshotFiles, snapshots) ||
+     !loadSnapshots(input.baselineFiles, baselineSnapshots))
+  {
+    deleteSnapshots(snapshots);
+    deleteSnapshots(baselineSnapshots);
+    return 1;
+  }
+
+  ofstream outputFile;
+  if(input.outputPath != "-")
+  {
+    outputFile.open(input.outputPath.c_str(), ios::out | ios::trunc);
+    if(!outputFile.is_open())
+    {
+      cerr << "ERROR opening output file [" << input.outputPath << "]" << endl;
+      deleteSnapshots(snapshots);
+      deleteSnapshots(baselineSnapshots);
+      return 1;
+    }
+  }
+  ostream &out(outputFile.is_open() ? outputFile : cout);
+
+  // The baseline and the candidate runs are each merged
+  if(!baselineSnapshots.empty())
+  {
+    Report baseline, candidate;
+    buildMergedReport(baselineSnapshots, baseline);
+    buildMergedReport(snapshots, candidate);
+
+    vector<Comparison> comparisons;
+    compareReports(baseline, candidate, input.thresholdPercent, comparisons);
+    if(input.format == FORMAT_TEXT)
+    {
+      printComparisonText(out, baseline, candidate, input.thresholdPercent, comparisons);
+    }
+    else if(input.format == FORMAT_CSV)
+    {
+      printComparisonCsv(out, comparisons);
+    }
+    else
+    {
+      printComparisonJson(out, baseline, candidate, input.thresholdPercent, comparisons);
+    }
+    out << flush;
+
+    deleteSnapshots(snapshots);
+    deleteSnapshots(baselineSnapshots);
+
+    for(size_t i = 0; i < comparisons.size(); ++i)
+    {
+      if(comparisons[i].latencyRegressed || comparisons[i].throughputRegressed)
+      {
+        return EXIT_REGRESSED;
+      }
+    }
+    return 0;
+  }
+
+  if(input.format == FORMAT_CSV)
+  {
+    printCsvHeader(out);
+  }
+  else if(input.format == FORMAT_JSON)
+  {
+    out << "{\"reports\":[\n";
+  }
+
+  if(input.merge)
+  {
+    Report report;
+    buildMergedReport(snapshots, report);
+    printReport(out, input, report, true);
+  }
+  else
+  {
+    for(size_t i = 0; i < snapshots.size(); ++i)
+    {
+      const SnapshotFileHeader &header(snapshots[i]->getHeader());
+      Report report;
+      report.source = snapshots[i]->getPath();
+      report.domainName = snapshots[i]->getDomainName();
+      report.pid = header.pid_;
+      report.clockSource = Checkpoint::getClockSourceStr((Checkpoint::ClockSource) header.clockSource_);
+      report.snapshotMicros = header.snapshotMicros_;
+      addSnapshot(*snapshots[i], false, report);
+      printReport(out, input, report, i == 0);
+    }
+  }
+
+  if(input.format == FORMAT_JSON)
+  {
+    out << "\n]}\n";
+  }
+  out << flush;
+
+  deleteSnapshots(snapshots);
+
+  return 0;
+}
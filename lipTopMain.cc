@@ -0,0 +1,244 @@
+/*
+ * lipTopMain.cc
+ *
+ * lip-top: shows the live per-checkpoint rates and latencies of a process
+ * profiling with Checkpoint::Config::shmName set. The shared-memory stats
+ * segment is only read, the profiled process is never paused.
+ */
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+#include <errno.h>
+#include <signal.h>  // kill()
+#include <stdint.h>  // uint32_t et al
+#include <time.h>    // clock_gettime()
+#include <unistd.h>  // usleep(), isatty()
+
+#include <CmdLineParser.h>
+
+#include "StatsSegment.h"
+
+using namespace std;
+
+const string ARG_SHM_NAME        = "-n";
+const string ARG_INTERVAL_MILLIS = "-i";
+const string ARG_NUM_INTERVALS   = "-c";
+const string ARG_PER_THREAD      = "-t";
+
+struct ConfigInput
+{
+  // Command line options
+  string shmName;
+  uint32_t intervalMillis;
+  uint32_t numIntervals;
+  bool perThread;
+
+  ConfigInput() : shmName("/lip"), intervalMillis(1000), numIntervals(0), perThread(false) {}
+};
+
+void loadCmdLine(CmdLineParser &clp)
+{
+  clp.setMainHelpText("Live view of a Low Impact Profiler shared-memory stats segment");
+
+  //
+  // Optional args
+  //
+  // Segment name
+  clp.addCmdLineOption(new CmdLineOptionStr(ARG_SHM_NAME,
+                                            string("Shared-memory segment name, as in Checkpoint::Config::shmName"),
+                                            string("/lip")));
+  // Refresh interval
+  clp.addCmdLineOption(new CmdLineOptionInt(ARG_INTERVAL_MILLIS,
+                                            string("Refresh interval in milliseconds"),
+                                            1000));
+  // Number of refreshes
+  clp.addCmdLineOption(new CmdLineOptionInt(ARG_NUM_INTERVALS,
+                                            string("Number of refreshes, 0 to run until the process exits"),
+                                            0));
+  // Per thread
+  clp.addCmdLineOption(new CmdLineOptionFlag(ARG_PER_THREAD,
+                                             string("Show each thread, instead of the sum of all threads"),
+                                             false));
+}
+
+bool parseCommandLine(int argc, char **argv, CmdLineParser &clp, ConfigInput &config)
+{
+  if(!clp.parseCmdLine(argc, argv))
+  {
+    clp.printUsage();
+    return false;
+  }
+
+  config.shmName        =  ((CmdLineOptionStr*)   clp.getCmdLineOption(ARG_SHM_NAME))->getValue();
+  config.intervalMillis =  ((CmdLineOptionInt*)   clp.getCmdLineOption(ARG_INTERVAL_MILLIS))->getValue();
+  config.numIntervals   =  ((CmdLineOptionInt*)   clp.getCmdLineOption(ARG_NUM_INTERVALS))->getValue();
+  config.perThread      =  ((CmdLineOptionFlag*)  clp.getCmdLineOption(ARG_PER_THREAD))->getValue();
+
+  if(config.intervalMillis == 0)
+  {
+    config.intervalMillis = 1;
+  }
+
+  return true;
+}
+
+uint64_t getNanos()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((now.tv_sec * (uint64_t)1000000000) + now.tv_nsec);
+}
+
+string getCheckpointLabel(const StatsSegmentReader &reader, uint32_t checkpoint)
+{
+  string name(reader.getCheckpointName(checkpoint));
+  if(!name.empty())
+  {
+    return name;
+  }
+
+  ostringstream label;
+  label << checkpoint;
+  return label.str();
+}
+
+// Prints a line per checkpoint that was hit in the interval
+void printInterval(const StatsSegmentReader &reader,
+                   const string &threadLabel,
+                   const vector<StatsCounters> &current,
+                   const vector<StatsCounters> &previous,
+                   double elapsedSeconds)
+{
+  double nanosPerCycle(reader.getHeader().nanosPerCycle_);
+  for(uint32_t chkPoint = 0; chkPoint < current.size(); ++chkPoint)
+  {
+    // A slot that was re-initialized starts counting from 0 again
+    StatsCounters start(previous[chkPoint]);
+    if(current[chkPoint].iterations_ < start.iterations_)
+    {
+      start = StatsCounters();
+    }
+    uint64_t iterations(current[chkPoint].iterations_ - start.iterations_);
+    uint64_t cycles(current[chkPoint].totalCycles_ - start.totalCycles_);
+    if(iterations == 0)
+    {
+      continue;
+    }
+
+    cout << setw(8) << threadLabel
+         << setw(24) << getCheckpointLabel(reader, chkPoint)
+         << setw(16) << (uint64_t) (iterations / elapsedSeconds)
+         << setw(16) << (uint64_t) ((cycles * nanosPerCycle) / iterations)
+         << setw(20) << current[chkPoint].iterations_
+         << "\n";
+  }
+}
+
+int main(int argc, char **argv)
+{
+  // Handle the Command line args
+  CmdLineParser clp;
+  loadCmdLine(clp);
+
+  ConfigInput input;
+  if(!parseCommandLine(argc, argv, clp, input))
+  {
+    cerr << "Error parsing command line arguments, exiting" << endl;
+    return 1;
+  }
+
+  StatsSegmentReader reader(input.shmName);
+  if(!reader.isOpen())
+  {
+    cerr << "ERROR reading stats segment [" << input.shmName << "]: "
+         << reader.getErrorStr() << endl;
+    return 1;
+  }
+
+  const StatsSegmentHeader &header(reader.getHeader());
+  uint32_t numSlots(header.numThreadSlots_);
+  vector<vector<StatsCounters> > previous(numSlots);
+  vector<vector<StatsCounters> > current(numSlots);
+  vector<StatsCounters> previousSum, currentSum;
+  bool isTty(isatty(STDOUT_FILENO));
+
+  for(uint32_t slot = 0; slot < numSlots; ++slot)
+  {
+    reader.readThread(slot, previous[slot]);
+  }
+  uint64_t previousNanos(getNanos());
+
+  for(uint32_t interval = 0; input.numIntervals == 0 || interval < input.numIntervals; ++interval)
+  {
+    usleep(input.intervalMillis * 1000);
+
+    bool processExited(kill(header.pid_, 0) != 0 && errno == ESRCH);
+
+    // A slot whose copy was not consistent keeps its previous counters
+    for(uint32_t slot = 0; slot < numSlots; ++slot)
+    {
+      if(!reader.readThread(slot, current[slot]))
+      {
+        current[slot] = previous[slot];
+      }
+    }
+    uint64_t currentNanos(getNanos());
+    double elapsedSeconds((currentNanos - previousNanos) / 1000000000.0);
+
+    if(isTty)
+    {
+      cout << "\033[H\033[2J";
+    }
+    cout << "lip-top [" << input.shmName
+         << "] pid [" << header.pid_
+         << "] interval [" << input.intervalMillis << "] ms\n"
+         << setw(8) << "Thread"
+         << setw(24) << "Checkpoint"
+         << setw(16) << "Iters/sec"
+         << setw(16) << "AvgNanos"
+         << setw(20) << "TotalIters"
+         << "\n";
+
+    if(input.perThread)
+    {
+      for(uint32_t slot = 0; slot < numSlots; ++slot)
+      {
+        ostringstream threadLabel;
+        threadLabel << slot;
+        printInterval(reader, threadLabel.str(), current[slot], previous[slot], elapsedSeconds);
+      }
+    }
+    else
+    {
+      previousSum.assign(header.numCheckpoints_, StatsCounters());
+      currentSum.assign(header.numCheckpoints_, StatsCounters());
+      for(uint32_t slot = 0; slot < numSlots; ++slot)
+      {
+        for(uint32_t chkPoint = 0; chkPoint < header.numCheckpoints_; ++chkPoint)
+        {
+          previousSum[chkPoint].iterations_  += previous[slot][chkPoint].iterations_;
+          previousSum[chkPoint].totalCycles_ += previous[slot][chkPoint].totalCycles_;
+          currentSum[chkPoint].iterations_   += current[slot][chkPoint].iterations_;
+          currentSum[chkPoint].totalCycles_  += current[slot][chkPoint].totalCycles_;
+        }
+      }
+      printInterval(reader, "all", currentSum, previousSum, elapsedSeconds);
+    }
+    cout << flush;
+
+    if(processExited)
+    {
+      cout << "Process [" << header.pid_ << "] exited" << endl;
+      break;
+    }
+
+    previous.swap(current);
+    previousNanos = currentNanos;
+  }
+
+  return 0;
+}
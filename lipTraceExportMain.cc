@@ -0,0 +1,119 @@
+/*
+ * lipTraceExportMain.cc
+ *
+ * Converts a Low Impact Profiler trace file into Chrome trace-event JSON,
+ * to be loaded in chrome://tracing or https://ui.perfetto.dev
+ */
+
+#include <string>
+#include <iostream>
+
+#include <errno.h>
+#include <fcntl.h>   // open()
+#include <string.h>  // strerror()
+#include <unistd.h>  // close()
+
+#include <CmdLineParser.h>
+
+#include "ChromeTraceExporter.h"
+
+using namespace std;
+
+const string ARG_TRACE_FILE  = "-i";
+const string ARG_JSON_FILE   = "-o";
+
+struct ConfigInput
+{
+  // Command line options
+  string traceFile;
+  string jsonFile;
+
+  ConfigInput() : traceFile("lip.trace"), jsonFile("-") {}
+};
+
+void loadCmdLine(CmdLineParser &clp)
+{
+  clp.setMainHelpText("Export a Low Impact Profiler trace file as Chrome trace-event JSON");
+
+  //
+  // Optional args
+  //
+  // Trace file
+  clp.addCmdLineOption(new CmdLineOptionStr(ARG_TRACE_FILE,
+                                            string("Trace file written with Checkpoint::Config::tracePath"),
+                                            string("lip.trace")));
+  // JSON file
+  clp.addCmdLineOption(new CmdLineOptionStr(ARG_JSON_FILE,
+                                            string("JSON output file, - for stdout"),
+                                            string("-")));
+}
+
+bool parseCommandLine(int argc, char **argv, CmdLineParser &clp, ConfigInput &config)
+{
+  if(!clp.parseCmdLine(argc, argv))
+  {
+    clp.printUsage();
+    return false;
+  }
+
+  config.traceFile  =  ((CmdLineOptionStr*)  clp.getCmdLineOption(ARG_TRACE_FILE))->getValue();
+  config.jsonFile   =  ((CmdLineOptionStr*)  clp.getCmdLineOption(ARG_JSON_FILE))->getValue();
+
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  // Handle the Command line args
+  CmdLineParser clp;
+  loadCmdLine(clp);
+
+  ConfigInput input;
+  if(!parseCommandLine(argc, argv, clp, input))
+  {
+    cerr << "Error parsing command line arguments, exiting" << endl;
+    return 1;
+  }
+
+  ChromeTraceExporter exporter(input.traceFile);
+  if(!exporter.isOpen())
+  {
+    cerr << "ERROR reading trace file [" << input.traceFile << "]: "
+         << exporter.getErrorStr() << endl;
+    return 1;
+  }
+
+  int fd(STDOUT_FILENO);
+  if(input.jsonFile != "-")
+  {
+    fd = open(input.jsonFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+    {
+      cerr << "ERROR opening JSON file [" << input.jsonFile << "]: "
+           << strerror(errno) << endl;
+      return 1;
+    }
+  }
+
+  bool exported(exporter.exportTo(fd));
+  if(fd != STDOUT_FILENO && close(fd) != 0)
+  {
+    exported = false;
+  }
+  if(!exported)
+  {
+    cerr << "ERROR exporting trace file [" << input.traceFile << "]: "
+         << exporter.getErrorStr() << endl;
+    return 1;
+  }
+
+  cerr << "Exported [" << exporter.getNumSlices() << "] slices from ["
+       << exporter.getNumRecords() << "] trace records";
+  if(exporter.getNumOverflows() > 0)
+  {
+    cerr << ", [" << exporter.getNumOverflows() << "] records were dropped while tracing";
+  }
+  cerr << endl;
+
+  return 0;
+}
@@ -22,6 +22,7 @@ using namespace std;
 const string ARG_SLEEP_MICROS   = "-s";
 const string ARG_NUM_LOOPS      = "-l";
 const string ARG_LIP_LOCKING    = "-b";
+const string ARG_LIP_CLOCK      = "-c";
 
 struct ConfigInput
 {
@@ -30,8 +31,9 @@ struct ConfigInput
   struct timespec sleepTime;
   uint32_t numLoops;
   bool lipLocking;
+  uint32_t lipClock;
 
-  ConfigInput() : sleepMicros(500), numLoops(10), lipLocking(false) {}
+  ConfigInput() : sleepMicros(500), numLoops(10), lipLocking(false), lipClock(0) {}
 };
 
 void loadCmdLine(CmdLineParser &clp)
@@ -54,6 +56,10 @@ void loadCmdLine(CmdLineParser &clp)
   clp.addCmdLineOption(new CmdLineOptionFlag(ARG_LIP_LOCKING,
                                              string("Use locking checkpoints"),
                                              false));
+  // Profiler clock source
+  clp.addCmdLineOption(new CmdLineOptionInt(ARG_LIP_CLOCK,
+                                            string("Checkpoint clock: 0=REALTIME usec, 1=MONOTONIC_RAW, 2=TSC, 3=TSCP"),
+                                            0));
 }
 
 
@@ -68,6 +74,7 @@ bool parseCommandLine(int argc, char **argv, CmdLineParser &clp, ConfigInput &co
   config.sleepMicros  =  ((CmdLineOptionInt*)   clp.getCmdLineOption(ARG_SLEEP_MICROS))->getValue();
   config.numLoops     =  ((CmdLineOptionInt*)   clp.getCmdLineOption(ARG_NUM_LOOPS))->getValue();
   config.lipLocking   =  ((CmdLineOptionFlag*)  clp.getCmdLineOption(ARG_LIP_LOCKING))->getValue();
+  config.lipClock     =  ((CmdLineOptionInt*)   clp.getCmdLineOption(ARG_LIP_CLOCK))->getValue();
 
   if(config.sleepMicros >= 1000000)
   {
@@ -177,7 +184,11 @@ int main(int argc, char **argv)
   printTime("\nInitializing Profiler");
 
   // Initializing with 0 means not multi-threaded
-  Checkpoint::initialize(0, input.lipLocking);
+  Checkpoint::Config lipConfig;
+  lipConfig.numThreads = 0;
+  lipConfig.useLocking = input.lipLocking;
+  lipConfig.clockSource = (Checkpoint::ClockSource) input.lipClock;
+  Checkpoint::initialize(lipConfig);
 
   getCycles(start);
 
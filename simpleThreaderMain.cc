@@ -29,6 +29,7 @@ const string ARG_NUM_THREADS    = "-t";
 const string ARG_SLEEP_MICROS   = "-s";
 const string ARG_NUM_LOOPS      = "-l";
 const string ARG_LIP_LOCKING    = "-b";
+const string ARG_LIP_CLOCK      = "-c";
 
 struct ConfigInput
 {
@@ -37,8 +38,9 @@ struct ConfigInput
   uint32_t sleepMicros;
   uint32_t numLoops;
   bool lipLocking;
+  uint32_t lipClock;
 
-  ConfigInput() : numThreads(3), sleepMicros(500), numLoops(10), lipLocking(false) {}
+  ConfigInput() : numThreads(3), sleepMicros(500), numLoops(10), lipLocking(false), lipClock(0) {}
 };
 
 void loadCmdLine(CmdLineParser &clp)
@@ -64,6 +66,10 @@ void loadCmdLine(CmdLineParser &clp)
   clp.addCmdLineOption(new CmdLineOptionFlag(ARG_LIP_LOCKING,
                                              string("Use locking checkpoints"),
                                              false));
+  // Profiler clock source
+  clp.addCmdLineOption(new CmdLineOptionInt(ARG_LIP_CLOCK,
+                                            string("Checkpoint clock: 0=REALTIME usec, 1=MONOTONIC_RAW, 2=TSC, 3=TSCP"),
+                                            0));
 }
 
 
@@ -79,6 +85,7 @@ bool parseCommandLine(int argc, char **argv, CmdLineParser &clp, ConfigInput &co
   config.sleepMicros  =  ((CmdLineOptionInt*)   clp.getCmdLineOption(ARG_SLEEP_MICROS))->getValue();
   config.numLoops     =  ((CmdLineOptionInt*)   clp.getCmdLineOption(ARG_NUM_LOOPS))->getValue();
   config.lipLocking   =  ((CmdLineOptionFlag*)  clp.getCmdLineOption(ARG_LIP_LOCKING))->getValue();
+  config.lipClock     =  ((CmdLineOptionInt*)   clp.getCmdLineOption(ARG_LIP_CLOCK))->getValue();
 
   // Check that the number of threads configured is not too high for the system
   struct rlimit rlimit;
@@ -154,7 +161,11 @@ int main(int argc, char **argv)
 
   printTime("\nStarting Threads");
 
-  Checkpoint::initialize(input.numThreads, input.lipLocking);
+  Checkpoint::Config lipConfig;
+  lipConfig.numThreads = input.numThreads;
+  lipConfig.useLocking = input.lipLocking;
+  lipConfig.clockSource = (Checkpoint::ClockSource) input.lipClock;
+  Checkpoint::initialize(lipConfig);
 
   pthread_t threadIds[input.numThreads];
   for(int i = 0; i < input.numThreads; ++i)